@@ -22,6 +22,29 @@
  * F4 and F5 toggle textures on and off. F4 turns on a texture for the water in the pool.
  * F5 toggles the tiled texture on the walls of the pool.
  *
+ * F6 toggles animated water, which can also be turned on from the start
+ * with --animated-water on the command line.
+ *
+ * The scene is only redrawn when something changes or moves, at most 60
+ * times a second, or --frame-rate N times (0 for as fast as the display
+ * allows).
+ *
+ * Each hanging light lights the scene around it. --lights N adds N more
+ * small lights of random colors around the hall. F10 (or --sway-lamps)
+ * sets the hanging lights swinging on their cords.
+ *
+ * F7 starts recording a profile of each frame, and pressing it again
+ * writes what has been recorded to trace.json. --profile FILE records
+ * from the start instead and writes the profile to FILE on exit.
+ *
+ * Opaque surfaces are drawn nearest first. F8 (or --depth-prepass) draws
+ * them into the depth buffer alone before shading them. F9 (or
+ * --overdraw) shows how many times each pixel is shaded instead of the
+ * scene, brighter the more often, with the average in the title.
+ *
+ * --software draws the scene on the CPU with a tiled rasterizer of its
+ * own instead, for machines without a GPU, and shows it in the window.
+ *
  * Based on: Unit 8 Section 2 Objective 1 ,Unit 9 Sections 1 Objective 2 by Steve Leung in the 
  *           COMP 390 study guide.
  *
@@ -30,20 +53,48 @@
  * Blue pool tile texture from vecteezy.com
  */
 
-#include <Windows.h>
-#include "gl/gl.h"
-#include "gl/glut.h"
+#include "glFunctions.h"
+#include "GL/glut.h"
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <cmath>
 #include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <random>
 #include "vector3.h"
+#include "textureStream.h"
+#include "mesh.h"
+#include "vertexCache.h"
+#include "matrix4.h"
+#include "model.h"
+#include "sceneGraph.h"
+#include "instancing.h"
+#include "glState.h"
+#include "frameCache.h"
+#include "frameScheduler.h"
+#include "jobs.h"
+#include "lightClusters.h"
+#include "opaqueQueue.h"
+#include "overdraw.h"
+#include "profiler.h"
+#include "sceneShader.h"
+#include "staticBatch.h"
+#include "softwareRenderer.h"
+#include "water.h"
+#include "bench.h"
 
 using namespace std;
 
 #define PI 3.1415926536
 bool textured_water = false;
+bool animated_water = false;
+bool swaying_lamps = false;
 bool plain_walls = false;
 bool light_zero = true;
 bool light_one = true;
@@ -67,25 +118,19 @@ GLfloat blue_light[] = {0.2, 0.2, 1.0, 1.0};
 
 GLfloat lmodel_ambient[] = {0.1, 0.1, 0.1, 1.0};
 
-// Surface parameters
-GLfloat shiny_ambient[] = {0.8, 0.8, 0.8, 1.0};
-GLfloat shiny_diffuse[] = {0.6, 0.6, 0.6, 1.0};
+// Surface parameters. The ambient and diffuse colors of a surface are
+// the color it is drawn with.
 GLfloat shiny_specular[] = {0.508273, 0.508273, 0.508273, 1.0};
-GLfloat shiny_shininess[] = {100};
+GLfloat shiny_shininess = 100;
 
-GLfloat ambient[] = {0.5, 0.5, 0.5, 1.0};
-GLfloat diffuse[] = {0.5, 0.5, 0.5, 1.0};
 GLfloat specular[] = {0.2, 0.2, 0.2, 1.0};
-GLfloat shininess[] = {1.0};
+GLfloat shininess = 1.0;
 
-// A struct to hold the relevant data for one texture image.
-struct TEXTURE {
-  string fn;
-  GLubyte *image;
-  GLubyte *l_texture;
-  BITMAPFILEHEADER fileheader;
-  BITMAPINFOHEADER infoheader;
-} texture;
+// The image holding the tile, water and wall textures, 2800 * 1960,
+// and its upload, at most TEXTURE_STREAM_BUDGET bytes a frame.
+const char *TEXTURE_FILE = "combined-texture.bmp";
+const size_t TEXTURE_STREAM_BUDGET = 2 << 20;
+TextureStream textureStream;
 
 // The initial viewing position and direction.
 vector3 viewer = vector3(50, 50, 150);
@@ -94,39 +139,107 @@ vector3 lookAt = vector3(0, 0, 0);
 // Used to track the mouse position in order to move the camera.
 int mouseX, mouseY;
 
-// GLuints for list IDs.
-GLuint cube;
-GLuint circle;
-GLuint cylinder;
-GLuint sphere;
-GLuint dome;
-GLuint triPyramid;
-GLuint squarePyramid;
-GLuint triPrism;
-GLuint poolChair;
-GLuint divingBoard;
-GLuint hangingLight;
-GLuint ladder;
-GLuint poolNoodles;
+// Camera movement received since the last frame, which applies it all at
+// once: the mouse movement while dragging, and steps forward (or back,
+// when negative) from the arrow keys.
+int pendingTurnX = 0, pendingTurnY = 0;
+int pendingSteps = 0;
+
+// The most frames a second to draw, or 0 to draw as fast as the buffer
+// swap allows.
+double frameRate = 60;
+
+// Meshes for the primitive shapes.
+Mesh cube;
+Mesh circle;
+Mesh cylinder;
+Mesh sphere;
+Mesh dome;
+Mesh triPyramid;
+Mesh squarePyramid;
+Mesh triPrism;
+
+// Every placed composite object, drawn instanced, and the
+// transform hierarchy they are placed in.
+SceneGraph scene;
+InstanceBatch sceneObjects;
+
+// The lights other than the viewer's spot lights: one at each hanging
+// light's globe, following its scene node, then any number more around
+// the hall (--lights), all binned into clusters every frame.
+LightClusters lightClusters;
+vector<ClusterLight> clusterLights;
+vector<int> lampNodes;
+int extraLights = 0;
+
+// Where each hanging light's cord is fixed to the ceiling, the node its
+// light hangs from, swung about by swayLamps.
+vector<vector3> lampMounts;
+vector<int> lampMountNodes;
+
+// The deck, pool and ceiling, and the walls with and without tiles.
+StaticBatch poolDeck;
+StaticBatch tiledWalls;
+StaticBatch plainWalls;
+
+// The opaque draws of the frame, nearest first, and whether to draw them
+// into the depth buffer before shading them.
+OpaqueQueue opaqueQueue;
+bool depth_prepass = false;
+
+// Whether to show and count how many times each pixel is shaded instead
+// of drawing the scene.
+bool show_overdraw = false;
+
+// Whether to draw the scene on the CPU instead of with OpenGL, and what
+// draws it.
+bool software_rendering = false;
+SoftwareRenderer softwareRenderer;
+
+// The water in the pool, tessellated into WATER_RESOLUTION x WATER_RESOLUTION quads.
+const int WATER_RESOLUTION = 128;
+WaterSurface water;
+
+// The simulated water used instead while animated_water is set,
+// a grid of WATER_SIM_COLUMNS across the pool by WATER_SIM_ROWS along it.
+const int WATER_SIM_COLUMNS = 512;
+const int WATER_SIM_ROWS = 1024;
+AnimatedWater animatedWater;
+
+// The last frame the window showed, and what it showed: the camera and
+// every toggle. While they stay the same only the animated water needs
+// drawing again.
+struct FrameState {
+  vector3 viewer, lookAt;
+  bool lights[3];
+  bool texturedWater, plainWalls, animatedWater;
+};
+FrameCache frameCache;
+FrameState cachedFrameState;
+
+// Where the profile is written, on exit with --profile or on F7.
+string profileFile = "trace.json";
 
 /*
  * Helper function to enable shiny material properties.
  */
 void shinyMaterial() {
-  glMaterialfv(GL_FRONT, GL_AMBIENT, shiny_ambient);
-  glMaterialfv(GL_FRONT, GL_SPECULAR, shiny_specular);
-  glMaterialfv(GL_FRONT, GL_DIFFUSE, shiny_diffuse);
-  glMaterialfv(GL_FRONT, GL_SHININESS, shiny_shininess);
+  useSceneMaterial(ShinyMaterial);
 }
 
 /*
  * Helper function to restore default material properties.
  */
 void defaultMaterial() {
-  glMaterialfv(GL_FRONT, GL_AMBIENT, ambient);
-  glMaterialfv(GL_FRONT, GL_SPECULAR, specular);
-  glMaterialfv(GL_FRONT, GL_DIFFUSE, diffuse);
-  glMaterialfv(GL_FRONT, GL_SHININESS, shininess);
+  useSceneMaterial(DefaultMaterial);
+}
+
+/*
+ * Helper function to enable default material properties
+ * for a surface that emits white light.
+ */
+void glowingMaterial() {
+  useSceneMaterial(GlowingMaterial);
 }
 
 /*
@@ -163,1068 +276,323 @@ void checkError() {
   } 
 }
 
-/* 
- * Read an image file into memory and store the texture data
- * in t.l_texture as a sequence of RGBA bytes.
- */
-void makeImage(TEXTURE *t) {
-  RGBTRIPLE rgb;
-  long int i, j;
-  FILE *l_file;
-
-  const char * filename = t->fn.c_str();
-
-  // Open image file, return if error.
-  fopen_s(&l_file, filename, "rb");
-  if (l_file == NULL) return;
-
-  // Read file header and header info.
-  fread(&t->fileheader, sizeof(t->fileheader), 1, l_file);
-  fseek(l_file, sizeof(t->fileheader), SEEK_SET);
-  fread(&t->infoheader, sizeof(t->infoheader), 1, l_file);
-
-  // Allocate space for the image file.
-  t->l_texture = (GLubyte *) malloc(t->infoheader.biWidth * t->infoheader.biHeight * 4);
-  if (t->l_texture == NULL) return;
-  memset(t->l_texture, 0, t->infoheader.biWidth * t->infoheader.biHeight * 4);
-
-  // Read the data.
-  j = 0;
-  //  int row = 0;
-  for (i = 0; i < t->infoheader.biWidth * t->infoheader.biHeight; i++) {
-    fread(&rgb, sizeof(rgb), 1, l_file);
-
-    t->l_texture[j] = (GLubyte) rgb.rgbtRed;
-    t->l_texture[j+1] = (GLubyte) rgb.rgbtGreen;
-    t->l_texture[j+2] = (GLubyte) rgb.rgbtBlue;
-    t->l_texture[j+3] = (GLubyte) 0;
-    
-    j += 4;
-  }
-  fclose(l_file);
-}
-
 /*
- * Helper function to allocate one list id,
- * or exit if glGenLists fails.
+ * Helper function to build one side of the frame of a pool chair.
  */
-GLuint listIdOrExit() {
-  GLuint id;
-  id = glGenLists(1);
-  if (id == 0) {
-    cerr << "glGenLists failed. exiting now." << endl;
-    exit(1);
-  }
-  return id;
-}
-  
-/*
- * Define a display list that draws a cube. 
- *
- * The cube has a side length of one and is centered
- * on the origin.
- *
- * Returns the listId.
- */
-GLuint makeCube() {
-  GLuint id = listIdOrExit();
-
-  vector3 a = vector3(-0.5, -0.5, 0.5);
-  vector3 b = vector3(0.5, -0.5, 0.5);
-  vector3 c = vector3(0.5, 0.5, 0.5);
-  vector3 d = vector3(-0.5, 0.5, 0.5);
-  vector3 e = vector3(0.5, -0.5, -0.5);
-  vector3 f = vector3(0.5, 0.5, -0.5);
-  vector3 g = vector3(-0.5, 0.5, -0.5);
-  vector3 h = vector3(-0.5, -0.5, -0.5);
-  
-// A macro to expand a vector into a glVertex3f  
-#define EXP(q) q.x, q.y, q.z  
-  
-  // Draw a cube with side length of 1, centered on the origin.
-  glNewList(id, GL_COMPILE); 
-
-  glBegin(GL_QUADS);
-  
-  glVertex3f(EXP(b));
-  glVertex3f(EXP(e));
-  glVertex3f(EXP(f));
-  glVertex3f(EXP(c));
-
-  glVertex3f(EXP(h));
-  glVertex3f(EXP(a));
-  glVertex3f(EXP(d));
-  glVertex3f(EXP(g));
-
-  glVertex3f(EXP(a));
-  glVertex3f(EXP(b));
-  glVertex3f(EXP(c));
-  glVertex3f(EXP(d));
-
-  glVertex3f(EXP(e));
-  glVertex3f(EXP(h));
-  glVertex3f(EXP(g));
-  glVertex3f(EXP(f));
-
-  glVertex3f(EXP(c));
-  glVertex3f(EXP(f));
-  glVertex3f(EXP(g));
-  glVertex3f(EXP(d));  
-
-  glVertex3f(EXP(e));
-  glVertex3f(EXP(b));
-  glVertex3f(EXP(a));
-  glVertex3f(EXP(h));  
-  
-  glEnd();
-  
-  glEndList();
-  
-  return id;
+Model makePoolChairFrame() {
+  Model frame;
+  frame.setMaterial(defaultMaterial);
+  frame.setColor(1.0, 1.0, 1.0, 0.0);
+
+  frame.add(cylinder, matrix4().scale(0.5, 0.5, 2.0));
+  frame.add(cylinder, matrix4().translate(0.0, -3, -17).rotate(45.0, 1.0, 0.0, 0.0).scale(0.5, 0.5, 0.4));
+  frame.add(cylinder, matrix4().translate(0.0, -0.2, 0.0).rotate(-45.0, 1.0, 0.0, 0.0).scale(0.5, 0.5, 0.4));
+  frame.add(cylinder, matrix4().translate(0.0, -3, -5.0).rotate(45.0, 1.0, 0.0, 0.0).scale(0.5, 0.5, 0.4));
+  frame.add(cylinder, matrix4().translate(0.0, -0.2, -10.0).rotate(-45.0, 1.0, 0.0, 0.0).scale(0.5, 0.5, 0.4));
+  frame.add(cylinder, matrix4().translate(0.0, -2.9, -2.5).scale(0.5, 0.5, 0.27));
+  frame.add(cylinder, matrix4().translate(0.0, -2.9, -12.5).scale(0.5, 0.5, 0.47));
+  frame.add(sphere, matrix4().translate(0.0, -0.05, 0.05).scale(0.525, 0.525, 0.525));
+  frame.add(sphere, matrix4().translate(0.0, -0.05, -20.05).scale(0.525, 0.525, 0.525));
+
+  return frame;
 }
 
 /*
- * Define a display list that draws a circle.
- * Takes the number of points to use in constructing the 
- * circle as an argument; must be positive.
- * Draws the circle in the xy plane, centered at the origin.
- * 
- * Returns the list id.
+ * Build a pool chair.
  */
-GLuint makeCircle(int numPoints) {
-  assert(numPoints > 0);
+Model makePoolChair() {
+  Model chair;
+  chair.setMaterial(defaultMaterial);
+  chair.setColor(1.0, 1.0, 1.0, 0.0);
 
-  GLuint id = listIdOrExit();
-  
-  glNewList(id, GL_COMPILE);
-    
-  glBegin(GL_POLYGON);  
-  for (int i = 0; i < numPoints; i++) {
-    double angle = i * (2*PI / numPoints);
-    glVertex3d(cos(angle), sin(angle), 0);
-  }
-  glEnd();
+  chair.add(cube, matrix4().rotate(90.0, 1.0, 0.0, 0.0).scale(10.0, 20.0, 1.0));
+  chair.add(cube, matrix4().translate(0.0, 5.0, -14.0).rotate(-45.0, 1.0, 0.0, 0.0).scale(10.0, 10.0, 1.0));
 
-  glEndList();
+  Model frame = makePoolChairFrame();
+  chair.add(frame, matrix4::translation(5.5, 0.0, 9.5));
+  chair.add(frame, matrix4::translation(-5.5, 0.0, 9.5));
 
-  return id;
+  return chair;
 }
 
 /*
- * Defines a display list that draws a cylinder.
- * numPoints is the number of points used to approximate 
- * the circles, it must be positive.
- * Length must be positive.
- * Returns the list Id.
+ * Helper function to build one railing of the diving board.
  */
-GLuint makeCylinder(int numPoints, int length) {
-  assert(length > 0);
-  GLuint id = listIdOrExit();
-
-  double *pointsX = new double[numPoints];
-  double *pointsY = new double[numPoints];
-
+Model makeDivingBoardRailing() {
+  Model railing;
+  railing.setMaterial(shinyMaterial);
+  railing.setColor(0.5, 0.5, 0.5, 0.0);
 
-  for(int i = 0; i < numPoints; i++) {
-    double angle = i * (2 * PI / numPoints);
-    pointsX[i] = cos(angle);
-    pointsY[i] = sin(angle);
-  }
+  railing.add(cylinder, matrix4().scale(0.5, 0.5, 3.0));
+  railing.add(cylinder, matrix4().translate(0.0, -12.5, -15.0).rotate(45.0, 1.0, 0.0, 0.0).scale(0.5, 0.5, 1.75));
+  railing.add(cylinder, matrix4().translate(0.0, 0.0, -1.0).rotate(-60.0, 1.0, 0.0, 0.0).scale(0.5, 0.5, 1.5));
 
-  glNewList(id, GL_COMPILE);
-
-  // One end of the cylinder.
-  glBegin(GL_POLYGON);
-  for(int i = 0; i < numPoints; i++)
-    glVertex3d(pointsX[i], pointsY[i], 0);
-  glEnd();
-  // The other end of the cylinder.
-  glBegin(GL_POLYGON);  
-  for(int i = numPoints - 1; i >= 0; i--)
-    glVertex3d(pointsX[i], pointsY[i], (double)-length);
-  glEnd();
-  // The middle of the cylinder.
-  glBegin(GL_TRIANGLE_STRIP);
-  for(int i = 0; i < numPoints; i++){
-    if ((i % 2) == 0)
-      glVertex3d(pointsX[i], pointsY[i], 0);
-    else
-      glVertex3d(pointsX[i], pointsY[i], (double)-length);
-  }
-  glVertex3d(pointsX[0], pointsY[0], 0);
-  glVertex3d(pointsX[1], pointsY[1], (double)-length);
-  glEnd();
-  
-  glEndList();
-
-  delete[] pointsX;
-  delete[] pointsY;
-  
-  return id;
+  return railing;
 }
 
 /*
- * Defines a display list that draws a sphere.
- * Draws the sphere as a "stack of pancakes".
- * numStacks is the number of pancakes, and 
- * numPoints is the number of points used to 
- * approximate the outer edge of each pancake.
- * The sphere is drawn with a radius of 1, centered
- * on the origin. 
- *
- * Returns the list id.
+ * Build a diving board.
  */
-GLuint makeSphere(int numPoints, int numStacks) {
-  assert((numPoints > 0) && (numStacks > 0));
+Model makeDivingBoard() {
+  Model board;
+  board.setMaterial(defaultMaterial);
 
-  if ((numStacks % 2) != 0) {
-    numStacks++;
-  }
-  
-  GLuint id = listIdOrExit();
+  board.setColor(0.8, 0.8, 1.0, 0.0);
+  board.add(cube, matrix4().scale(10.0, 15.0, 15.0));
 
-  double *pointsX = new double[numPoints];
-  double *pointsZ = new double[numPoints];  
+  board.setColor(0.8, 1.0, 0.8, 0.);
+  board.add(cube, matrix4().translate(0.0, 8.0, 0.0).scale(15.0, 1.0, 25.0));
+  board.add(cube, matrix4().translate(0.0, 3.0, 10.0).rotate(-30.0, 1.0, 0.0, 0.0).scale(10.0, 12.0, 1.0));
 
-  for(int i = 0; i < numPoints; i++) {
-    double angle = i * (2 * PI / numPoints);
-    pointsX[i] = cos(angle);
-    pointsZ[i] = sin(angle);
-  }  
+  // The steps.
+  board.setColor(0.7, 1.0, 0.7, 0.0);
+  board.add(triPrism, matrix4().translate(0.0, -1.75, 13.8).rotate(-60.0, 1.0, 0.0, 0.0).scale(9.5, 2.0, 2.0));
+  board.add(triPrism, matrix4().translate(0.0, 0.5, 12.8).rotate(-60.0, 1.0, 0.0, 0.0).scale(9.5, 2.0, 2.0));
+  board.add(triPrism, matrix4().translate(0.0, 2.75, 11.5).rotate(-60.0, 1.0, 0.0, 0.0).scale(9.5, 2.0, 2.0));
 
-  glNewList(id, GL_COMPILE);
+  board.setColor(1.0, 1.0, 1.0, 0.0);
+  board.add(cube, matrix4().translate(0.0, 9.0, -22.4).scale(10.0, 1.0, 70.0));
 
-  for (int stackPair = 0; stackPair < (numStacks / 2); stackPair++) {
-    double chordSize = PI / numStacks;
-    double outerAngle = stackPair * chordSize;
-    double innerAngle = (stackPair + 1) * chordSize;
-    double outerCoef = cos(outerAngle);
-    double innerCoef = cos(innerAngle);
-  
-    glBegin(GL_TRIANGLE_STRIP);
-    for(int i = 0; i < numPoints; i++) {
-      glVertex3d(outerCoef * pointsX[i], sin(outerAngle), outerCoef * pointsZ[i]);
-      glVertex3d(innerCoef * pointsX[i], sin(innerAngle), innerCoef * pointsZ[i]);
-    }
-    glVertex3d(outerCoef * pointsX[0], sin(outerAngle), outerCoef * pointsZ[0]);
-    glVertex3d(innerCoef * pointsX[1], sin(innerAngle), innerCoef * pointsZ[1]);
-    glEnd();
-
-    glBegin(GL_TRIANGLE_STRIP);
-    for(int i = 0; i < numPoints; i++) {
-      glVertex3d(outerCoef * pointsX[i], -sin(outerAngle), outerCoef * pointsZ[i]);
-      glVertex3d(innerCoef * pointsX[i], -sin(innerAngle), innerCoef * pointsZ[i]);
-    }
-    glVertex3d(outerCoef * pointsX[0], -sin(outerAngle), outerCoef * pointsZ[0]);
-    glVertex3d(innerCoef * pointsX[1], -sin(innerAngle), innerCoef * pointsZ[1]);
-    glEnd();
+  Model railing = makeDivingBoardRailing();
+  board.add(railing, matrix4::translation(-5.5, 20.0, 14.0));
+  board.add(railing, matrix4::translation(5.5, 20.0, 14.0));
 
-  }
-  
-  // From some angles a gap appears in the sphere.
-  // So we add this circle in the centre of the sphere.
-  glPushMatrix();
-  glRotatef(90.0, 1.0, 0.0, 0.0);
-  glCallList(circle);
-  glPopMatrix();
-
-  glEndList();
-
-  delete[] pointsX;
-  delete[] pointsZ;
-  
-  return id;
+  return board;
 }
 
 /*
- * Defines a display list that draws a Dome.
- * Functions the same as makeSphere, but only draws
- * half of  the sphere.
- * Returns the list id.
+ * Build a hanging light.
  */
-GLuint makeDome(int numPoints, int numStacks) {
-   assert((numPoints > 0) && (numStacks > 0));
-
-  if ((numStacks % 2) != 0) {
-    numStacks++;
-  }
-  
-  GLuint id = listIdOrExit();
+Model makeHangingLight() {
+  Model light;
 
-  double *pointsX = new double[numPoints];
-  double *pointsZ = new double[numPoints];  
-
-  for(int i = 0; i < numPoints; i++) {
-    double angle = i * (2 * PI / numPoints);
-    pointsX[i] = cos(angle);
-    pointsZ[i] = sin(angle);
-  }  
-
-  glNewList(id, GL_COMPILE);
-
-  for (int stack = 0; stack < (numStacks / 2); stack++) {
-    double chordSize = PI / numStacks;
-    double outerAngle = stack * chordSize;
-    double innerAngle = (stack + 1) * chordSize;
-    double outerCoef = cos(outerAngle);
-    double innerCoef = cos(innerAngle);
-  
-    glBegin(GL_TRIANGLE_STRIP);
-    for(int i = 0; i < numPoints; i++) {
-      glVertex3d(outerCoef * pointsX[i], sin(outerAngle), outerCoef * pointsZ[i]);
-      glVertex3d(innerCoef * pointsX[i], sin(innerAngle), innerCoef * pointsZ[i]);
-    }
-    glVertex3d(outerCoef * pointsX[0], sin(outerAngle), outerCoef * pointsZ[0]);
-    glVertex3d(innerCoef * pointsX[1], sin(innerAngle), innerCoef * pointsZ[1]);
-    glEnd();
-  }
-
-
-  // Draw the base of the dome.
-  glPushMatrix();
-  glRotatef(90.0, 1.0, 0.0, 0.0);
-  glCallList(circle);
-  glPopMatrix();
+  // Allow the "globe" of the light to emit light.
+  light.setMaterial(glowingMaterial);
+  light.setColor(1.0, 1.0, 1.0, 0.0);
+  light.add(sphere, matrix4());
 
-  glEndList();
+  light.setMaterial(defaultMaterial);
+  light.setColor(0.1, 0.1, 0.1, 0.0);
+  light.add(cylinder, matrix4().translate(0.0, 1.0, 0.0).rotate(90, 1.0, 0.0, 0.0).scale(0.2, 0.2, 1.0));
+  light.add(dome, matrix4().translate(0.0, 0.15, 0.0).scale(1.5, 1.5, 1.5));
 
-  delete[] pointsX;
-  delete[] pointsZ;
-  
-  return id;
+  return light;
 }
 
 /*
- * Define a display list that draws a triangular
- * based pyramid.
- * Returns the list id.
+ * Helper function to build one rung of a ladder.
  */
-GLuint makeTriPyramid() {
-  GLuint id = listIdOrExit();
+Model makeLadderRung() {
+  Model rung;
+  rung.setMaterial(shinyMaterial);
 
-  vector3 a = vector3(-0.288675, 0, -0.5);
-  vector3 b = vector3(-0.288675, 0, 0.5);
-  vector3 c = vector3(0.433013, 0 ,0);
-  vector3 d = vector3(0, 0.866025, 0);
-  
-  glNewList(id, GL_COMPILE);
-  glBegin(GL_TRIANGLES);
-  // Bottom
-  glVertex3f(EXP(a));
-  glVertex3f(EXP(c));
-  glVertex3f(EXP(b));
-
-  glVertex3f(EXP(b));
-  glVertex3f(EXP(c));
-  glVertex3f(EXP(d));
+  rung.setColor(0.5, 0.5, 0.5, 0.0);
+  rung.add(cube, matrix4().scale(8.0, 1.0, 3.0));
 
-  glVertex3f(EXP(c));
-  glVertex3f(EXP(a));
-  glVertex3f(EXP(d));
+  rung.setColor(0.4, 0.4, 0.4, 0.0);
+  rung.add(dome, matrix4());
+  rung.add(dome, matrix4::translation(-3.0, 0.0, 0.0));
+  rung.add(dome, matrix4::translation(3.0, 0.0, 0.0));
 
-  glVertex3f(EXP(a));
-  glVertex3f(EXP(b));
-  glVertex3f(EXP(d));
-  
-  glEnd();
-  glEndList();
-  
-  return id;
+  return rung;
 }
 
 /*
- * Define a display list that draws a square
- * based pyramid.
- * Returns the list id.
+ * Helper function to build one railing of a ladder.
  */
-GLuint makeSquarePyramid() {
-  GLuint id = listIdOrExit();
-
-  vector3 a = vector3(0.5, 0, 0.5);
-  vector3 b = vector3(-0.5, 0, 0.5);
-  vector3 c = vector3(-0.5, 0, -0.5);
-  vector3 d = vector3(0.5, 0, -0.5);
-  vector3 e = vector3(0, 0.707107, 0);
-
-  glNewList(id, GL_COMPILE);
-  glBegin(GL_TRIANGLES);
-  // Bottom
-  glVertex3f(EXP(a));
-  glVertex3f(EXP(b));
-  glVertex3f(EXP(c));
-  glVertex3f(EXP(c));
-  glVertex3f(EXP(d));
-  glVertex3f(EXP(a));
-  //Sides
-  glVertex3f(EXP(a));
-  glVertex3f(EXP(d));
-  glVertex3f(EXP(e));
-
-  glVertex3f(EXP(d));
-  glVertex3f(EXP(c));
-  glVertex3f(EXP(e));
-
-  glVertex3f(EXP(c));
-  glVertex3f(EXP(b));
-  glVertex3f(EXP(e));
-
-  glVertex3f(EXP(b));
-  glVertex3f(EXP(a));
-  glVertex3f(EXP(e)); 
-  
-  glEnd();
-  glEndList();
-
-  return id;
+Model makeLadderRailing() {
+  Model railing;
+  railing.setMaterial(shinyMaterial);
+  railing.setColor(0.5, 0.5, 0.5, 0.0);
+
+  railing.add(cylinder, matrix4().rotate(90.0, 1.0, 0.0, 0.0).scale(0.5, 0.5, 4.0));
+  railing.add(cylinder, matrix4().translate(0.0, 40.0, 0.0).scale(0.5, 0.5, 1.0));
+  railing.add(sphere, matrix4().translate(0.0, 40.0, 0.0).scale(0.5, 0.5, 0.5));
+  railing.add(cylinder, matrix4().translate(0.0, 25.0, -10.0).rotate(90.0, 1.0, 0.0, 0.0).scale(0.5, 0.5, 1.5));
+  railing.add(sphere, matrix4().translate(0.0, 40.0, -10.0).scale(0.5, 0.5, 0.5));
+
+  return railing;
 }
 
 /*
- * Define a display list that draws a triangular Prism.
- * Returns the list id.
+ * Build a ladder.
  */
-GLuint makeTriPrism() {
-  GLuint id = listIdOrExit();
+Model makeLadder() {
+  Model ladder;
 
-  vector3 a = vector3(-0.5, 0, -0.5);
-  vector3 b = vector3(-0.5, 0, 0.5);
-  vector3 c = vector3(0.5, 0, 0.5);
-  vector3 d = vector3(0.5, 0, -0.5);
-  vector3 e = vector3(0.5, 0.866025, 0);
-  vector3 f = vector3(-0.5, 0.866025, 0);
+  Model rung = makeLadderRung();
+  for (int i = 0; i < 4; i++)
+    ladder.add(rung, matrix4::translation(0.0, -5.0 + 5.0 * i, 0.0));
 
-  glNewList(id, GL_COMPILE);
-  
-  glBegin(GL_TRIANGLES);
-  // End Faces
-  glVertex3f(EXP(c));
-  glVertex3f(EXP(d));
-  glVertex3f(EXP(e));
-
-  glVertex3f(EXP(a));
-  glVertex3f(EXP(b));
-  glVertex3f(EXP(f));  
-  glEnd();
-
-  // Middle Faces
-  glBegin(GL_TRIANGLE_STRIP);
-  glVertex3f(EXP(b));
-  glVertex3f(EXP(c));
-  glVertex3f(EXP(f));
-  glVertex3f(EXP(e));
-  glVertex3f(EXP(a));
-  glVertex3f(EXP(d));
-  glVertex3f(EXP(b));
-  glVertex3f(EXP(c));  
-  glEnd();
-  
-  glEndList();  
+  Model railing = makeLadderRailing();
+  ladder.add(railing, matrix4::translation(4.0, -10.0, 0.0));
+  ladder.add(railing, matrix4::translation(-4.0, -10.0, 0.0));
 
-  return id;
+  return ladder;
 }
 
 /*
- * Define a display list to draw a pool chair.
- * Returns the list id.
+ * Helper function to build one pool noodle.
  */
-GLuint makePoolChair() {
-  GLuint frame = listIdOrExit();
-  
-  glNewList(frame, GL_COMPILE);
-  
-  glPushMatrix();
-  glScalef(0.5, 0.5, 2.0);
-  glCallList(cylinder);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(0.0, -3, -17);
-  glRotatef(45.0, 1.0, 0.0, 0.0);
-  glScalef(0.5, 0.5, 0.4);
-  glCallList(cylinder);
-  glPopMatrix();
-
-
-  glPushMatrix();
-  glTranslatef(0.0, -0.2, 0.0);
-  glRotatef(-45.0, 1.0, 0.0, 0.0);
-  glScalef(0.5, 0.5, 0.4);
-  glCallList(cylinder);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(0.0, -3, -5.0);
-  glRotatef(45.0, 1.0, 0.0, 0.0);
-  glScalef(0.5, 0.5, 0.4);
-  glCallList(cylinder);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(0.0, -0.2, -10.0);
-  glRotatef(-45.0, 1.0, 0.0, 0.0);
-  glScalef(0.5, 0.5, 0.4);
-  glCallList(cylinder);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(0.0, -2.9, -2.5);
-  glScalef(0.5, 0.5, 0.27);
-  glCallList(cylinder);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(0.0, -2.9, -12.5);
-  glScalef(0.5, 0.5, 0.47);
-  glCallList(cylinder);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(0.0, -0.05, 0.05);
-  glScalef(0.525, 0.525, 0.525);
-  glCallList(sphere);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(0.0, -0.05, -20.05);
-  glScalef(0.525, 0.525, 0.525);
-  glCallList(sphere);
-  glPopMatrix();     
-    
-  glEndList();
-
-  
-  GLuint id = listIdOrExit();
-
-  glNewList(id, GL_COMPILE);
-
-  glColor4f(1.0, 1.0, 1.0, 0.0);
-  glPushMatrix();
-  glRotatef(90.0, 1.0, 0.0, 0.0);
-  glScalef(10.0, 20.0, 1.0);
-  glCallList(cube);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(0.0, 5.0, -14.0);
-  glRotatef(-45.0, 1.0, 0.0, 0.0);
-  glScalef(10.0, 10.0, 1.0);  
-  glCallList(cube);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(5.5, 0.0, 9.5);
-  glCallList(frame);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(-5.5, 0.0, 9.5);
-  glCallList(frame);
-  glPopMatrix();
-
-
-  
-  glEndList(); 
-  
-  return id;
+Model makePoolNoodle(vector3 color) {
+  Model noodle;
+  noodle.setMaterial(defaultMaterial);
+
+  // The ends are a darker shade of the noodle's color.
+  noodle.setColor(((color.x - 0.2) < 0.0) ? 0.0 : color.x - 0.2,
+                  ((color.y - 0.2) < 0.0) ? 0.0 : color.y - 0.2,
+                  ((color.z - 0.2) < 1.0) ? 0.0 : color.z - 0.2,
+                  0);
+  noodle.add(circle, matrix4().translate(0.0, 0.0, 0.2).scale(0.2, 0.2, 0.2));
+  noodle.add(circle, matrix4().translate(0.0, 0.0, -25.2).rotate(180.0, 0.0, 1.0, 0.0).scale(0.2, 0.2, 0.2));
+
+  noodle.setColor(color.x, color.y, color.z, 0.0);
+  noodle.add(cylinder, matrix4().scale(1.0, 1.0, 2.5));
+
+  return noodle;
 }
 
 /*
- * Define a display list to draw a diving board.
- * Returns the list id.
+ * Build a stack of pool noodles.
  */
-GLuint makeDivingBoard() {
-  GLuint railing = listIdOrExit();
-  
-  glNewList(railing, GL_COMPILE);
-  glColor4f(0.5, 0.5, 0.5, 0.0);
-  
-  shinyMaterial();
-  
-  glPushMatrix();
-  glScalef(0.5, 0.5, 3.0);
-  glCallList(cylinder);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(0.0, -12.5, -15.0);
-  glRotatef(45.0, 1.0, 0.0, 0.0);
-  glScalef(0.5, 0.5, 1.75);
-  glCallList(cylinder);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(0.0, 0.0, -1.0);
-  glRotatef(-60.0, 1.0, 0.0, 0.0);
-  glScalef(0.5, 0.5, 1.5);
-  glCallList(cylinder);
-  glPopMatrix();
-
-  defaultMaterial();
-  glEndList();
-  
-  GLuint id = listIdOrExit();
-
-  glNewList(id, GL_COMPILE);  
-  glColor4f(0.8, 0.8, 1.0, 0.0);
-  glPushMatrix();
-  glScalef(10.0, 15.0, 15.0);
-  glCallList(cube);
-  glPopMatrix();
-
-  glColor4f(0.8, 1.0, 0.8, 0.);
-  glPushMatrix();
-  glTranslatef(0.0, 8.0, 0.0);
-  glScalef(15.0, 1.0, 25.0);
-  glCallList(cube);
-  glPopMatrix();
-
-  
-  glPushMatrix();
-  glTranslatef(0.0, 3.0, 10.0);
-  glRotatef(-30.0, 1.0, 0.0, 0.0);
-  glScalef(10.0, 12.0, 1.0);
-  glCallList(cube);
-  glPopMatrix();
-
-  glColor4f(0.7, 1.0, 0.7, 0.0);
-  glPushMatrix();
-  glTranslatef(0.0, -1.75, 13.8);
-  glRotatef(-60.0, 1.0, 0.0, 0.0);
-  glScalef(9.5, 2.0, 2.0);
-  glCallList(triPrism);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(0.0, 0.5, 12.8);
-  glRotatef(-60.0, 1.0, 0.0, 0.0);
-  glScalef(9.5, 2.0, 2.0);
-  glCallList(triPrism);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(0.0, 2.75, 11.5);
-  glRotatef(-60.0, 1.0, 0.0, 0.0);
-  glScalef(9.5, 2.0, 2.0);
-  glCallList(triPrism);
-  glPopMatrix();
+Model makePoolNoodles() {
+  vector3 red = {1.0, 0.0, 0.0};
+  vector3 green = {0.0, 1.0, 0.0};
+  vector3 blue = {0.0, 0.0, 1.0};
+  vector3 pink = {1.0, 0.5, 0.5};
+  vector3 purple = {1.0, 0.0, 1.0};
+  vector3 yellow = {1.0, 1.0, 0.0};
 
-  glColor4f(1.0, 1.0, 1.0, 0.0);
-  glPushMatrix();
-  glTranslatef(0.0, 9.0, -22.4);
-  glScalef(10.0, 1.0, 70.0);
-  glCallList(cube);
-  glPopMatrix();  
+  // Each noodle's color and position in the stack.
+  struct {
+    vector3 color;
+    float x, y;
+  } stack[] = {
+    {red, 0.0, 0.0}, {green, 2.0, 0.0}, {blue, 4.0, 0.0},
+    {pink, 6.0, 0.0}, {purple, 8.0, 0.0}, {yellow, 10.0, 0.0},
+    {pink, 1.0, 2.0}, {yellow, 3.0, 2.0}, {red, 5.0, 2.0},
+    {blue, 7.0, 2.0}, {green, 9.0, 2.0},
+    {purple, 2.0, 4.0}, {pink, 4.0, 4.0}, {green, 6.0, 4.0}, {red, 8.0, 4.0},
+    {blue, 3.0, 6.0}, {yellow, 5.0, 6.0}, {purple, 7.0, 6.0},
+  };
 
-  glPushMatrix();
-  glTranslatef(-5.5, 20.0, 14.0);
-  glCallList(railing);
-  glPopMatrix();
+  Model noodles;
+  for (auto &noodle : stack)
+    noodles.add(makePoolNoodle(noodle.color), matrix4::translation(noodle.x, noodle.y, 0.0));
 
-  glPushMatrix();
-  glTranslatef(5.5, 20.0, 14.0);
-  glCallList(railing);
-  glPopMatrix();
-  
-  glEndList();
-  return id;
+  return noodles;
 }
 
 /*
- * Define a display list to draw a hanging light.
- * returns the list id.
+ * Place a composite object at a new node of the scene below parent, a
+ * root node by default, and return the node, which can be moved later.
  */
-GLuint makeHangingLight() {
-  GLuint id = listIdOrExit();
-
-  glNewList(id, GL_COMPILE);
-  glColor4f(1.0, 1.0, 1.0, 0.0);
-  glPushMatrix();
-  // Allow the "globe" of the light to emit light.
-  glMaterialfv(GL_FRONT_AND_BACK, GL_EMISSION, white_light);
-  glCallList(sphere);  
-  glPopMatrix();
-
-  glMaterialfv(GL_FRONT_AND_BACK, GL_EMISSION, black_light);
-
-  
-  glColor4f(0.1, 0.1, 0.1, 0.0);
-  glPushMatrix();
-  glTranslatef(0.0, 1.0, 0.0);
-  glRotatef(90, 1.0, 0.0, 0.0);
-  glScalef(0.2, 0.2, 1.0);
-  glCallList(cylinder);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(0.0, 0.15, 0.0);
-  glScalef(1.5, 1.5, 1.5);
-  glCallList(dome);
-  glPopMatrix();
-  
-  glEndList();
-  
-  return id;
+int placeObject(const Model &model, matrix4 placement, int parent = -1) {
+  int node = scene.addNode(parent, placement);
+  addInstance(&sceneObjects, &scene, node, model);
+  return node;
 }
 
 /*
- * Define a display list to draw a ladder.
- * Returns the list id.
+ * Place every composite object in the scene, merging the repeated
+ * parts into instance groups. Only refers to the meshes, so it can run
+ * before they are uploaded; uploadInstances follows once they are.
  */
-GLuint makeLadder() {
-
-  GLuint rung = listIdOrExit();
-  
-  glNewList(rung, GL_COMPILE);
-  
-  glColor4f(0.5, 0.5, 0.5, 0.0);
-  glPushMatrix();
-  glScalef(8.0, 1.0, 3.0);
-  glCallList(cube);
-  glPopMatrix();
-
-  glPushMatrix();
-  glColor4f(0.4, 0.4, 0.4, 0.0);
-  glCallList(dome);
-  glTranslatef(-3.0, 0.0, 0.0);
-  glCallList(dome);
-  glTranslatef(6.0, 0.0, 0.0);
-  glCallList(dome);
-  glPopMatrix();
-    
-  glEndList();
-  
-  GLuint railing = listIdOrExit();
-  
-  glNewList(railing, GL_COMPILE);
-  shinyMaterial();  
-  glColor4f(0.5, 0.5, 0.5, 0.0);
-  
-  glPushMatrix();
-  glRotatef(90.0, 1.0, 0.0, 0.0);
-  glScalef(0.5, 0.5, 4.0);  
-  glCallList(cylinder);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(0.0, 40.0, 0.0);
-  glScalef(0.5, 0.5, 1.0);
-  glCallList(cylinder);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(0.0, 40.0, 0.0);
-  glScalef(0.5, 0.5, 0.5);
-  glCallList(sphere);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(0.0, 25.0, -10.0);
-  glRotatef(90.0, 1.0, 0.0, 0.0);
-  glScalef(0.5, 0.5, 1.5);
-  glCallList(cylinder);  
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(0.0, 40.0, -10.0);
-  glScalef(0.5, 0.5, 0.5);
-  glCallList(sphere);
-  glPopMatrix();
-  defaultMaterial();
-  glEndList();
-  
-  GLuint id = listIdOrExit();
-  glNewList(id, GL_COMPILE);
-  shinyMaterial();
-
-  glPushMatrix();
-  glTranslatef(0.0, -5.0, 0.0);  
-  glCallList(rung);
-  glTranslatef(0.0, 5.0, 0.0);
-  glCallList(rung);
-  glTranslatef(0.0, 5.0, 0.0);
-  glCallList(rung);
-  glTranslatef(0.0, 5.0, 0.0);
-  glCallList(rung);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(4.0, -10.0, 0.0);
-  glCallList(railing);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(-4.0, -10.0, 0.0);
-  glCallList(railing);
-  glPopMatrix();
+void makeSceneObjects() {
+  Model ladder = makeLadder();
+  Model poolChair = makePoolChair();
+  Model divingBoard = makeDivingBoard();
+  Model hangingLight = makeHangingLight();
+  Model poolNoodles = makePoolNoodles();
+
+  // The Ladder.
+  placeObject(ladder, matrix4().translate(-48.0, -20.0, -90.0).rotate(90.0, 0.0, 1.0, 0.0));
+
+  // Some pool chairs
+  placeObject(poolChair, matrix4().translate(-80.0, 3.0, 0.0).rotate(90.0, 0.0, 1.0, 0.0));
+  placeObject(poolChair, matrix4().translate(-80.0, 3.0, 70.0).rotate(90.0, 0.0, 1.0, 0.0));
+  placeObject(poolChair, matrix4().translate(-80.0, 3.0, -70.0).rotate(90.0, 0.0, 1.0, 0.0));
+  placeObject(poolChair, matrix4().translate(80.0, 3.0, 0.0).rotate(270.0, 0.0, 1.0, 0.0));
+  placeObject(poolChair, matrix4().translate(80.0, 3.0, 70.0).rotate(270.0, 0.0, 1.0, 0.0));
+  placeObject(poolChair, matrix4().translate(80.0, 3.0, -70.0).rotate(270.0, 0.0, 1.0, 0.0));
+
+  // The diving board
+  placeObject(divingBoard, matrix4::translation(0.0, 8.0, 115.0));
+
+  // The lights, each hanging from the top of its cord, 8 above the
+  // center of its globe.
+  lampMounts = {vector3(-55.0, 63.0, 50.0), vector3(0.0, 63.0, 0.0), vector3(55.0, 63.0, -50.0)};
+  for (const vector3 &mount : lampMounts) {
+    Transform hanging;
+    hanging.translation = mount;
+    int mountNode = scene.addNode(-1, hanging);
+    lampMountNodes.push_back(mountNode);
+    lampNodes.push_back(placeObject(hangingLight, matrix4().translate(0.0, -8.0, 0.0).scale(4.0, 4.0, 4.0), mountNode));
+  }
 
+  // A stack of pool noodles
+  placeObject(poolNoodles, matrix4().translate(70.0, 2.0, -135.0).rotate(90.0, 0.0, 1.0, 0.0));
 
-  defaultMaterial();
-  glEndList();
-  
-  return id;
+  scene.updateWorld();
 }
 
 /*
- * Helper function to draw one pool noodle.
+ * Swing the hanging lights a few degrees about their mounts while
+ * swaying_lamps is set, each with its own period and direction, and
+ * hang them straight down again once it is cleared.
  */
-void drawPoolNoodle(vector3 color) {
-  glColor4f(((color.x - 0.2) < 0.0) ? 0.0 : color.x - 0.2,
-	    ((color.y - 0.2) < 0.0) ? 0.0 : color.y - 0.2,
-	    ((color.z - 0.2) < 1.0) ? 0.0 : color.z - 0.2,
-	    0);
-  
-  glPushMatrix();
-  glTranslatef(0.0, 0.0, 0.2);
-  glScalef(0.2, 0.2, 0.2);
-  glCallList(circle);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(0.0, 0.0, -25.2);
-  glRotatef(180.0, 0.0, 1.0, 0.0);
-  glScalef(0.2, 0.2, 0.2);
-  glCallList(circle);
-  glPopMatrix();
-
-  
-  glColor4f(color.x, color.y, color.z, 0.0);
-  glPushMatrix();
-  glScalef(1.0, 1.0, 2.5);
-  glCallList(cylinder);
-  glPopMatrix();
+void swayLamps() {
+  static const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  static bool swaying = false;
+  if (!swaying_lamps && !swaying)
+    return;
+  swaying = swaying_lamps;
+
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  for (size_t i = 0; i < lampMountNodes.size(); i++) {
+    double heading = i * 2.1;
+    Transform hanging;
+    hanging.translation = lampMounts[i];
+    hanging.axis = vector3((float) cos(heading), 0.0f, (float) sin(heading));
+    hanging.angle = swaying ? (float) (6.0 * sin(seconds * 2 * PI / (3.0 + 0.4 * i))) : 0.0f;
+    scene.setLocal(lampMountNodes[i], hanging);
+  }
 }
 
 /*
- * Define a display list to  draw some pool noodles.
- * Returns the list id.
+ * Make a warm point light for each hanging light, placed by
+ * placeLampLights, and scatter count small lights of random colors
+ * around the hall, the same ones every run.
  */
-GLuint makePoolNoodles() {
-  
-  vector3 red = {1.0, 0.0, 0.0};
-  vector3 green = {0.0, 1.0, 0.0};
-  vector3 blue = {0.0, 0.0, 1.0};
-  vector3 pink = {1.0, 0.5, 0.5};
-  vector3 purple = {1.0, 0.0, 1.0};
-  vector3 yellow = {1.0, 1.0, 0.0};
-    
-  
-  GLuint id = listIdOrExit();
-  
-  glNewList(id, GL_COMPILE);
-  
-  glPushMatrix();
-  drawPoolNoodle(red);  
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(2.0, 0.0, 0.0);
-  drawPoolNoodle(green);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(4.0, 0.0, 0.0);
-  drawPoolNoodle(blue);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(6.0, 0.0, 0.0);
-  drawPoolNoodle(pink);  
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(8.0, 0.0, 0.0);
-  drawPoolNoodle(purple);  
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(10.0, 0.0, 0.0);
-  drawPoolNoodle(yellow);  
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(1.0, 2.0, 0.0);
-  drawPoolNoodle(pink);  
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(3.0, 2.0, 0.0);
-  drawPoolNoodle(yellow);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(5.0, 2.0, 0.0);
-  drawPoolNoodle(red);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(7.0, 2.0, 0.0);
-  drawPoolNoodle(blue);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(9.0, 2.0, 0.0);
-  drawPoolNoodle(green);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(2.0, 4.0, 0.0);
-  drawPoolNoodle(purple);
-  glPopMatrix();
-
-
-  glPushMatrix();
-  glTranslatef(4.0, 4.0, 0.0);
-  drawPoolNoodle(pink);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(6.0, 4.0, 0.0);
-  drawPoolNoodle(green);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(8.0, 4.0, 0.0);
-  drawPoolNoodle(red);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(3.0, 6.0, 0.0);
-  drawPoolNoodle(blue);
-  glPopMatrix();
-
-  glPushMatrix();
-  glTranslatef(5.0, 6.0, 0.0);
-  drawPoolNoodle(yellow);  
-  glPopMatrix();
+void makeClusterLights(int count) {
+  for (size_t i = 0; i < lampNodes.size(); i++) {
+    ClusterLight lamp;
+    // Far enough to light the deck below, not the whole hall.
+    lamp.radius = 100.0;
+    lamp.color[0] = 0.9;
+    lamp.color[1] = 0.8;
+    lamp.color[2] = 0.6;
+    clusterLights.push_back(lamp);
+  }
 
-  glPushMatrix();
-  glTranslatef(7.0, 6.0, 0.0);
-  drawPoolNoodle(purple);
-  glPopMatrix();
-  
-  glEndList();  
-  return id;
+  mt19937 random(390);
+  uniform_real_distribution<float> x(-95.0, 95.0), y(5.0, 90.0), z(-145.0, 145.0), hue(0.0, 1.0);
+  for (int i = 0; i < count; i++) {
+    ClusterLight light;
+    light.position = vector3(x(random), y(random), z(random));
+    light.radius = 25.0;
+    for (int c = 0; c < 3; c++)
+      light.color[c] = hue(random);
+    clusterLights.push_back(light);
+  }
 }
 
-
 /*
- * Initialize. Set up the required parameters for the program.
+ * Move the hanging lights' point lights to the centers of their globes.
  */
-void initialize() {
-  glClearColor(0.2, 0.5, 0.2, 0.0);
-  /*
-   * Display Lists
-   */
-  cube = makeCube();
-  circle = makeCircle(100);
-  cylinder = makeCylinder(100, 10);
-  sphere = makeSphere(100, 50);
-  dome = makeDome(100, 50);
-  triPyramid = makeTriPyramid();
-  squarePyramid = makeSquarePyramid();
-  triPrism = makeTriPrism();
-  poolChair = makePoolChair();
-  divingBoard = makeDivingBoard();
-  hangingLight = makeHangingLight();
-  ladder = makeLadder();
-  poolNoodles = makePoolNoodles();
-
-  /*
-   * Texture Image
-   */
-  makeImage(&texture);  // Load the texture into memory.
-
-  GLuint texName;
-
-  glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // Specify that each pixel row in memory will be byte aligned.
-
-  glGenTextures(1, &texName); // Generate a texture name.
-  glBindTexture(GL_TEXTURE_2D, texName); // Bind the texture name to a 2D texture object.
- 
-  // Repeat the texture in the s direction if necessary.
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  // Repeat the texture in the t direction if necessary.
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  // Use linear interpolation when magnifying the texture.
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  // Use linear interpolation when minifying the texture.
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  // Tell the texture function to simply replace the pixel color
-  // with the color as its stored in the texture. Alternatively
-  // we could specify how the source and destination colors are blended together.  
-  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
-
-  // Define the texture image.
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
-	       texture.infoheader.biWidth, texture.infoheader.biHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE,
-	       texture.l_texture);
-
-  /*
-   * OpenGL Paramters
-   */
-  glEnable(GL_CULL_FACE); // Turn on back face culling.
-  glEnable(GL_DEPTH_TEST);// Turn on depth buffer visible surface detection
-  // Enable Transparency 
-  glEnable(GL_BLEND);
-  glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
-  
-  glEnable(GL_FOG); // Enable atmospheric attenuation.
-  GLfloat atmoColor [4] = {0.6, 0.6, 0.9, 1.0}; // Grey/Blue
-  glFogfv(GL_FOG_COLOR, atmoColor); // Set the fog color.
-  glFogi(GL_FOG_MODE, GL_EXP2);     // Calculate the blending factor for the fog using the equation
-                                    // f = e^(-density*c^2)
-  glFogf(GL_FOG_DENSITY, 0.005);   // Set the density value for calculating f.
-
-
-  /*
-   * Lights
-   */
-  glEnable(GL_LIGHTING);
-  glEnable(GL_LIGHT0);
-  glEnable(GL_LIGHT1);
-  glEnable(GL_LIGHT2);
-
-  // Tell the lighting model to take into account a material's color as well as its
-  // lighting surface properties.
-  glEnable(GL_COLOR_MATERIAL);
-
-  glLightfv(GL_LIGHT0, GL_POSITION, light_position0);
-
-  glLightfv(GL_LIGHT0, GL_AMBIENT, red_light);
-  glLightfv(GL_LIGHT0, GL_DIFFUSE, red_light);
-  glLightfv(GL_LIGHT0, GL_SPECULAR, red_light);
-
-  // Make a spotlight with a cone of 90 degrees, and attenuation exponent of one.
-  glLightfv(GL_LIGHT0, GL_SPOT_DIRECTION, direction_forward);
-  glLightf(GL_LIGHT0, GL_SPOT_CUTOFF, 90.0);
-  glLightf(GL_LIGHT0, GL_SPOT_EXPONENT, 1.0);
-
-  glLightfv(GL_LIGHT1, GL_POSITION, light_position1);
-
-  glLightfv(GL_LIGHT1, GL_AMBIENT, green_light);
-  glLightfv(GL_LIGHT1, GL_DIFFUSE, green_light);
-  glLightfv(GL_LIGHT1, GL_SPECULAR, green_light);
-
-
-  glLightfv(GL_LIGHT1, GL_SPOT_DIRECTION, direction_forward);
-  glLightf(GL_LIGHT1, GL_SPOT_CUTOFF, 90.0);
-  glLightf(GL_LIGHT1, GL_SPOT_EXPONENT, 1.0);
-
-  glLightfv(GL_LIGHT2, GL_POSITION, light_position2);
-
-  glLightfv(GL_LIGHT2, GL_AMBIENT, blue_light);
-  glLightfv(GL_LIGHT2, GL_DIFFUSE, blue_light);
-  glLightfv(GL_LIGHT2, GL_SPECULAR, blue_light);
-
-  glLightfv(GL_LIGHT2, GL_SPOT_DIRECTION, direction_forward);
-  glLightf(GL_LIGHT2, GL_SPOT_CUTOFF, 90.0);
-  glLightf(GL_LIGHT2, GL_SPOT_EXPONENT, 1.0);
-
-  // Set the ambient lighting model parameters to the values
-  // stored in lmodel ambient.
-  glLightModelfv(GL_LIGHT_MODEL_AMBIENT, lmodel_ambient);
-
-  // Set the material properties.
-  defaultMaterial();
+void placeLampLights() {
+  for (size_t i = 0; i < lampNodes.size(); i++)
+    clusterLights[i].position = scene.world(lampNodes[i]).transformPoint(vector3(0, 0, 0));
 }
 
 /* 
@@ -1235,13 +603,14 @@ void initialize() {
 enum Texture {White, Blue, Water, Green, None};
 
 /*
- * Draw a textured or non-textured rectangle.
+ * Add a textured or non-textured rectangle to a static batch.
  * (x1, y1, z1) is the lower left corner and
  * (x2, y2, z2) is the upper right corner.
  * yz specifies if the rectangle is to be drawn in the yz plane.
  * t selects which texture (if any) to display on the rectangle.
+ * Untextured rectangles take the batch's current color.
  */
-void tileRect(float x1, float y1, float z1, float x2, float y2, float z2, bool yz, Texture t) {
+void tileRect(StaticBatch *batch, float x1, float y1, float z1, float x2, float y2, float z2, bool yz, Texture t) {
   // The texCoords of each texture.
   static float whiteCoords[4][2] = { {0, 0.5}, {0.5, 0.5}, {0.5, 1}, {0, 1} };
   static float blueCoords[4][2] = { {0.5, 0.5}, {1, 0.5}, {1, 1}, {0.5, 1} };
@@ -1274,61 +643,115 @@ void tileRect(float x1, float y1, float z1, float x2, float y2, float z2, bool y
     cerr << "Invalid argument to tileRect. t must be one of White, Blue, Green, or None." << endl;
     exit(1);
   }
-  if (use_no_texture) {
-    if (yz) {
-      glBegin(GL_QUADS);
-      glVertex3f(x1, y1, z1);
-      glVertex3f(x2, y1, z2);
-      glVertex3f(x2, y2, z2);
-      glVertex3f(x1, y2, z1);
-      glEnd();
-    } else {  
-      glBegin(GL_QUADS);
-      glVertex3f(x1, y1, z1);
-      glVertex3f(x2, y1, z1);
-      glVertex3f(x2, y2, z2);
-      glVertex3f(x1, y2, z2);
-      glEnd();
-    }
+  float corners[4][3];
+  corners[0][0] = x1; corners[0][1] = y1; corners[0][2] = z1;
+  corners[2][0] = x2; corners[2][1] = y2; corners[2][2] = z2;
+  if (yz) {
+    corners[1][0] = x2; corners[1][1] = y1; corners[1][2] = z2;
+    corners[3][0] = x1; corners[3][1] = y2; corners[3][2] = z1;
   } else {
-    glEnable(GL_TEXTURE_2D);
-  
-    if (yz) {
-      glBegin(GL_QUADS);
-      glTexCoord2d(coords[0][0], coords[0][1]);
-      glVertex3f(x1, y1, z1);
-      glTexCoord2d(coords[1][0], coords[1][1]);
-      glVertex3f(x2, y1, z2);
-      glTexCoord2d(coords[2][0], coords[2][1]);
-      glVertex3f(x2, y2, z2);
-      glTexCoord2d(coords[3][0], coords[3][1]);
-      glVertex3f(x1, y2, z1);
-      glEnd();
-
-    } else {  
-      glBegin(GL_QUADS);
-      glTexCoord2d(coords[0][0], coords[0][1]);
-      glVertex3f(x1, y1, z1);
-      glTexCoord2d(coords[1][0], coords[1][1]);
-      glVertex3f(x2, y1, z1);
-      glTexCoord2d(coords[2][0], coords[2][1]);
-      glVertex3f(x2, y2, z2);
-      glTexCoord2d(coords[3][0], coords[3][1]);
-      glVertex3f(x1, y2, z2);
-      glEnd();
-    }
+    corners[1][0] = x2; corners[1][1] = y1; corners[1][2] = z1;
+    corners[3][0] = x1; corners[3][1] = y2; corners[3][2] = z2;
+  }
+
+  batch->addQuad(corners, use_no_texture ? NULL : coords);
+}
+
+/*
+ * Helper function to add the walls of the pool, tiled with t
+ * under their alpha layer, to a static batch.
+ */
+void makeWalls(StaticBatch *batch, Texture t) {
+  batch->setColor(1.0, 1.0, 1.0, 0.0);
+  batch->setLayer(1.0, 1.0, 1.0, 0.3);
+  // Near Wall
+  tileRect(batch, 100, 0, 150, -100, 100, 150, false, t);
+  // Right Wall
+  tileRect(batch, 100, 0, -150, 100, 100, 150, true, t);
+  // Far Wall
+  tileRect(batch, -100, 0, -150, 100, 100, -150, false, t);
+  // Left Wall
+  tileRect(batch, -100, 0, 150, -100, 100, -150, true, t);
+  batch->setLayer(1.0, 1.0, 1.0, 1.0);
+}
+
+/*
+ * Collect the rectangles of the deck, pool, walls and ceiling, which
+ * never change, into static batches.
+ *
+ * The tile floor and walls of the pool are seen through a translucent
+ * white layer, lit like a non-textured quad drawn over top of them but
+ * shaded with them in one pass. This amplifies the lighting effects, as
+ * lighting variations are less apparent on the textures alone.
+ *
+ * The batches are uploaded separately, by uploadStaticBatch.
+ */
+void makeStaticGeometry() {
+  /*
+   * The blue tiled floor, under its alpha layer.
+   */
+  poolDeck.setLayer(1.0, 1.0, 1.0, 0.5);
+
+  // Close short side.
+  tileRect(&poolDeck, -50, 0, 150, 0, 0, 100, false, Blue);
+  tileRect(&poolDeck, 0, 0, 150, 50, 0, 100, false, Blue);
+
+  // Right long side.
+  tileRect(&poolDeck, 50, 0, 150, 100, 0, 100, false, Blue);
+  tileRect(&poolDeck, 50, 0, 100, 100, 0, 50, false, Blue);
+  tileRect(&poolDeck, 50, 0, 50, 100, 0, 0, false, Blue);
+  tileRect(&poolDeck, 50, 0, 0, 100, 0, -50, false, Blue);
+  tileRect(&poolDeck, 50, 0, -50, 100, 0, -100, false, Blue);
+  tileRect(&poolDeck, 50, 0, -100, 100, 0, -150, false, Blue);
+
+  // Far short side.
+  tileRect(&poolDeck, 0, 0, -100, 50, 0, -150, false, Blue);
+  tileRect(&poolDeck, -50, 0, -100, 0, 0, -150, false, Blue);
+
+  // Left long side.
+  tileRect(&poolDeck, -100, 0, -100, -50, 0, -150, false, Blue);
+  tileRect(&poolDeck, -100, 0, -50, -50, 0, -100, false, Blue);
+  tileRect(&poolDeck, -100, 0, 0, -50, 0, -50, false, Blue);
+  tileRect(&poolDeck, -100, 0, 50, -50, 0, 0, false, Blue);
+  tileRect(&poolDeck, -100, 0, 100, -50, 0, 50, false, Blue);
+  tileRect(&poolDeck, -100, 0, 150, -50, 0, 100, false, Blue);
+
+  poolDeck.setLayer(1.0, 1.0, 1.0, 1.0);
+
+  /*
+   * Pool Sides and Bottom.
+   */
+
+  // Near Side
+  tileRect(&poolDeck, 50, -100, 100, -50, 0, 100, false, White);
+  // Right Side
+  tileRect(&poolDeck, 50, -100, -100, 50, 0, 100, true, White);
+  // Far Side
+  tileRect(&poolDeck, -50, -100, -100, 50, 0, -100, false, White);
+  // Left Side
+  tileRect(&poolDeck, -50, -100, 100, -50, 0, -100, true, White);
+  // Bottom
+  tileRect(&poolDeck, -50, -100, 100, 50, -100, -100, false, White);
+
+  /*
+   * Ceiling of the pool
+   */
+  poolDeck.setColor(0.1, 0.1, 0.1, 0.0);
+  tileRect(&poolDeck, 100, 100, 150, -100, 100, -150, false, None);
 
-    glDisable(GL_TEXTURE_2D);
-  }
+  /*
+   * Walls of the Pool, in both styles F5 toggles between.
+   */
+  makeWalls(&tiledWalls, White);
+  makeWalls(&plainWalls, None);
 }
 
 /*
- * Draws the water in the pool using a bezier spline surface.
+ * Set up the bezier spline surface for the water in the pool.
  *
  * Based on chapter 14 from the text.
- *
  */
-void renderSplineSurface() {
+void makeWater() {
   // We specify 16 control points inside the pool.
   static const GLfloat points[4][4][3] = {
     { {-50, -10, 100}, {-25, -5, 100},
@@ -1345,191 +768,375 @@ void renderSplineSurface() {
   static const GLfloat waterCoords[2][2][2] = { {{0, 0}, {0, 0.5}},
 						{{0.5, 0}, {0.5, 0.5}} };
 
-  glMap2f(GL_MAP2_VERTEX_3, 0.0, 1.0, 12, 4,
-	  0.0, 1.0, 3, 4, &points[0][0][0]); // Map our control points.
-  if (textured_water) {
-    glMap2f(GL_MAP2_TEXTURE_COORD_2, 0, 1, 2, 2, // And map our texture coordinates.
-	    0, 1, 4, 2, &waterCoords[0][0][0]);
-    glEnable(GL_MAP2_TEXTURE_COORD_2);
-    glEnable(GL_TEXTURE_2D); 
-  }
-  glEnable(GL_MAP2_VERTEX_3);
+  createWater(&water, WATER_RESOLUTION);
+  water.patch.setControlPoints(points);
+  water.patch.setTexCoords(waterCoords);
+}
 
-  glColor4f(0.0, 0.0, 1.0, 0.3);
+/*
+ * Start or stop the water simulation to match animated_water. The
+ * simulation is created the first time it is needed.
+ */
+void updateWaterSimulation() {
+  if (animated_water) {
+    if (animatedWater.simulation == NULL)
+      createAnimatedWater(&animatedWater, WATER_SIM_COLUMNS, WATER_SIM_ROWS, thread::hardware_concurrency());
+    animatedWater.simulation->start();
+  } else if (animatedWater.simulation != NULL) {
+    animatedWater.simulation->stop();
+  }
+}
 
-  // Defines a mesh derived from our control points with 20 vertices in the u and v directions.  
-  glMapGrid2f(20, 0, 1, 20, 0, 1);
-  // Draws the vertices defined by our mesh as if we called glBegin(GL_QUAD_STRIP)
-  glEvalMesh2(GL_FILL, 0, 20, 0, 20);
+/*
+ * Drip water off the end of the diving board, and now and then
+ * somewhere else in the pool, to keep the animated water moving.
+ */
+void disturbWater() {
+  static chrono::steady_clock::time_point lastDrip;
+  static unsigned drips = 0;
 
-  glDisable(GL_TEXTURE_2D);
+  chrono::steady_clock::time_point now = chrono::steady_clock::now();
+  if (now - lastDrip < chrono::milliseconds(700))
+    return;
+  lastDrip = now;
 
-  checkError();
+  if (drips % 3 == 0) {
+    animatedWater.simulation->disturb(0.0, 58.0, 4.0, 3.0);
+  } else {
+    // A fixed sequence of spots scattered over the pool.
+    float x = (float) ((drips * 37) % 90) - 45;
+    float z = (float) ((drips * 71) % 190) - 95;
+    animatedWater.simulation->disturb(x, z, 1.5, 1.5);
+  }
+  drips++;
 }
 
 /*
- * Render the scene.
- * The various preprocessor directives were used in developing
- * each component of the program. Enabling them will draw 
- * different components centred at the origin.
- *
- * The tile floor and walls of the pool have a translucent 
- * non-textured quad drawn over top of them. This amplifies the lighting
- * effects, as lighting variations are less apparent on the textures alone.
- *
+ * Print the size of the finest level of each primitive and its average
+ * cache miss ratio as generated and after optimizeVertexCache.
  */
-void render() {
-  /*
-   * Draw the blue tiled floor.
-   */
+void printMeshStats() {
+  struct {
+    const char *name;
+    MeshData data;
+  } meshes[] = {
+    {"cube", cubeMeshData()},
+    {"circle", circleMeshData(100)},
+    {"cylinder", cylinderMeshData(100, 10)},
+    {"sphere", sphereMeshData(100, 50)},
+    {"dome", domeMeshData(100, 50)},
+    {"triPyramid", triPyramidMeshData()},
+    {"squarePyramid", squarePyramidMeshData()},
+    {"triPrism", triPrismMeshData()},
+  };
 
-  // Close short side.
-  tileRect(-50, 0, 150, 0, 0, 100, false, Blue);
-  tileRect(0, 0, 150, 50, 0, 100, false, Blue);
+  cout << "mesh vertices triangles acmr optimized_acmr" << endl;
+  for (auto &mesh : meshes) {
+    float generated = averageCacheMissRatio(mesh.data, VERTEX_CACHE_SIZE);
+    optimizeVertexCache(&mesh.data);
+    cout << mesh.name << " " << mesh.data.vertexCount() << " " << mesh.data.indices.size() / 3
+         << " " << generated << " " << averageCacheMissRatio(mesh.data, VERTEX_CACHE_SIZE) << endl;
+  }
+}
 
-  // Right long side.
-  tileRect(50, 0, 150, 100, 0, 100, false, Blue);
-  tileRect(50, 0, 100, 100, 0, 50, false, Blue);
-  tileRect(50, 0, 50, 100, 0, 0, false, Blue);
-  tileRect(50, 0, 0, 100, 0, -50, false, Blue);
-  tileRect(50, 0, -50, 100, 0, -100, false, Blue);
-  tileRect(50, 0, -100, 100, 0, -150, false, Blue);
+/*
+ * Switch between drawing the scene and showing its overdraw: every
+ * fragment adds to the color it lands on, over black.
+ */
+void showOverdraw(bool show) {
+  show_overdraw = show;
+  setSceneShading(show ? SceneOverdraw : SceneShaded);
+  if (show) {
+    cachedBlendFunc(GL_ONE, GL_ONE);
+    glClearColor(0.0, 0.0, 0.0, 0.0);
+  } else {
+    cachedBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
+    glClearColor(0.2, 0.5, 0.2, 0.0);
+  }
+}
 
-  // Far short side.
-  tileRect(0, 0, -100, 50, 0, -150, false, Blue);
-  tileRect(-50, 0, -100, 0, 0, -150, false, Blue);
+/*
+ * The overdraw of the last frame counted, or -1 if it is not being
+ * shown, for the benchmark.
+ */
+double shownOverdraw() {
+  return show_overdraw ? overdraw() : -1;
+}
 
-  // Left long side.
-  tileRect(-100, 0, -100, -50, 0, -150, false, Blue);
-  tileRect(-100, 0, -50, -50, 0, -100, false, Blue);
-  tileRect(-100, 0, 0, -50, 0, -50, false, Blue);
-  tileRect(-100, 0, 50, -50, 0, 0, false, Blue);
-  tileRect(-100, 0, 100, -50, 0, 50, false, Blue);
-  tileRect(-100, 0, 150, -50, 0, 100, false, Blue);
+/*
+ * Initialize. Set up the required parameters for the program.
+ */
+void initialize() {
+  ProfileScope initializing("initialize");
+  if (!loadGLFunctions()) {
+    cerr << "OpenGL 3.3 or newer is required. exiting now." << endl;
+    exit(1);
+  }
+
+  glClearColor(0.2, 0.5, 0.2, 0.0);
+  const float clearColor[4] = {0.2, 0.5, 0.2, 0.0};
+  copy(clearColor, clearColor + 4, softwareRenderer.clearColor);
+  // Workers for the loading below; stopped again when the program exits.
+  startJobs();
+  atexit(stopJobs);
 
   /*
-   * Alpha layer
+   * Texture Image
    */
-  glColor4f(1.0, 1.0, 1.0, 0.5);
-    // Close short side.
-  tileRect(-50, 0.1, 150, 0, 0.1, 100, false, None);
-  tileRect(0, 0.1, 150, 50, 0.1, 100, false, None);
+  GLuint texName;
 
-  // Right long side.
-  tileRect(50, 0.1, 150, 100, 0.1, 100, false, None);
-  tileRect(50, 0.1, 100, 100, 0.1, 50, false, None);
-  tileRect(50, 0.1, 50, 100, 0.1, 0, false, None);
-  tileRect(50, 0.1, 0, 100, 0.1, -50, false, None);
-  tileRect(50, 0.1, -50, 100, 0.1, -100, false, None);
-  tileRect(50, 0.1, -100, 100, 0.1, -150, false, None);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // Specify that each pixel row in memory will be byte aligned.
 
-  // Far short side.
-  tileRect(0, 0.1, -100, 50, 0.1, -150, false, None);
-  tileRect(-50, 0.1, -100, 0, 0.1, -150, false, None);
+  glGenTextures(1, &texName); // Generate a texture name.
+  cachedBindTexture(GL_TEXTURE_2D, texName); // Bind the texture name to a 2D texture object.
+ 
+  // Repeat the texture in the s direction if necessary.
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  // Repeat the texture in the t direction if necessary.
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  // Use linear interpolation when magnifying the texture.
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  // Use linear interpolation within and between mipmap levels when
+  // minifying the texture.
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+  // Stream the texture image and its mipmap levels in over the first
+  // frames, loading them as a job alongside the meshes below. The four
+  // textures share the image, so stop the mip chain while each quarter is
+  // still 32 pixels across, before the levels blur them together. Keep it
+  // compressed if the driver can sample BC1.
+  // Drawing on the CPU, load the same levels for the software renderer
+  // to sample instead.
+  bool compressed = hasGLExtension("GL_EXT_texture_compression_s3tc");
+  if (software_rendering)
+    loadSoftwareTexture(&softwareRenderer, TEXTURE_FILE, 64);
+  else
+    textureStream.start(texName, TEXTURE_FILE, 64, compressed ? MipBC1 : MipRGBA);
 
-  // Left long side.
-  tileRect(-100, 0.1, -100, -50, 0.1, -150, false, None);
-  tileRect(-100, 0.1, -50, -50, 0.1, -100, false, None);
-  tileRect(-100, 0.1, 0, -50, 0.1, -50, false, None);
-  tileRect(-100, 0.1, 50, -50, 0.1, 0, false, None);
-  tileRect(-100, 0.1, 100, -50, 0.1, 50, false, None);
-  tileRect(-100, 0.1, 150, -50, 0.1, 100, false, None);
+  /*
+   * Meshes
+   */
+  // Generate every level of every primitive, reordered for the vertex
+  // cache, and the objects and static geometry made of them as jobs, and
+  // then upload the lot on this thread, which has the context.
+  MeshData cubeData, triPyramidData, squarePyramidData, triPrismData;
+  vector<MeshData> circleData(4), cylinderData(4), sphereData(4), domeData(4);
+  JobGroup generating;
+  auto generate = [&generating](MeshData *data, function<MeshData()> make) {
+    generating.run([data, make] {
+      ProfileScope scope("mesh");
+      *data = make();
+      optimizeVertexCache(data);
+    });
+  };
+  generate(&cubeData, cubeMeshData);
+  // The round primitives have levels of detail for when they look small,
+  // each used from a projected radius of LEVEL_PIXELS pixels up.
+  const vector<float> LEVEL_PIXELS = {60.0, 20.0, 6.0, 0.0};
+  const int LEVEL_SEGMENTS[4] = {100, 48, 24, 12};
+  const int LEVEL_STACKS[4] = {50, 24, 12, 6};
+  for (int i = 0; i < 4; i++) {
+    int segments = LEVEL_SEGMENTS[i];
+    int stacks = LEVEL_STACKS[i];
+    generate(&circleData[i], [=] { return circleMeshData(segments); });
+    generate(&cylinderData[i], [=] { return cylinderMeshData(segments, 10); });
+    generate(&sphereData[i], [=] { return sphereMeshData(segments, stacks); });
+    generate(&domeData[i], [=] { return domeMeshData(segments, stacks); });
+  }
+  generate(&triPyramidData, triPyramidMeshData);
+  generate(&squarePyramidData, squarePyramidMeshData);
+  generate(&triPrismData, triPrismMeshData);
+  generating.run([] {
+    ProfileScope scope("scene objects");
+    makeSceneObjects();
+    makeClusterLights(extraLights);
+  });
+  generating.run([] {
+    ProfileScope scope("static geometry");
+    makeStaticGeometry();
+  });
+  generating.wait();
+
+  {
+    ProfileScope uploading("upload", true);
+    cube = uploadMesh(cubeData);
+    circle = uploadMeshLevels(circleData, LEVEL_PIXELS);
+    cylinder = uploadMeshLevels(cylinderData, LEVEL_PIXELS);
+    sphere = uploadMeshLevels(sphereData, LEVEL_PIXELS);
+    dome = uploadMeshLevels(domeData, LEVEL_PIXELS);
+    triPyramid = uploadMesh(triPyramidData);
+    squarePyramid = uploadMesh(squarePyramidData);
+    triPrism = uploadMesh(triPrismData);
+    uploadInstances(&sceneObjects, scene);
+    uploadStaticBatch(&poolDeck);
+    uploadStaticBatch(&tiledWalls);
+    uploadStaticBatch(&plainWalls);
+    makeWater();
+    updateWaterSimulation();
+  }
 
+  /*
+   * OpenGL Paramters
+   */
+  cachedEnable(GL_CULL_FACE); // Turn on back face culling.
+  cachedEnable(GL_DEPTH_TEST);// Turn on depth buffer visible surface detection
+  // Enable Transparency 
+  cachedEnable(GL_BLEND);
+  cachedBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
 
   /*
-   * Pool Sides and Bottom.
+   * Shading
    */
+  // The scene shader lights and fogs everything per pixel, see sceneShader.h.
+  createSceneShader();
+  createLightClusters(&lightClusters);
 
-  // Near Side
-  tileRect(50, -100, 100, -50, 0, 100, false, White);
-  // Right Side
-  tileRect(50, -100, -100, 50, 0, 100, true, White);
-  // Far Side
-  tileRect(-50, -100, -100, 50, 0, -100, false, White);
-  // Left Side
-  tileRect(-50, -100, 100, -50, 0, -100, true, White);
-  // Bottom
-  tileRect(-50, -100, 100, 50, -100, -100, false, White);
+  // Atmospheric attenuation, with the blending factor for the fog
+  // calculated using the equation f = e^(-(density*c)^2).
+  GLfloat atmoColor [4] = {0.6, 0.6, 0.9, 1.0}; // Grey/Blue
+  setSceneFog(atmoColor, 0.005);
 
   /*
-   * Walls of the Pool.
+   * Lights
    */
-  glColor4f(1.0, 1.0, 1.0, 0.0);
-  float delta = 0.5;
-  if (plain_walls) {
-  // Near Wall
-  tileRect(100, 0, 150, -100, 100, 150, false, None);
-  // Right Wall
-  tileRect(100, 0, -150, 100, 100, 150, true, None);
-  // Far Wall
-  tileRect(-100, 0, -150, 100, 100, -150, false, None);
-  // Left Wall
-  tileRect(-100, 0, 150, -100, 100, -150, true, None);
-  } else {
-    // Near Wall
-    tileRect(100, 0, 150, -100, 100, 150, false, White);
-    // Right Wall
-    tileRect(100, 0, -150, 100, 100, 150, true, White);
-    // Far Wall
-    tileRect(-100, 0, -150, 100, 100, -150, false, White);
-    // Left Wall
-    tileRect(-100, 0, 150, -100, 100, -150, true, White);
+  // Make three spotlights at the viewing position pointing forward, in
+  // red, green and blue, with a cone of 90 degrees, and attenuation
+  // exponent of one. They are given in eye coordinates, so they move
+  // with the viewer.
+  GLfloat *light_positions[3] = {light_position0, light_position1, light_position2};
+  GLfloat *light_colors[3] = {red_light, green_light, blue_light};
+  for (int i = 0; i < 3; i++) {
+    SceneLight light;
+    copy(light_positions[i], light_positions[i] + 4, light.position);
+    copy(direction_forward, direction_forward + 3, light.spotDirection);
+    copy(light_colors[i], light_colors[i] + 4, light.ambient);
+    copy(light_colors[i], light_colors[i] + 4, light.diffuse);
+    copy(light_colors[i], light_colors[i] + 4, light.specular);
+    light.spotCutoff = 90.0;
+    light.spotExponent = 1.0;
+    setSceneLight(i, light);
+    setSceneLightEnabled(i, true);
   }
+
+  // Set the ambient lighting model parameters to the values
+  // stored in lmodel ambient.
+  setSceneAmbient(lmodel_ambient);
+
   /*
-   * Alpha Layer
+   * Materials
    */
+  SceneMaterialProperties material;
+  copy(specular, specular + 4, material.specular);
+  copy(black_light, black_light + 4, material.emission);
+  material.shininess = shininess;
+  material.emissive = false;
+  setSceneMaterial(DefaultMaterial, material);
+
+  // Glowing surfaces emit white light.
+  copy(white_light, white_light + 4, material.emission);
+  material.emissive = true;
+  setSceneMaterial(GlowingMaterial, material);
+
+  copy(shiny_specular, shiny_specular + 4, material.specular);
+  copy(black_light, black_light + 4, material.emission);
+  material.shininess = shiny_shininess;
+  material.emissive = false;
+  setSceneMaterial(ShinyMaterial, material);
+
+  // Set the material properties.
+  defaultMaterial();
+
+  if (show_overdraw)
+    showOverdraw(true);
+}
+
+/*
+ * Draws the water in the pool, the bezier spline surface set up by makeWater.
+ */
+void renderSplineSurface() {
+  ProfileScope scope("water", true);
+  cachedColor4f(0.0, 0.0, 1.0, 0.3);
+  if (animated_water)
+    disturbWater();
+  if (!animated_water || !drawAnimatedWater(&animatedWater, textured_water))
+    drawWater(&water, textured_water);
+
+  checkError();
+}
+
+/*
+ * Queue the tiled deck, the pool, the walls, the ceiling and the ladder,
+ * pool chairs, diving board, lights and pool noodles, nearest first.
+ */
+void queueOpaque() {
+  ProfileScope scope("opaque queue");
+  Frustum frustum = currentFrustum();
+  clearOpaqueQueue(&opaqueQueue);
+  queueStaticBatch(&opaqueQueue, poolDeck, frustum);
+  queueStaticBatch(&opaqueQueue, plain_walls ? plainWalls : tiledWalls, frustum);
+#define DRAW_THE_SCENE
+#ifdef DRAW_THE_SCENE
+  cullInstances(&sceneObjects, frustum);
+  queueInstances(&opaqueQueue, sceneObjects);
+#endif // DRAW_THE_SCENE
+  sortOpaqueQueue(&opaqueQueue);
+}
+
+/*
+ * Render the scene, leaving out the water unless withWater.
+ * The various preprocessor directives were used in developing
+ * each component of the program. Enabling them will draw 
+ * different components centred at the origin.
+ */
+void render(bool withWater) {
+  queueOpaque();
 
-  glColor4f(1.0, 1.0, 1.0, 0.3);
-  tileRect(100, 0, 150 - delta, -100, 100, 150 - delta, false, None);
-  tileRect(100 - delta, 0, -150, 100 - delta, 100, 150, true, None);
-  tileRect(-100, 0, -150 + delta, 100, 100, -150 + delta, false, None);
-  tileRect(-100 + delta, 0, 150, -100 + delta, 100, -150, true, None);
-  
   /*
-   * Ceiling of the pool
+   * Draw them, then any translucent quads of the deck and walls.
    */
+  if (depth_prepass)
+    drawDepthPrepass(opaqueQueue);
+  if (show_overdraw)
+    beginOverdrawCount();
+  {
+    ProfileScope scope("opaque", true);
+    drawOpaqueQueue(opaqueQueue);
+  }
+  drawStaticBlended(poolDeck);
+  drawStaticBlended(plain_walls ? plainWalls : tiledWalls);
+  defaultMaterial();
 
-  glColor4f(0.1, 0.1, 0.1, 0.0);
-  
-  glBegin(GL_QUADS);
-  glVertex3f(100.0, 100.0, 150.0);
-  glVertex3f(-100.0, 100.0, 150.0);
-  glVertex3f(-100.0, 100.0, -150.0);
-  glVertex3f(100.0, 100.0, -150.0);  
-  glEnd();
-
-  
   //#define TEST_SHAPES 
 #ifdef TEST_SHAPES
   /*
    * Draw the cube.
    */
-  glColor4f(1.0, 0.0, 0.0, 0.0);
+  cachedColor4f(1.0, 0.0, 0.0, 0.0);
   glPushMatrix();
   glTranslatef(20.0, 0.0, 0.0);
   glScalef(10.0, 10.0, 10.0);
-  glCallList(cube);
+  drawMesh(cube);
   glPopMatrix();
   
 
   /*
    * Draw the circle.
    */  
-  glColor4f(0.0, 1.0, 0.0, 0.0);
+  cachedColor4f(0.0, 1.0, 0.0, 0.0);
   glPushMatrix();
   glTranslatef(0.0, 0.0, -20.0);
   glScalef(5.0, 5.0, 5.0);
-  glCallList(circle);
+  drawMesh(circle);
   glPopMatrix();
 
 
   /*
    * Draw the cylinder
   */
-  glColor4f(0.0, 0.0, 1.0, 0.0);
+  cachedColor4f(0.0, 0.0, 1.0, 0.0);
   glPushMatrix();
   glTranslatef(-20.0, 0.0, 0.0);
-  glCallList(cylinder);
+  drawMesh(cylinder);
   glPopMatrix();
 
 
@@ -1537,11 +1144,11 @@ void render() {
    * Draw the sphere
   */
 
-  glColor4f(1.0, 0.0, 1.0, 0.0);
+  cachedColor4f(1.0, 0.0, 1.0, 0.0);
   glPushMatrix();
   glTranslatef(20.0, 30.0, 0.0);
   glScalef(5.0, 5.0, 5.0);
-  glCallList(sphere);
+  drawMesh(sphere);
   glPopMatrix();
 
 
@@ -1549,41 +1156,41 @@ void render() {
    * Draw the dome.
   */
 
-  glColor4f(1.0, 1.0, 0.0, 0.0);
+  cachedColor4f(1.0, 1.0, 0.0, 0.0);
   glPushMatrix();
   glTranslatef(-20.0, 30.0, 0.0);
   glScalef(5.0, 5.0, 5.0);
-  glCallList(dome);
+  drawMesh(dome);
   glPopMatrix();
 
   /*
    * Draw the Triangular Pyramid.
    */
-  glColor4f(0.0, 1.0, 1.0, 0.0);
+  cachedColor4f(0.0, 1.0, 1.0, 0.0);
   glPushMatrix();
   glTranslatef(0.0, 30.0, -30.0);
   glScalef(10.0, 10.0, 10.0);
-  glCallList(triPyramid);
+  drawMesh(triPyramid);
   glPopMatrix();
 
   /*
    * Draw the Square based Pyramid.
    */
-  glColor4f(1.0, 0.2, 0.2, 0.0);
+  cachedColor4f(1.0, 0.2, 0.2, 0.0);
   glPushMatrix();
   glTranslatef(-20.0, 0.0, 20.0);
   glScalef(10.0, 10.0, 10.0);
-  glCallList(squarePyramid);
+  drawMesh(squarePyramid);
   glPopMatrix();
  
   /*
    * Draw the triangular prism.
    */
-  glColor4f(0.2, 1.0, 0.2, 0.0);
+  cachedColor4f(0.2, 1.0, 0.2, 0.0);
   glPushMatrix();
   glTranslatef(20.0, 0.0, 20.0);
   glScalef(5.0, 5.0, 5.0);
-  glCallList(triPrism);
+  drawMesh(triPrism);
   glPopMatrix();
     
   
@@ -1591,141 +1198,264 @@ void render() {
 
   //#define TEST_POOL_CHAIR
 #ifdef TEST_POOL_CHAIR
-  glPushMatrix();
-  glCallList(poolChair);
-  glPopMatrix();  
+  drawModel(makePoolChair());
 #endif // TEST_POOL_CHAIR
 
   //#define TEST_DIVING_BOARD  
 #ifdef TEST_DIVING_BOARD
-  glPushMatrix();
-  glCallList(divingBoard);
-  glPopMatrix();
+  drawModel(makeDivingBoard());
 #endif // TEST_DIVING_BOARD
 
   //#define TEST_HANGING_LIGHT
 #ifdef TEST_HANGING_LIGHT
-  glPushMatrix();
-  glCallList(hangingLight);
-  glPopMatrix();
+  drawModel(makeHangingLight());
 #endif // TEST_HANGING_LIGHT
 
   //#define TEST_LADDER
 #ifdef TEST_LADDER
-  glPushMatrix();
-  glCallList(ladder);
-  glPopMatrix();
+  drawModel(makeLadder());
 #endif // TEST_LADDER
 
 //#define TEST_POOL_NOODLES
 #ifdef TEST_POOL_NOODLES
-  glPushMatrix();
-  glCallList(poolNoodles);
-  glPopMatrix();
+  drawModel(makePoolNoodles());
 #endif // TEST_POOL_NOODLES
 
-#define DRAW_THE_SCENE
-#ifdef DRAW_THE_SCENE
-  // Draw the Ladder.
-  glPushMatrix();
-  glTranslatef(-48.0, -20.0, -90.0);
-  glRotatef(90.0, 0.0, 1.0, 0.0);
-  glCallList(ladder);
-  glPopMatrix();
+  /*
+   * Render the Water
+   */
+  if (withWater)
+    renderSplineSurface();
+  if (show_overdraw)
+    endOverdrawCount();
+  glFlush();
+}
 
-  // Draw some pool chairs
-  glPushMatrix();
-  glTranslatef(-80.0, 3.0, 0.0);
-  glRotatef(90.0, 0.0, 1.0, 0.0);
-  glCallList(poolChair);
-  glPopMatrix();
-  
-  glPushMatrix();
-  glTranslatef(-80.0, 3.0, 70.0);
-  glRotatef(90.0, 0.0, 1.0, 0.0);
-  glCallList(poolChair);
-  glPopMatrix();
+/*
+ * Add the water in the pool to the software frame, as renderSplineSurface
+ * draws it.
+ */
+void addSoftwareWater(const matrix4 &view) {
+  SoftwareDraw draw;
+  if (animated_water)
+    disturbWater();
+  if (animated_water && updateAnimatedWaterVertices(&animatedWater)) {
+    draw.vertices = animatedWater.vertices.data();
+    draw.columns = animatedWater.simulation->columns();
+    draw.triangleCount = 2 * draw.columns * animatedWater.simulation->rows();
+  } else {
+    updateWaterVertices(&water);
+    draw.vertices = water.vertices.data();
+    draw.columns = water.resolution;
+    draw.triangleCount = 2 * water.resolution * water.resolution;
+  }
+  draw.stride = BezierPatch::FLOATS_PER_VERTEX;
+  draw.normalOffset = 3;
+  draw.texCoordOffset = textured_water ? 6 : -1;
+  draw.indices = NULL;
+  draw.modelview = view;
+  const float blue[4] = {0.0, 0.0, 1.0, 0.3};
+  copy(blue, blue + 4, draw.color);
+  draw.material = DefaultMaterial;
+  draw.flags = textured_water ? SceneTextured : 0;
+  draw.blended = true;
+  addSoftwareDraw(&softwareRenderer, draw);
+}
 
-  glPushMatrix();
-  glTranslatef(-80.0, 3.0, -70.0);
-  glRotatef(90.0, 0.0, 1.0, 0.0);
-  glCallList(poolChair);
-  glPopMatrix();
+/*
+ * Render the scene like render(true), but on the CPU (see
+ * softwareRenderer.h), and show it in the framebuffer that is bound.
+ */
+void renderSoftware() {
+  matrix4 projection, view;
+  glGetFloatv(GL_PROJECTION_MATRIX, projection.m);
+  glGetFloatv(GL_MODELVIEW_MATRIX, view.m);
+  queueOpaque();
+
+  beginSoftwareFrame(&softwareRenderer, projection, lightClusters);
+  addSoftwareOpaqueQueue(&softwareRenderer, opaqueQueue, sceneObjects, view);
+  addSoftwareBlended(&softwareRenderer, poolDeck, view);
+  addSoftwareBlended(&softwareRenderer, plain_walls ? plainWalls : tiledWalls, view);
+  addSoftwareWater(view);
+  defaultMaterial();
+  {
+    ProfileScope scope("software");
+    drawSoftwareFrame(&softwareRenderer);
+  }
+  presentSoftwareFrame(&softwareRenderer);
+}
 
-  glPushMatrix();
-  glTranslatef(80.0, 3.0, 0.0);
-  glRotatef(270.0, 0.0, 1.0, 0.0);
-  glCallList(poolChair);
-  glPopMatrix();
-  
-  glPushMatrix();
-  glTranslatef(80.0, 3.0, 70.0);
-  glRotatef(270.0, 0.0, 1.0, 0.0);
-  glCallList(poolChair);
-  glPopMatrix();
+/*
+ * Collect the GPU timings and state change counts of earlier frames.
+ */
+void collectProfile() {
+  profileFrame();
+  GLStateCounts stateCounts = glStateCounts();
+  profileCounter("state changes issued", stateCounts.issued);
+  profileCounter("state changes elided", stateCounts.elided);
+  resetGLStateCounts();
+}
 
-  glPushMatrix();
-  glTranslatef(80.0, 3.0, -70.0);
-  glRotatef(270.0, 0.0, 1.0, 0.0);
-  glCallList(poolChair);
-  glPopMatrix();
+/*
+ * Look from the viewer at the lookAt point.
+ */
+void setCamera() {
+  // Make the viewing matrix the identity matrix.
+  glLoadIdentity();
+  // Set viewing matrix to look at the "lookAt" vector from "viewer" with
+  // the positive y axis as the up direction.
+  gluLookAt(viewer.x, viewer.y, viewer.z, lookAt.x, lookAt.y, lookAt.z, 0, 1, 0);
+}
 
-  // Draw the diving board
-  glPushMatrix();
-  glTranslatef(0.0, 8.0, 115.0);
-  glCallList(divingBoard);
-  glPopMatrix();
+/*
+ * Bring the objects and the lights up to date for this viewpoint.
+ */
+void updateLights() {
+  // Bring the objects up to date first, so the lamps' lights follow
+  // their globes in the same frame.
+  if (scene.updateWorld())
+    updateInstances(&sceneObjects, scene);
+  // Sort the lights into clusters from this viewpoint, and upload them and
+  // any change to the other lights.
+  placeLampLights();
+  if (updateLightClusters(&lightClusters, clusterLights))
+    setSceneClusterMapping(lightClusters.mapping);
+  setSceneClusterEntries((int) lightClusters.indices.size());
+  updateSceneShader();
+}
 
-  // Draw the lights
-  
-  glPushMatrix();
-  glTranslatef(-55.0, 55.0, 50.0);
-  glScalef(4.0, 4.0, 4.0);
-  glCallList(hangingLight);
-  glPopMatrix();
+/*
+ * Draw one frame from the current viewing position without presenting it.
+ * Shared by the display callback and the benchmark.
+ */
+void drawFrame() {
+  collectProfile();
+  ProfileScope scope("frame", true);
+  swayLamps();
+  if (software_rendering) {
+    setCamera();
+    updateLights();
+    renderSoftware();
+    return;
+  }
+  // Carry on uploading the texture.
+  textureStream.update(TEXTURE_STREAM_BUDGET);
+  // Clear the color and depth buffers
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  setCamera();
+  updateLights();
+  // Draw the scene
+  render(true);
+}
 
-  glPushMatrix();
-  glTranslatef(0.0, 55.0, 0.0);
-  glScalef(4.0, 4.0, 4.0);
-  glCallList(hangingLight);
-  glPopMatrix();
+/*
+ * The camera, lights and toggles the frame is drawn with.
+ */
+FrameState currentFrameState() {
+  FrameState state;
+  state.viewer = viewer;
+  state.lookAt = lookAt;
+  state.lights[0] = light_zero;
+  state.lights[1] = light_one;
+  state.lights[2] = light_two;
+  state.texturedWater = textured_water;
+  state.plainWalls = plain_walls;
+  state.animatedWater = animated_water;
+  return state;
+}
 
-  glPushMatrix();
-  glTranslatef(55.0, 55.0, -50.0);
-  glScalef(4.0, 4.0, 4.0);
-  glCallList(hangingLight);
-  glPopMatrix();
+/*
+ * Whether a and b have the same camera, lights and toggles.
+ */
+bool sameFrameState(const FrameState &a, const FrameState &b) {
+  return a.viewer.x == b.viewer.x && a.viewer.y == b.viewer.y && a.viewer.z == b.viewer.z &&
+         a.lookAt.x == b.lookAt.x && a.lookAt.y == b.lookAt.y && a.lookAt.z == b.lookAt.z &&
+         equal(a.lights, a.lights + 3, b.lights) && a.texturedWater == b.texturedWater &&
+         a.plainWalls == b.plainWalls && a.animatedWater == b.animatedWater;
+}
 
-  // Draw a stack of pool noodles
-  glPushMatrix();
-  glTranslatef(70.0, 2.0, -135.0);
-  glRotatef(90.0, 0.0, 1.0, 0.0);
-  glCallList(poolNoodles);
-  glPopMatrix();
-#endif // DRAW_THE_SCENE
-  
-  /*
-   * Render the Water
-   */
-  renderSplineSurface();
-  glFlush();
+/*
+ * Draw one frame like drawFrame, but through the frame cache (see
+ * frameCache.h): the scene is only drawn again when the camera, a light
+ * or a toggle changed, something in the scene moved, or the texture is
+ * still coming in. Animated water is left out of the cached image and
+ * drawn over it each frame, in the rectangle the pool covers. While the
+ * overdraw is shown, or the scene is drawn on the CPU, every frame is
+ * drawn in full.
+ */
+void drawCachedSceneFrame() {
+  if (show_overdraw || software_rendering) {
+    drawFrame();
+    return;
+  }
+  collectProfile();
+  ProfileScope scope("frame", true);
+  swayLamps();
+  textureStream.update(TEXTURE_STREAM_BUDGET);
+  FrameState state = currentFrameState();
+  if (!textureStream.done() || scene.dirty || !sameFrameState(state, cachedFrameState)) {
+    invalidateFrameCache(&frameCache);
+    cachedFrameState = state;
+  }
+  setCamera();
+
+  int damage[4] = {0, 0, 0, 0};
+  function<void()> moving;
+  if (animated_water) {
+    // Anywhere the water can be: the pool, with room for waves.
+    BoundingBox pool;
+    pool.add(vector3(-50.0, -100.0, -100.0));
+    pool.add(vector3(50.0, 10.0, 100.0));
+    screenRectangle(pool, damage);
+    moving = renderSplineSurface;
+  }
+  auto drawStatic = [] {
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    updateLights();
+    render(!animated_water);
+  };
+  if (!drawCachedFrame(&frameCache, drawStatic, moving, damage))
+    drawStatic();
 }
 
+void applyInput();
+
 /*
  * Display Registry
  */
 void display(void) {
-  // Clear the color and depth buffers
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  // Make the viewing matrix the identity matrix.
-  glLoadIdentity();
-  // Set viewing matrix to look at the "lookAt" vector from "viewer" with
-  // the positive y axis as the up direction.
-  gluLookAt(viewer.x, viewer.y, viewer.z, lookAt.x, lookAt.y, lookAt.z, 0, 1, 0);
-  // Draw the scene
-  render();
+  beginFrame();
+  applyInput();
+  drawCachedSceneFrame();
+  if (show_overdraw) {
+    double average = overdraw();
+    if (average >= 0) {
+      char title[64];
+      snprintf(title, sizeof(title), "Final Project - %.2f fragments shaded per pixel", average);
+      glutSetWindowTitle(title);
+    }
+  }
   // Display the update by swapping the front and back buffers.
-  glutSwapBuffers();
+  {
+    ProfileScope scope("swap");
+    glutSwapBuffers();
+  }
+  endFrame();
+}
+
+/*
+ * Whether everything loaded in the background is ready, for the benchmark.
+ */
+bool sceneLoaded() {
+  return software_rendering ? softwareTextureLoaded(softwareRenderer) : textureStream.done();
+}
+
+/*
+ * Whether to keep drawing with nothing new asked for: while the water
+ * or the lamps move, and until the whole texture is in.
+ */
+bool animating() {
+  return animated_water || swaying_lamps || !sceneLoaded();
 }
 
 /*
@@ -1744,10 +1474,12 @@ void reshape(int w, int h) {
   glFrustum(-1.0, 1.0, -1.0, 1.0, 1.5, 1000.0);
   // Set the matrix mode back to modelview.
   glMatrixMode(GL_MODELVIEW);
+  if (software_rendering)
+    resizeSoftwareRenderer(&softwareRenderer, w, h);
 }
 
 /*
- * Simple vector3 times 3x3 matrix multiplication for use in moveViewer.
+ * Simple vector3 times 3x3 matrix multiplication for use in applyInput.
  */
 vector3 vector3TimesMatrix3x3(vector3 v, float* m) {
   vector3 result = {v.x * m[0] + v.y * m[3] + v.z * m[6],
@@ -1757,15 +1489,14 @@ vector3 vector3TimesMatrix3x3(vector3 v, float* m) {
 }
 
 /*
- * Motion registry. Callback function to move the lookAt vector
- * whenever the mouse is moved with one of the mouse buttons held down.
+ * Move the camera by the input received since the last frame.
  */
-void moveLookAt(int x, int y) {
-  int dX = x - mouseX;
-  int dY = y - mouseY;
+void applyInput() {
+  if (pendingTurnX == 0 && pendingTurnY == 0 && pendingSteps == 0)
+    return;
 
-  float yRotation = dX / 20.0;
-  float xRotation = dY / 20.0;
+  float yRotation = pendingTurnX / 20.0;
+  float xRotation = pendingTurnY / 20.0;
 
   // Rotate about the y axis to move the camera left and right.
   float yRotationMatrix[] =  {cos(yRotation), 0, sin(yRotation),
@@ -1781,44 +1512,53 @@ void moveLookAt(int x, int y) {
 							       yRotationMatrix), xRotationMatrix);
   // Update the location we are looking at.
   lookAt = viewer.add(dirVec);
-  
+
+  // Then step along the new direction.
+  vector3 step = dirVec.normalize().scalar(pendingSteps);
+  viewer = viewer.add(step);
+  lookAt = lookAt.add(step);
+
+  pendingTurnX = 0;
+  pendingTurnY = 0;
+  pendingSteps = 0;
+}
+
+/*
+ * Motion registry. Turns the camera, at the next frame, whenever the
+ * mouse is moved with one of the mouse buttons held down.
+ */
+void moveLookAt(int x, int y) {
+  pendingTurnX += x - mouseX;
+  pendingTurnY += y - mouseY;
   mouseX = x;
   mouseY = y;
-  
-  glutPostRedisplay();
+  requestFrame();
 }
 
 /*
- * Keyboard motion registry. Callback function to move the viewer position
- * using the arrow keys of the keyboard.
+ * Keyboard motion registry. Callback function to move the viewer position,
+ * at the next frame, using the arrow keys of the keyboard.
  * Also handles user input for toggling lights and textures.
  */
 void moveViewer(int key, int x, int y) {
-  vector3 dirVec = {0, 0, 0}; 
   switch (key) {
   case GLUT_KEY_UP:
-    dirVec = lookAt.subtract(viewer).normalize();
+    pendingSteps++;
     break;
   case GLUT_KEY_DOWN:
-    dirVec = lookAt.subtract(viewer).normalize().scalar(-1);
+    pendingSteps--;
     break;
   case GLUT_KEY_F1:
-    if (light_zero)
-      glDisable(GL_LIGHT0);
-    else glEnable(GL_LIGHT0);
     light_zero = !light_zero;
+    setSceneLightEnabled(0, light_zero);
     break;
   case GLUT_KEY_F2:
-    if (light_one) 
-      glDisable(GL_LIGHT1);
-    else glEnable(GL_LIGHT1);    
     light_one = !light_one;
+    setSceneLightEnabled(1, light_one);
     break;
   case GLUT_KEY_F3:
-    if (light_two)
-      glDisable(GL_LIGHT2);
-    else glEnable(GL_LIGHT2);
     light_two = !light_two;
+    setSceneLightEnabled(2, light_two);
     break;
   case GLUT_KEY_F4:
     textured_water = !textured_water;
@@ -1826,12 +1566,30 @@ void moveViewer(int key, int x, int y) {
   case GLUT_KEY_F5:
     plain_walls = !plain_walls;
     break;
+  case GLUT_KEY_F6:
+    animated_water = !animated_water;
+    updateWaterSimulation();
+    break;
+  case GLUT_KEY_F7:
+    if (profiling())
+      writeProfile(profileFile, true);
+    else
+      startProfiling();
+    break;
+  case GLUT_KEY_F8:
+    depth_prepass = !depth_prepass;
+    break;
+  case GLUT_KEY_F9:
+    showOverdraw(!show_overdraw);
+    if (!show_overdraw)
+      glutSetWindowTitle("Final Project");
+    break;
+  case GLUT_KEY_F10:
+    swaying_lamps = !swaying_lamps;
+    break;
   }
 
-  viewer = viewer.add(dirVec);
-  lookAt = lookAt.add(dirVec);
-  
-  glutPostRedisplay();
+  requestFrame();
 }
 
 /*
@@ -1842,12 +1600,54 @@ void trackMouse(int x, int y) {
   mouseY = y;
 }
 
+/*
+ * Write the profile recorded since --profile. The context may already be
+ * gone, so GPU timings not yet collected are left out.
+ */
+void writeProfileAtExit() {
+  writeProfile(profileFile, false);
+}
+
 /*
  * Main program.
  */
 int main(int argc, char** argv) {
-  // Texture info.
-  texture.fn = "combined-texture.bmp"; // 2800 * 1960  
+  // Start with the water animated, the lamps swaying, more lights, the
+  // depth pre-pass, the overdraw shown, the profiler recording or the
+  // scene drawn on the CPU if asked to, or just report on the meshes.
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--animated-water") == 0)
+      animated_water = true;
+    if (strcmp(argv[i], "--sway-lamps") == 0)
+      swaying_lamps = true;
+    if (strcmp(argv[i], "--lights") == 0 && i + 1 < argc)
+      extraLights = max(atoi(argv[++i]), 0);
+    if (strcmp(argv[i], "--frame-rate") == 0 && i + 1 < argc)
+      frameRate = max(atof(argv[++i]), 0.0);
+    if (strcmp(argv[i], "--depth-prepass") == 0)
+      depth_prepass = true;
+    if (strcmp(argv[i], "--overdraw") == 0)
+      show_overdraw = true;
+    if (strcmp(argv[i], "--software") == 0)
+      software_rendering = true;
+    if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+      profileFile = argv[++i];
+      startProfiling();
+      atexit(writeProfileAtExit);
+    }
+    if (strcmp(argv[i], "--mesh-stats") == 0) {
+      printMeshStats();
+      return 0;
+    }
+  }
+
+  // Run the headless benchmark instead of opening a window if asked to.
+  BenchOptions benchOptions;
+  if (parseBenchArgs(argc, argv, &benchOptions)) {
+    BenchScene scene = {&viewer, &lookAt, initialize, reshape, drawFrame, drawCachedSceneFrame, sceneLoaded,
+                        shownOverdraw};
+    return runBench(argc, argv, benchOptions, scene);
+  }
   
   // Initialize glut.
   glutInit(&argc, argv);
@@ -1872,6 +1672,9 @@ int main(int argc, char** argv) {
 
   // Set our program's parameters.
   initialize();
+  // Draw only when something changes or moves, at most frameRate times a
+  // second.
+  startFrameScheduler(frameRate, animating);
 
   // Draw the scene until the window is close.
   glutMainLoop();
@@ -0,0 +1,385 @@
+/*
+ * Headless frame benchmark. See bench.h.
+ */
+#include "platform.h"
+#include "GL/gl.h"
+#ifdef _WIN32
+#include "GL/glut.h"
+#else
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include "bench.h"
+
+using namespace std;
+
+#define BENCH_PI 3.1415926536
+
+/*
+ * One leg of the scripted camera path.
+ * place sets the viewer and lookAt vectors for t in [0, 1].
+ */
+struct BenchPhase {
+  const char *name;
+  void (*place)(float t, vector3 *viewer, vector3 *lookAt);
+};
+
+/*
+ * The default view from main(), held still.
+ */
+static void placeOverview(float t, vector3 *viewer, vector3 *lookAt) {
+  *viewer = vector3(50, 50, 150);
+  *lookAt = vector3(0, 0, 0);
+}
+
+/*
+ * Circle the room above the deck, looking down into the pool.
+ */
+static void placeOrbit(float t, vector3 *viewer, vector3 *lookAt) {
+  float angle = (float) (t * 2 * BENCH_PI);
+  *viewer = vector3(80 * cos(angle), 50, 130 * sin(angle));
+  *lookAt = vector3(0, -20, 0);
+}
+
+/*
+ * Walk the length of the left deck, looking ahead.
+ */
+static void placeWalk(float t, vector3 *viewer, vector3 *lookAt) {
+  float z = 140 - 280 * t;
+  *viewer = vector3(-75, 20, z);
+  *lookAt = vector3(-75, 15, z - 10);
+}
+
+/*
+ * Stand near the far wall and pan across it, so that most of the
+ * scene is behind the camera.
+ */
+static void placeFaceWall(float t, vector3 *viewer, vector3 *lookAt) {
+  float x = -60 + 120 * t;
+  *viewer = vector3(0, 50, -110);
+  *lookAt = vector3(x, 50, -150);
+}
+
+/*
+ * Drop from the end of the diving board towards the water.
+ */
+static void placeDive(float t, vector3 *viewer, vector3 *lookAt) {
+  *viewer = vector3(0, 40 - 45 * t, 80 - 20 * t);
+  *lookAt = vector3(0, -40, 20);
+}
+
+static const BenchPhase phases[] = {
+  {"overview", placeOverview},
+  {"orbit", placeOrbit},
+  {"walk", placeWalk},
+  {"face_wall", placeFaceWall},
+  {"dive", placeDive},
+};
+
+/*
+ * Frame time statistics for one phase, in milliseconds.
+ */
+struct BenchStats {
+  string name;
+  int frames;
+  double min;
+  double median;
+  double p99;
+  double mean;
+  double fps;
+  double overdraw;          // Mean fragments shaded per pixel, or -1.
+};
+
+/*
+ * Nearest rank percentile of an already sorted list.
+ */
+static double percentile(const vector<double> &sorted, double p) {
+  size_t rank = (size_t) ceil(p * sorted.size());
+  if (rank > 0)
+    rank--;
+  return sorted[min(rank, sorted.size() - 1)];
+}
+
+static BenchStats summarize(const string &name, vector<double> times, const vector<double> &overdraws) {
+  BenchStats s;
+  sort(times.begin(), times.end());
+  double total = 0;
+  for (double t : times)
+    total += t;
+
+  s.name = name;
+  s.frames = (int) times.size();
+  s.min = times.front();
+  s.median = percentile(times, 0.5);
+  s.p99 = percentile(times, 0.99);
+  s.mean = total / times.size();
+  s.fps = (s.mean > 0) ? 1000.0 / s.mean : 0;
+
+  s.overdraw = -1;
+  if (!overdraws.empty()) {
+    s.overdraw = 0;
+    for (double o : overdraws)
+      s.overdraw += o / overdraws.size();
+  }
+  return s;
+}
+
+static void usageExit(const char *message) {
+  cerr << "--bench: " << message << endl;
+  cerr << "usage: --bench [--frames N] [--warmup N] [--size WxH] [--phase NAME] [--out FILE]"
+       << " [--capture PREFIX] [--frame-cache]" << endl;
+  exit(1);
+}
+
+bool parseBenchArgs(int argc, char **argv, BenchOptions *opts) {
+  bool bench = false;
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    bool hasValue = (i + 1 < argc);
+
+    if (strcmp(arg, "--bench") == 0) {
+      bench = true;
+    } else if (strcmp(arg, "--frames") == 0) {
+      if (!hasValue || (opts->frames = atoi(argv[++i])) <= 0)
+        usageExit("--frames must be positive");
+    } else if (strcmp(arg, "--warmup") == 0) {
+      if (!hasValue || (opts->warmup = atoi(argv[++i])) < 0)
+        usageExit("--warmup must not be negative");
+    } else if (strcmp(arg, "--size") == 0) {
+      if (!hasValue || sscanf(argv[++i], "%dx%d", &opts->width, &opts->height) != 2 ||
+          opts->width <= 0 || opts->height <= 0)
+        usageExit("--size must look like 750x750");
+    } else if (strcmp(arg, "--phase") == 0) {
+      if (!hasValue)
+        usageExit("--phase needs a name");
+      opts->phase = argv[++i];
+    } else if (strcmp(arg, "--out") == 0) {
+      if (!hasValue)
+        usageExit("--out needs a file name");
+      opts->output = argv[++i];
+    } else if (strcmp(arg, "--capture") == 0) {
+      if (!hasValue)
+        usageExit("--capture needs a file name prefix");
+      opts->capture = argv[++i];
+    } else if (strcmp(arg, "--frame-cache") == 0) {
+      opts->frameCache = true;
+    }
+  }
+  return bench;
+}
+
+#ifdef _WIN32
+
+/*
+ * Windows has no surfaceless context, so render into the back buffer
+ * of a GLUT window that is never shown.
+ */
+static bool createContext(int argc, char **argv, int width, int height) {
+  glutInit(&argc, argv);
+  glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH);
+  glutInitWindowSize(width, height);
+  glutCreateWindow("Final Project - bench");
+  glutHideWindow();
+  return true;
+}
+
+static void destroyContext() {
+}
+
+#else
+
+static EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+static EGLSurface eglSurface = EGL_NO_SURFACE;
+static EGLContext eglContext = EGL_NO_CONTEXT;
+
+/*
+ * Create a compatibility profile context rendering to a pbuffer,
+ * preferring Mesa's surfaceless platform so no X server is needed.
+ */
+static bool createContext(int argc, char **argv, int width, int height) {
+  PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+    (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+  if (getPlatformDisplay != NULL)
+    eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+  if (eglDisplay == EGL_NO_DISPLAY)
+    eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+  EGLint major, minor;
+  if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor)) {
+    cerr << "eglInitialize failed." << endl;
+    return false;
+  }
+
+  const EGLint configAttribs[] = {
+    EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    EGL_RED_SIZE, 8,
+    EGL_GREEN_SIZE, 8,
+    EGL_BLUE_SIZE, 8,
+    EGL_ALPHA_SIZE, 8,
+    EGL_DEPTH_SIZE, 24,
+    EGL_NONE
+  };
+  EGLConfig config;
+  EGLint numConfigs = 0;
+  if (!eglChooseConfig(eglDisplay, configAttribs, &config, 1, &numConfigs) || numConfigs == 0) {
+    cerr << "No EGL config with an RGBA pbuffer and depth buffer." << endl;
+    return false;
+  }
+
+  const EGLint surfaceAttribs[] = {EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE};
+  eglSurface = eglCreatePbufferSurface(eglDisplay, config, surfaceAttribs);
+  if (eglSurface == EGL_NO_SURFACE) {
+    cerr << "eglCreatePbufferSurface failed." << endl;
+    return false;
+  }
+
+  eglBindAPI(EGL_OPENGL_API);
+  eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, NULL);
+  if (eglContext == EGL_NO_CONTEXT ||
+      !eglMakeCurrent(eglDisplay, eglSurface, eglSurface, eglContext)) {
+    cerr << "Could not create an OpenGL context." << endl;
+    return false;
+  }
+  return true;
+}
+
+static void destroyContext() {
+  eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglDestroyContext(eglDisplay, eglContext);
+  eglDestroySurface(eglDisplay, eglSurface);
+  eglTerminate(eglDisplay);
+}
+
+#endif // _WIN32
+
+/*
+ * Save the current color buffer as a binary PPM image, for comparing
+ * the output of different renderer versions.
+ */
+static void capture(const string &filename, int width, int height) {
+  vector<unsigned char> pixels(width * height * 3);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+  FILE *file;
+  fopen_s(&file, filename.c_str(), "wb");
+  if (file == NULL) {
+    cerr << "--bench: cannot write " << filename << endl;
+    return;
+  }
+  fprintf(file, "P6\n%d %d\n255\n", width, height);
+  // OpenGL rows run bottom to top, PPM rows top to bottom.
+  for (int row = height - 1; row >= 0; row--)
+    fwrite(&pixels[row * width * 3], 1, width * 3, file);
+  fclose(file);
+}
+
+static void writeStats(FILE *out, const BenchStats &s) {
+  fprintf(out, "{\"name\": \"%s\", \"frames\": %d, \"min_ms\": %.4f, \"median_ms\": %.4f, "
+          "\"p99_ms\": %.4f, \"mean_ms\": %.4f, \"fps\": %.2f",
+          s.name.c_str(), s.frames, s.min, s.median, s.p99, s.mean, s.fps);
+  if (s.overdraw >= 0)
+    fprintf(out, ", \"overdraw\": %.3f", s.overdraw);
+  fprintf(out, "}");
+}
+
+static void writeJson(FILE *out, const BenchOptions &opts,
+                      const vector<BenchStats> &results, const BenchStats &total) {
+  fprintf(out, "{\n");
+  fprintf(out, "  \"renderer\": \"%s\",\n", (const char *) glGetString(GL_RENDERER));
+  fprintf(out, "  \"version\": \"%s\",\n", (const char *) glGetString(GL_VERSION));
+  fprintf(out, "  \"width\": %d,\n  \"height\": %d,\n", opts.width, opts.height);
+  fprintf(out, "  \"frames_per_phase\": %d,\n  \"warmup\": %d,\n", opts.frames, opts.warmup);
+  fprintf(out, "  \"phases\": [\n");
+  for (size_t i = 0; i < results.size(); i++) {
+    fprintf(out, "    ");
+    writeStats(out, results[i]);
+    fprintf(out, (i + 1 < results.size()) ? ",\n" : "\n");
+  }
+  fprintf(out, "  ],\n  \"total\": ");
+  writeStats(out, total);
+  fprintf(out, "\n}\n");
+}
+
+int runBench(int argc, char **argv, const BenchOptions &opts, const BenchScene &scene) {
+  if (!createContext(argc, argv, opts.width, opts.height))
+    return 1;
+
+  scene.initialize();
+  scene.reshape(opts.width, opts.height);
+  while (!scene.loaded()) {
+    scene.drawFrame();
+    glFinish();
+  }
+
+  void (*drawFrame)() = opts.frameCache ? scene.drawCachedFrame : scene.drawFrame;
+  vector<BenchStats> results;
+  vector<double> allTimes, allOverdraws;
+
+  for (const BenchPhase &phase : phases) {
+    if (!opts.phase.empty() && opts.phase != phase.name)
+      continue;
+
+    for (int i = 0; i < opts.warmup; i++) {
+      phase.place(0, scene.viewer, scene.lookAt);
+      drawFrame();
+      glFinish();
+    }
+
+    vector<double> times, overdraws;
+    times.reserve(opts.frames);
+    for (int i = 0; i < opts.frames; i++) {
+      float t = (opts.frames > 1) ? (float) i / (opts.frames - 1) : 0;
+      phase.place(t, scene.viewer, scene.lookAt);
+
+      // glFinish makes the time include the work queued for the GPU
+      // (or llvmpipe's threads), not just the API calls.
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      drawFrame();
+      glFinish();
+      chrono::steady_clock::time_point end = chrono::steady_clock::now();
+
+      times.push_back(chrono::duration<double, milli>(end - start).count());
+      double overdraw = scene.overdraw();
+      if (overdraw >= 0)
+        overdraws.push_back(overdraw);
+
+      if (i == 0 && !opts.capture.empty())
+        capture(opts.capture + "-" + phase.name + ".ppm", opts.width, opts.height);
+    }
+    allTimes.insert(allTimes.end(), times.begin(), times.end());
+    allOverdraws.insert(allOverdraws.end(), overdraws.begin(), overdraws.end());
+    results.push_back(summarize(phase.name, times, overdraws));
+  }
+
+  if (results.empty()) {
+    cerr << "--bench: unknown phase \"" << opts.phase << "\"" << endl;
+    destroyContext();
+    return 1;
+  }
+
+  FILE *out = stdout;
+  if (!opts.output.empty()) {
+    fopen_s(&out, opts.output.c_str(), "w");
+    if (out == NULL) {
+      cerr << "--bench: cannot write " << opts.output << endl;
+      destroyContext();
+      return 1;
+    }
+  }
+  writeJson(out, opts, results, summarize("total", allTimes, allOverdraws));
+  if (out != stdout)
+    fclose(out);
+
+  destroyContext();
+  return 0;
+}
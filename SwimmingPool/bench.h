@@ -0,0 +1,62 @@
+#pragma once
+/*
+ * Headless frame benchmark.
+ *
+ * Started with "--bench" on the command line. Creates an offscreen
+ * context (EGL surfaceless on Linux, so it also runs on llvmpipe; a
+ * GLUT window on Windows), moves the camera along a scripted path,
+ * renders a fixed number of frames per phase of the path and reports
+ * min/median/p99 frame times as JSON, and the mean overdraw if the scene
+ * counts it.
+ */
+#include <string>
+#include "vector3.h"
+
+/*
+ * Benchmark settings, filled in from the command line.
+ */
+struct BenchOptions {
+  int width = 750;        // Size of the offscreen surface.
+  int height = 750;
+  int frames = 200;       // Frames timed per phase.
+  int warmup = 10;        // Untimed frames rendered before each phase.
+  std::string phase;      // Only run the phase with this name if not empty.
+  std::string output;     // Write the JSON here instead of to stdout.
+  std::string capture;    // Save the first timed frame of each phase as
+                          // <capture>-<phase>.ppm if not empty.
+  bool frameCache = false; // Draw with drawCachedFrame, like the window.
+};
+
+/*
+ * The hooks the benchmark needs into the scene.
+ * drawFrame must render one complete frame from viewer/lookAt
+ * without presenting it, and drawCachedFrame likewise, but through the
+ * window's frame cache. loaded returns true once everything the
+ * scene loads in the background is in; until then the benchmark
+ * renders untimed frames. overdraw returns the fragments shaded per
+ * pixel by the frame just finished, or -1 if they are not counted.
+ */
+struct BenchScene {
+  vector3 *viewer;
+  vector3 *lookAt;
+  void (*initialize)();
+  void (*reshape)(int w, int h);
+  void (*drawFrame)();
+  void (*drawCachedFrame)();
+  bool (*loaded)();
+  double (*overdraw)();
+};
+
+/*
+ * Returns true if "--bench" is present, in which case opts holds
+ * the settings given by any of:
+ *   --frames N  --warmup N  --size WxH  --phase NAME  --out FILE
+ *   --capture PREFIX  --frame-cache
+ * Exits with a message on a malformed option.
+ */
+bool parseBenchArgs(int argc, char **argv, BenchOptions *opts);
+
+/*
+ * Run the benchmark. Returns the process exit code.
+ */
+int runBench(int argc, char **argv, const BenchOptions &opts, const BenchScene &scene);
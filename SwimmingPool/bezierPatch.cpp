@@ -0,0 +1,138 @@
+/*
+ * CPU tessellation of a bicubic Bezier patch. See bezierPatch.h.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "bezierPatch.h"
+#include "simd.h"
+
+using namespace std;
+
+BezierPatch::BezierPatch() : changed(true) {
+  memset(control, 0, sizeof(control));
+  memset(texCoords, 0, sizeof(texCoords));
+}
+
+void BezierPatch::setControlPoints(const float points[4][4][3]) {
+  if (memcmp(control, points, sizeof(control)) != 0) {
+    memcpy(control, points, sizeof(control));
+    changed = true;
+  }
+}
+
+void BezierPatch::setTexCoords(const float coords[2][2][2]) {
+  if (memcmp(texCoords, coords, sizeof(texCoords)) != 0) {
+    memcpy(texCoords, coords, sizeof(texCoords));
+    changed = true;
+  }
+}
+
+void BezierPatch::makeBasis(int resolution, Basis *basis) {
+  int count = resolution + 1;
+  int padded = (count + LANES - 1) / LANES * LANES;
+
+  basis->resolution = resolution;
+  for (int k = 0; k < 4; k++) {
+    basis->value[k].resize(padded);
+    basis->derivative[k].resize(padded);
+  }
+
+  for (int i = 0; i < padded; i++) {
+    // The padding repeats the last parameter so it stays well defined.
+    float t = (float) min(i, resolution) / resolution;
+    float s = 1 - t;
+
+    basis->value[0][i] = s * s * s;
+    basis->value[1][i] = 3 * t * s * s;
+    basis->value[2][i] = 3 * t * t * s;
+    basis->value[3][i] = t * t * t;
+
+    basis->derivative[0][i] = -3 * s * s;
+    basis->derivative[1][i] = 3 * s * s - 6 * t * s;
+    basis->derivative[2][i] = 6 * t * s - 3 * t * t;
+    basis->derivative[3][i] = 3 * t * t;
+  }
+}
+
+bool BezierPatch::tessellate(int resolution, vector<float> *vertices) {
+  if (resolution != basis.resolution) {
+    makeBasis(resolution, &basis);
+    changed = true;
+  }
+  if (!changed)
+    return false;
+
+  int count = resolution + 1;
+  vertices->resize(count * count * FLOATS_PER_VERTEX);
+  float *out = vertices->data();
+
+  for (int i = 0; i < count; i++) {
+    float u = (float) i / resolution;
+
+    // Collapse the patch along u into a cubic curve in v, and its
+    // derivative with respect to u.
+    float curve[4][3];
+    float curveDu[4][3];
+    for (int j = 0; j < 4; j++) {
+      for (int c = 0; c < 3; c++) {
+        curve[j][c] = 0;
+        curveDu[j][c] = 0;
+        for (int k = 0; k < 4; k++) {
+          curve[j][c] += basis.value[k][i] * control[k][j][c];
+          curveDu[j][c] += basis.derivative[k][i] * control[k][j][c];
+        }
+      }
+    }
+
+    // Evaluate the curve at LANES columns at a time.
+    for (int first = 0; first < count; first += LANES) {
+      lanes p[3], du[3], dv[3];
+      for (int c = 0; c < 3; c++) {
+        p[c] = lanesSet(0.0f);
+        du[c] = lanesSet(0.0f);
+        dv[c] = lanesSet(0.0f);
+      }
+
+      for (int j = 0; j < 4; j++) {
+        lanes b = lanesLoad(&basis.value[j][first]);
+        lanes db = lanesLoad(&basis.derivative[j][first]);
+        for (int c = 0; c < 3; c++) {
+          p[c] = lanesAdd(p[c], lanesMul(b, lanesSet(curve[j][c])));
+          du[c] = lanesAdd(du[c], lanesMul(b, lanesSet(curveDu[j][c])));
+          dv[c] = lanesAdd(dv[c], lanesMul(db, lanesSet(curve[j][c])));
+        }
+      }
+
+      // normal = dv x du, which points to the counter clockwise side.
+      lanes n[3];
+      n[0] = lanesSub(lanesMul(dv[1], du[2]), lanesMul(dv[2], du[1]));
+      n[1] = lanesSub(lanesMul(dv[2], du[0]), lanesMul(dv[0], du[2]));
+      n[2] = lanesSub(lanesMul(dv[0], du[1]), lanesMul(dv[1], du[0]));
+      lanes length = lanesSqrt(lanesAdd(lanesAdd(lanesMul(n[0], n[0]), lanesMul(n[1], n[1])),
+                                        lanesMul(n[2], n[2])));
+      length = lanesMax(length, lanesSet(1e-20f));
+
+      float result[6][LANES];
+      for (int c = 0; c < 3; c++) {
+        lanesStore(result[c], p[c]);
+        lanesStore(result[3 + c], lanesDiv(n[c], length));
+      }
+
+      // Interleave the columns into the vertex array.
+      int columns = min(LANES, count - first);
+      for (int lane = 0; lane < columns; lane++) {
+        float v = (float) (first + lane) / resolution;
+        for (int c = 0; c < 6; c++)
+          *out++ = result[c][lane];
+        for (int c = 0; c < 2; c++) {
+          *out++ = (1 - u) * (1 - v) * texCoords[0][0][c] + u * (1 - v) * texCoords[0][1][c] +
+                   (1 - u) * v * texCoords[1][0][c] + u * v * texCoords[1][1][c];
+        }
+      }
+    }
+  }
+
+  changed = false;
+  return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+/*
+ * CPU tessellation of a bicubic Bezier patch.
+ *
+ * Replaces the fixed function evaluators (glMap2f / glEvalMesh2). The
+ * Bernstein basis functions and their derivatives are tabulated once per
+ * resolution, and a single pass over the grid produces positions, texture
+ * coordinates and analytic normals (the cross product of the partial
+ * derivatives), several columns at a time with SSE or AVX where the
+ * compiler targets them. The patch is only re-tessellated after its
+ * control points change.
+ */
+#include <vector>
+
+class BezierPatch {
+public:
+  // Each vertex: position x, y, z, normal x, y, z, texture s, t.
+  static const int FLOATS_PER_VERTEX = 8;
+
+  BezierPatch();
+
+  // Set the 4x4 control points, indexed [u][v][xyz] like the points
+  // given to glMap2f(GL_MAP2_VERTEX_3, 0, 1, 12, 4, 0, 1, 3, 4, ...).
+  void setControlPoints(const float points[4][4][3]);
+
+  // Texture coordinates are interpolated bilinearly between the corners,
+  // indexed [v][u][st] like the coordinates given to
+  // glMap2f(GL_MAP2_TEXTURE_COORD_2, 0, 1, 2, 2, 0, 1, 4, 2, ...).
+  void setTexCoords(const float coords[2][2][2]);
+
+  // Evaluate the patch on a grid of resolution x resolution quads,
+  // (resolution + 1)^2 vertices, u major: vertex (u, v) is at
+  // index u * (resolution + 1) + v. Returns false and leaves vertices alone
+  // if neither the control points nor the resolution changed since the
+  // last call.
+  bool tessellate(int resolution, std::vector<float> *vertices);
+
+private:
+  // Bernstein basis values and derivatives at resolution + 1 evenly
+  // spaced parameters, padded to a whole number of SIMD lanes.
+  struct Basis {
+    int resolution = -1;
+    std::vector<float> value[4];
+    std::vector<float> derivative[4];
+  };
+  static void makeBasis(int resolution, Basis *basis);
+
+  float control[4][4][3];
+  float texCoords[2][2][2];
+  bool changed;
+  Basis basis;
+};
@@ -0,0 +1,117 @@
+/*
+ * BMP loading. See bitmap.h.
+ */
+#include <cstring>
+#include <iostream>
+#include "platform.h"
+#include "bitmap.h"
+#include "jobs.h"
+#include "mappedFile.h"
+
+#if defined(__SSSE3__) || defined(__AVX__)
+#include <tmmintrin.h>
+#define BITMAP_SHUFFLE
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BITMAP_SWIZZLE
+#endif
+
+using namespace std;
+
+// The file type, "BM", and the uncompressed biCompression value.
+static const unsigned short BITMAP_TYPE = 0x4D42;
+static const unsigned int BITMAP_RGB = 0;
+
+/*
+ * Convert one row of width BGR pixels to RGBA with zero alpha.
+ */
+static void convertRow(const unsigned char *in, unsigned char *out, int width) {
+  int x = 0;
+  // Four pixels at a time read 16 bytes and use the first 12, so stop
+  // while the rest of the row still covers the whole load.
+#if defined(BITMAP_SHUFFLE)
+  const __m128i order = _mm_setr_epi8(2, 1, 0, -128, 5, 4, 3, -128,
+                                      8, 7, 6, -128, 11, 10, 9, -128);
+  for (; x + 6 <= width; x += 4) {
+    __m128i bgr = _mm_loadu_si128((const __m128i *) (in + 3 * x));
+    _mm_storeu_si128((__m128i *) (out + 4 * x), _mm_shuffle_epi8(bgr, order));
+  }
+#elif defined(BITMAP_SWIZZLE)
+  // Without a byte shuffle, gather the four bytes from each pixel's blue
+  // into a 32 bit lane, then swap blue and red with shifts, masking the
+  // next pixel's blue out of alpha.
+  const __m128i low = _mm_set1_epi32(0x000000FF);
+  const __m128i green = _mm_set1_epi32(0x0000FF00);
+  const __m128i high = _mm_set1_epi32(0x00FF0000);
+  for (; x + 6 <= width; x += 4) {
+    __m128i bgr = _mm_loadu_si128((const __m128i *) (in + 3 * x));
+    __m128i pixels = _mm_unpacklo_epi64(_mm_unpacklo_epi32(bgr, _mm_srli_si128(bgr, 3)),
+                                        _mm_unpacklo_epi32(_mm_srli_si128(bgr, 6), _mm_srli_si128(bgr, 9)));
+    __m128i rgba = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(pixels, 16), low),
+                                _mm_and_si128(pixels, green));
+    rgba = _mm_or_si128(rgba, _mm_and_si128(_mm_slli_epi32(pixels, 16), high));
+    _mm_storeu_si128((__m128i *) (out + 4 * x), rgba);
+  }
+#endif
+  for (; x < width; x++) {
+    out[4 * x] = in[3 * x + 2];
+    out[4 * x + 1] = in[3 * x + 1];
+    out[4 * x + 2] = in[3 * x];
+    out[4 * x + 3] = 0;
+  }
+}
+
+bool loadBitmap(const string &filename, Bitmap *bitmap) {
+  MappedFile file;
+  if (!file.open(filename.c_str())) {
+    cerr << "Cannot read " << filename << endl;
+    return false;
+  }
+
+  BITMAPFILEHEADER fileHeader;
+  BITMAPINFOHEADER infoHeader;
+  if (file.size() < sizeof(fileHeader) + sizeof(infoHeader)) {
+    cerr << filename << " is too short to be a bitmap" << endl;
+    return false;
+  }
+  memcpy(&fileHeader, file.data(), sizeof(fileHeader));
+  memcpy(&infoHeader, file.data() + sizeof(fileHeader), sizeof(infoHeader));
+
+  // Later versions of the info header only add fields after these.
+  if (fileHeader.bfType != BITMAP_TYPE || infoHeader.biSize < sizeof(infoHeader)) {
+    cerr << filename << " is not a bitmap" << endl;
+    return false;
+  }
+  if (infoHeader.biBitCount != 24 || infoHeader.biCompression != BITMAP_RGB) {
+    cerr << filename << " is not a 24 bit uncompressed bitmap" << endl;
+    return false;
+  }
+
+  // A negative height means the rows are stored top row first.
+  int width = infoHeader.biWidth;
+  int height = infoHeader.biHeight < 0 ? -infoHeader.biHeight : infoHeader.biHeight;
+  bool topDown = infoHeader.biHeight < 0;
+  // Each row is padded to a multiple of four bytes.
+  size_t stride = ((size_t) width * 3 + 3) & ~(size_t) 3;
+  if (width <= 0 || height <= 0 ||
+      fileHeader.bfOffBits > file.size() ||
+      (file.size() - fileHeader.bfOffBits) / stride < (size_t) height) {
+    cerr << filename << " has a bad size or is truncated" << endl;
+    return false;
+  }
+
+  bitmap->width = width;
+  bitmap->height = height;
+  bitmap->pixels.resize((size_t) width * height * 4);
+
+  const unsigned char *rows = file.data() + fileHeader.bfOffBits;
+  unsigned char *pixels = bitmap->pixels.data();
+  parallelFor(height, 64, [=](int first, int last) {
+    for (int row = first; row < last; row++) {
+      int source = topDown ? height - 1 - row : row;
+      convertRow(rows + source * stride, pixels + (size_t) row * width * 4, width);
+    }
+  });
+
+  return true;
+}
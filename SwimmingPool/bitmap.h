@@ -0,0 +1,25 @@
+#pragma once
+/*
+ * Loading 24 bit uncompressed BMP files as RGBA texture images.
+ *
+ * The file is memory mapped (see mappedFile.h) and its pixels converted
+ * straight from the mapping into the RGBA image, bands of rows at a time
+ * as jobs (see jobs.h). Where the compiler targets SSSE3 or AVX each
+ * thread converts four pixels per byte shuffle.
+ */
+#include <string>
+#include <vector>
+
+struct Bitmap {
+  int width;
+  int height;
+  // width * height RGBA pixels, bottom row first as OpenGL expects. The
+  // alpha of every pixel is 0, opaque under the scene's blend function.
+  std::vector<unsigned char> pixels;
+};
+
+/*
+ * Load filename into *bitmap. Reports the problem on cerr and returns
+ * false if the file cannot be read or is not a 24 bit uncompressed bitmap.
+ */
+bool loadBitmap(const std::string &filename, Bitmap *bitmap);
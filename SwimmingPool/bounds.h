@@ -0,0 +1,43 @@
+#pragma once
+/*
+ * Axis aligned bounding boxes.
+ */
+#include <algorithm>
+#include <cmath>
+#include "matrix4.h"
+
+struct BoundingBox {
+  // An empty box, which grows to fit the first point added.
+  vector3 min = vector3(1e30f, 1e30f, 1e30f);
+  vector3 max = vector3(-1e30f, -1e30f, -1e30f);
+
+  bool empty() const { return min.x > max.x; }
+  vector3 center() const { return min.add(max).scalar(0.5f); }
+  vector3 extent() const { return max.subtract(min).scalar(0.5f); }
+
+  void add(const vector3 &p) {
+    min = vector3(std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z));
+    max = vector3(std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z));
+  }
+  void add(const BoundingBox &b) {
+    if (!b.empty()) {
+      add(b.min);
+      add(b.max);
+    }
+  }
+
+  // The box around this box transformed by m.
+  BoundingBox transform(const matrix4 &m) const {
+    vector3 c = m.transformPoint(center());
+    vector3 e = extent();
+    // Each new half extent is the old half extents weighted by the
+    // absolute values of a row of the matrix.
+    vector3 r = vector3(std::fabs(m.m[0]) * e.x + std::fabs(m.m[4]) * e.y + std::fabs(m.m[8]) * e.z,
+                        std::fabs(m.m[1]) * e.x + std::fabs(m.m[5]) * e.y + std::fabs(m.m[9]) * e.z,
+                        std::fabs(m.m[2]) * e.x + std::fabs(m.m[6]) * e.y + std::fabs(m.m[10]) * e.z);
+    BoundingBox b;
+    b.min = c.subtract(r);
+    b.max = c.add(r);
+    return b;
+  }
+};
@@ -0,0 +1,177 @@
+/*
+ * View frustum culling. See culling.h.
+ */
+#include <algorithm>
+#include "glFunctions.h"
+#include "culling.h"
+#include "simd.h"
+#include "vectorBatch.h"
+
+using namespace std;
+
+// Leaves hold at most this many items.
+static const int BVH_LEAF_SIZE = 4;
+
+Frustum currentFrustum() {
+  matrix4 projection, modelview;
+  glGetFloatv(GL_PROJECTION_MATRIX, projection.m);
+  glGetFloatv(GL_MODELVIEW_MATRIX, modelview.m);
+  matrix4 clip = projection.multiply(modelview);
+
+  // Each plane is the sum or difference of the last row of the clip
+  // matrix and one of the others.
+  Frustum frustum;
+  for (int i = 0; i < 6; i++) {
+    int row = i / 2;
+    float sign = (i % 2 == 0) ? 1.0f : -1.0f;
+    frustum.a[i] = clip.m[3] + sign * clip.m[row];
+    frustum.b[i] = clip.m[7] + sign * clip.m[4 + row];
+    frustum.c[i] = clip.m[11] + sign * clip.m[8 + row];
+    frustum.d[i] = clip.m[15] + sign * clip.m[12 + row];
+  }
+  for (int i = 6; i < Frustum::PLANES; i++) {
+    frustum.a[i] = 0;
+    frustum.b[i] = 0;
+    frustum.c[i] = 0;
+    frustum.d[i] = 1;
+  }
+
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  frustum.modelview = modelview;
+  frustum.pixelScale = projection.m[5] * viewport[3] / 2;
+  frustum.farDistance = projection.m[14] / (projection.m[10] + 1);
+  return frustum;
+}
+
+void projectedRadii(const Frustum &frustum, const vector<BoundingBox> &boxes, vector<float> *radii) {
+  vector3Batch centers;
+  centers.resize(boxes.size());
+  for (size_t i = 0; i < boxes.size(); i++)
+    centers.set(i, boxes[i].center());
+  transformPoints(frustum.modelview, centers, &centers);
+  vector<float> distancesSquared;
+  dotProducts(centers, centers, &distancesSquared);
+
+  radii->resize(boxes.size());
+  for (size_t i = 0; i < boxes.size(); i++) {
+    vector3 extent = boxes[i].extent();
+    float radius = sqrt(extent.dot(extent));
+    float distance = sqrt(distancesSquared[i]);
+    // From inside the sphere it covers the whole view.
+    (*radii)[i] = (distance <= radius) ? 1e30f : frustum.pixelScale * radius / distance;
+  }
+}
+
+Containment testBox(const Frustum &frustum, const BoundingBox &box) {
+  vector3 center = box.center();
+  vector3 extent = box.extent();
+  lanes cx = lanesSet(center.x), cy = lanesSet(center.y), cz = lanesSet(center.z);
+  lanes ex = lanesSet(extent.x), ey = lanesSet(extent.y), ez = lanesSet(extent.z);
+  lanes zero = lanesSet(0.0f);
+  int outside = 0;
+  int crossing = 0;
+
+  for (int i = 0; i < Frustum::PLANES; i += LANES) {
+    lanes a = lanesLoad(frustum.a + i);
+    lanes b = lanesLoad(frustum.b + i);
+    lanes c = lanesLoad(frustum.c + i);
+    // Distance from the plane to the center of the box, and the
+    // furthest any corner is from the center along the plane normal.
+    lanes distance = lanesAdd(lanesAdd(lanesMul(a, cx), lanesMul(b, cy)),
+                              lanesAdd(lanesMul(c, cz), lanesLoad(frustum.d + i)));
+    lanes radius = lanesAdd(lanesAdd(lanesMul(lanesMax(a, lanesSub(zero, a)), ex),
+                                     lanesMul(lanesMax(b, lanesSub(zero, b)), ey)),
+                            lanesMul(lanesMax(c, lanesSub(zero, c)), ez));
+    outside |= lanesLessMask(distance, lanesSub(zero, radius));
+    crossing |= lanesLessMask(distance, radius);
+  }
+
+  if (outside != 0)
+    return Outside;
+  return (crossing != 0) ? Intersecting : Inside;
+}
+
+/*
+ * Build the subtree over items first .. first + count - 1, splitting at
+ * the median along the axis the item centers are most spread out along.
+ */
+static int buildNode(BoundingVolumeHierarchy *bvh, int first, int count) {
+  BoundingVolumeHierarchy::Node node;
+  BoundingBox centers;
+  for (int i = first; i < first + count; i++) {
+    node.bounds.add(bvh->itemBounds[bvh->items[i]]);
+    centers.add(bvh->itemBounds[bvh->items[i]].center());
+  }
+  node.first = first;
+  node.count = count;
+  node.left = -1;
+  node.right = -1;
+
+  int index = (int) bvh->nodes.size();
+  bvh->nodes.push_back(node);
+  if (count <= BVH_LEAF_SIZE)
+    return index;
+
+  vector3 spread = centers.max.subtract(centers.min);
+  int axis = (spread.x >= spread.y && spread.x >= spread.z) ? 0 : (spread.y >= spread.z) ? 1 : 2;
+  const vector<BoundingBox> &bounds = bvh->itemBounds;
+  int *begin = bvh->items.data() + first;
+  nth_element(begin, begin + count / 2, begin + count, [&](int p, int q) {
+    vector3 cp = bounds[p].center();
+    vector3 cq = bounds[q].center();
+    return (axis == 0) ? cp.x < cq.x : (axis == 1) ? cp.y < cq.y : cp.z < cq.z;
+  });
+
+  int left = buildNode(bvh, first, count / 2);
+  int right = buildNode(bvh, first + count / 2, count - count / 2);
+  bvh->nodes[index].left = left;
+  bvh->nodes[index].right = right;
+  return index;
+}
+
+void buildBVH(BoundingVolumeHierarchy *bvh, const vector<BoundingBox> &bounds) {
+  bvh->nodes.clear();
+  bvh->itemBounds = bounds;
+  bvh->items.resize(bounds.size());
+  for (size_t i = 0; i < bounds.size(); i++)
+    bvh->items[i] = (int) i;
+
+  if (!bounds.empty())
+    buildNode(bvh, 0, (int) bounds.size());
+}
+
+int cullBVH(const BoundingVolumeHierarchy &bvh, const Frustum &frustum, vector<char> *visible) {
+  visible->assign(bvh.itemBounds.size(), 0);
+  if (bvh.nodes.empty())
+    return 0;
+
+  int count = 0;
+  int stack[64];
+  int depth = 0;
+  stack[depth++] = 0;
+
+  while (depth > 0) {
+    const BoundingVolumeHierarchy::Node &node = bvh.nodes[stack[--depth]];
+    Containment containment = testBox(frustum, node.bounds);
+    if (containment == Outside)
+      continue;
+
+    if (containment == Inside) {
+      for (int i = node.first; i < node.first + node.count; i++)
+        (*visible)[bvh.items[i]] = 1;
+      count += node.count;
+    } else if (node.left < 0) {
+      for (int i = node.first; i < node.first + node.count; i++) {
+        if (testBox(frustum, bvh.itemBounds[bvh.items[i]]) != Outside) {
+          (*visible)[bvh.items[i]] = 1;
+          count++;
+        }
+      }
+    } else {
+      stack[depth++] = node.left;
+      stack[depth++] = node.right;
+    }
+  }
+  return count;
+}
@@ -0,0 +1,74 @@
+#pragma once
+/*
+ * View frustum culling.
+ *
+ * The frustum is taken from the current gl projection and modelview
+ * matrices, so it always matches the camera set up with gluLookAt. Boxes
+ * are tested against all six planes at once, a SIMD register of planes at
+ * a time (see simd.h). A BoundingVolumeHierarchy groups many boxes so
+ * whole subtrees outside the frustum are rejected with one test, and
+ * subtrees entirely inside it are accepted without testing further.
+ */
+#include <vector>
+#include "bounds.h"
+
+enum Containment { Outside, Intersecting, Inside };
+
+/*
+ * The six planes, as a x + b y + c z + d >= 0 inside, stored as a structure
+ * of arrays and padded with planes everything is inside of to a whole
+ * number of SIMD registers.
+ */
+struct Frustum {
+  static const int PLANES = 8;
+  float a[PLANES];
+  float b[PLANES];
+  float c[PLANES];
+  float d[PLANES];
+
+  // For measuring how large things look: the modelview matrix, and the
+  // height in pixels of something one unit tall one unit from the eye.
+  matrix4 modelview;
+  float pixelScale;
+
+  // For ordering by depth: the distance from the eye to the far plane.
+  float farDistance;
+};
+
+/*
+ * The frustum of the current gl projection and modelview matrices and
+ * viewport, in the coordinates the modelview matrix is applied to.
+ */
+Frustum currentFrustum();
+
+Containment testBox(const Frustum &frustum, const BoundingBox &box);
+
+/*
+ * About how many pixels the radius of the sphere around each box covers,
+ * with the centers transformed and measured as a batch (see
+ * vectorBatch.h).
+ */
+void projectedRadii(const Frustum &frustum, const std::vector<BoundingBox> &boxes, std::vector<float> *radii);
+
+struct BoundingVolumeHierarchy {
+  struct Node {
+    BoundingBox bounds;
+    int left, right;                  // Child nodes, -1 for a leaf.
+    int first, count;                 // The items of the subtree, in items.
+  };
+
+  std::vector<Node> nodes;            // nodes[0] is the root.
+  std::vector<int> items;             // Item indices grouped by subtree.
+  std::vector<BoundingBox> itemBounds;
+};
+
+/*
+ * Build a hierarchy over the boxes of items 0 .. bounds.size() - 1.
+ */
+void buildBVH(BoundingVolumeHierarchy *bvh, const std::vector<BoundingBox> &bounds);
+
+/*
+ * Set visible[i] for every item i at least partly inside the frustum,
+ * and clear it for the rest. Returns the number visible.
+ */
+int cullBVH(const BoundingVolumeHierarchy &bvh, const Frustum &frustum, std::vector<char> *visible);
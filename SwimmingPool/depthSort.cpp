@@ -0,0 +1,34 @@
+/*
+ * Ordering things nearest first. See depthSort.h.
+ */
+#include <algorithm>
+#include <cmath>
+#include "depthSort.h"
+
+using namespace std;
+
+unsigned depthKey(const matrix4 &modelview, const BoundingBox &box, float farDistance) {
+  const float *m = modelview.m;
+  vector3 c = box.center();
+  vector3 e = box.extent();
+  // The eye looks down -z, and the nearest corner is nearer than the
+  // center by the half extents weighted by the z row of the matrix.
+  float center = -(m[2] * c.x + m[6] * c.y + m[10] * c.z + m[14]);
+  float reach = fabs(m[2]) * e.x + fabs(m[6]) * e.y + fabs(m[10]) * e.z;
+  float nearest = min(max((center - reach) / farDistance, 0.0f), 1.0f);
+  return (unsigned) (nearest * ((1 << DEPTH_KEY_BITS) - 1));
+}
+
+void sortByDepth(vector<DepthItem> *items) {
+  vector<DepthItem> sorted(items->size());
+  for (int shift = 0; shift < DEPTH_KEY_BITS; shift += 8) {
+    size_t starts[257] = {};
+    for (const DepthItem &item : *items)
+      starts[((item.key >> shift) & 255) + 1]++;
+    for (int digit = 0; digit < 256; digit++)
+      starts[digit + 1] += starts[digit];
+    for (const DepthItem &item : *items)
+      sorted[starts[(item.key >> shift) & 255]++] = item;
+    items->swap(sorted);
+  }
+}
@@ -0,0 +1,31 @@
+#pragma once
+/*
+ * Ordering things nearest first.
+ *
+ * Each thing is given a key from how far in front of the eye the nearest
+ * point of its bounding box is, quantized to DEPTH_KEY_BITS bits between
+ * the eye and the far plane, and the keys are radix sorted: a counting
+ * pass per byte of the key, least significant first, which is linear in
+ * the number of things and stable, so things at the same depth keep the
+ * order they were given in.
+ */
+#include <vector>
+#include "bounds.h"
+
+const int DEPTH_KEY_BITS = 16;
+
+struct DepthItem {
+  unsigned key;
+  int index;                // Whatever the caller is sorting.
+};
+
+/*
+ * The key of box seen with modelview, with farDistance the distance to
+ * the far plane. Everything beyond it has the largest key.
+ */
+unsigned depthKey(const matrix4 &modelview, const BoundingBox &box, float farDistance);
+
+/*
+ * Sort items by key, smallest first.
+ */
+void sortByDepth(std::vector<DepthItem> *items);
@@ -0,0 +1,155 @@
+/*
+ * Showing the last frame again instead of drawing it. See frameCache.h.
+ */
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include "frameCache.h"
+#include "glState.h"
+#include "profiler.h"
+
+using namespace std;
+
+void invalidateFrameCache(FrameCache *cache) {
+  cache->staticValid = false;
+  cache->frameValid = false;
+}
+
+/*
+ * Create the framebuffer, or give it a new size. Returns false if the
+ * driver cannot render to it.
+ */
+static bool resizeFrameCache(FrameCache *cache, int width, int height) {
+  if (cache->framebuffer == 0) {
+    glGenFramebuffers(1, &cache->framebuffer);
+    glGenRenderbuffers(3, cache->renderbuffers);
+  }
+  const GLenum formats[3] = {GL_RGBA8, GL_RGBA8, GL_DEPTH_COMPONENT24};
+  const GLenum attachments[3] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_DEPTH_ATTACHMENT};
+  GLint bound;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &bound);
+  glBindFramebuffer(GL_FRAMEBUFFER, cache->framebuffer);
+  for (int i = 0; i < 3; i++) {
+    glBindRenderbuffer(GL_RENDERBUFFER, cache->renderbuffers[i]);
+    glRenderbufferStorage(GL_RENDERBUFFER, formats[i], width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachments[i], GL_RENDERBUFFER, cache->renderbuffers[i]);
+  }
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+  glBindFramebuffer(GL_FRAMEBUFFER, bound);
+
+  cache->width = width;
+  cache->height = height;
+  invalidateFrameCache(cache);
+  return complete;
+}
+
+/*
+ * Copy a rectangle from one of the cache's color buffers to the bound
+ * draw framebuffer's draw buffer.
+ */
+static void copyRectangle(GLenum from, const int r[4]) {
+  glReadBuffer(from);
+  glBlitFramebuffer(r[0], r[1], r[0] + r[2], r[1] + r[3], r[0], r[1], r[0] + r[2], r[1] + r[3],
+                    GL_COLOR_BUFFER_BIT, GL_NEAREST);
+}
+
+bool drawCachedFrame(FrameCache *cache, const function<void()> &drawStatic,
+                     const function<void()> &drawMoving, const int damage[4]) {
+  if (!cache->usable)
+    return false;
+
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  if (viewport[2] != cache->width || viewport[3] != cache->height) {
+    if (!resizeFrameCache(cache, viewport[2], viewport[3])) {
+      cerr << "Cannot render to a framebuffer, so every frame will be drawn in full." << endl;
+      cache->usable = false;
+      return false;
+    }
+  }
+
+  GLint target;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &target);
+  glBindFramebuffer(GL_FRAMEBUFFER, cache->framebuffer);
+
+  if (!cache->staticValid) {
+    ProfileScope scope("static image", true);
+    glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    drawStatic();
+    cache->staticValid = true;
+    cache->frameValid = false;
+  }
+
+  GLenum shown = GL_COLOR_ATTACHMENT0;
+  if (drawMoving) {
+    ProfileScope scope("damage", true);
+    // Restore where the moving part was last frame as well as where it
+    // is now, or all of the frame if it is not a copy of the static
+    // image yet.
+    int restore[4] = {viewport[0], viewport[1], viewport[2], viewport[3]};
+    if (cache->frameValid) {
+      const int *last = cache->damage;
+      restore[0] = min(damage[0], last[0]);
+      restore[1] = min(damage[1], last[1]);
+      restore[2] = max(damage[0] + damage[2], last[0] + last[2]) - restore[0];
+      restore[3] = max(damage[1] + damage[3], last[1] + last[3]) - restore[1];
+    }
+    glDrawBuffer(GL_COLOR_ATTACHMENT1);
+    copyRectangle(GL_COLOR_ATTACHMENT0, restore);
+
+    cachedEnable(GL_SCISSOR_TEST);
+    glScissor(damage[0], damage[1], damage[2], damage[3]);
+    glDepthMask(GL_FALSE);
+    drawMoving();
+    glDepthMask(GL_TRUE);
+    cachedDisable(GL_SCISSOR_TEST);
+
+    copy(damage, damage + 4, cache->damage);
+    cache->frameValid = true;
+    shown = GL_COLOR_ATTACHMENT1;
+  }
+
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+  copyRectangle(shown, viewport);
+  glBindFramebuffer(GL_FRAMEBUFFER, target);
+  return true;
+}
+
+void screenRectangle(const BoundingBox &box, int rectangle[4]) {
+  matrix4 projection, modelview;
+  GLint viewport[4];
+  glGetFloatv(GL_PROJECTION_MATRIX, projection.m);
+  glGetFloatv(GL_MODELVIEW_MATRIX, modelview.m);
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  copy(viewport, viewport + 4, rectangle);
+
+  const matrix4 &p = projection;
+  float low[2] = {1e30f, 1e30f}, high[2] = {-1e30f, -1e30f};
+  for (int corner = 0; corner < 8; corner++) {
+    vector3 v = vector3((corner & 1) ? box.max.x : box.min.x,
+                        (corner & 2) ? box.max.y : box.min.y,
+                        (corner & 4) ? box.max.z : box.min.z);
+    vector3 eye = modelview.transformPoint(v);
+    float w = p.m[3] * eye.x + p.m[7] * eye.y + p.m[11] * eye.z + p.m[15];
+    if (w <= 1e-4f)
+      return;
+    float ndc[2] = {(p.m[0] * eye.x + p.m[4] * eye.y + p.m[8] * eye.z + p.m[12]) / w,
+                    (p.m[1] * eye.x + p.m[5] * eye.y + p.m[9] * eye.z + p.m[13]) / w};
+    for (int axis = 0; axis < 2; axis++) {
+      low[axis] = min(low[axis], ndc[axis]);
+      high[axis] = max(high[axis], ndc[axis]);
+    }
+  }
+
+  // To whole pixels, a pixel wider each way, within the viewport.
+  for (int axis = 0; axis < 2; axis++) {
+    int origin = viewport[axis], size = viewport[axis + 2];
+    int first = (int) floor(origin + (max(low[axis], -1.0f) + 1) * 0.5f * size) - 1;
+    int last = (int) ceil(origin + (min(high[axis], 1.0f) + 1) * 0.5f * size) + 1;
+    first = max(first, origin);
+    last = min(last, origin + size);
+    rectangle[axis] = first;
+    rectangle[axis + 2] = max(last - first, 0);
+  }
+}
@@ -0,0 +1,58 @@
+#pragma once
+/*
+ * Showing the last frame again instead of drawing it.
+ *
+ * Frames are drawn into an offscreen framebuffer and copied to the one
+ * that was bound. The part of the scene that only changes when something
+ * invalidates the cache (the camera moving, a light or texture toggled)
+ * is drawn once into a static image, with its depth. A part that moves
+ * every frame is drawn over a copy of the static image, scissored to a
+ * damage rectangle around it: each frame the rectangle is restored from
+ * the static image and the moving part is drawn into it again, without
+ * writing depth, so the static depth stays valid. While nothing moves a
+ * frame is just the copy out.
+ */
+#include <functional>
+#include "glFunctions.h"
+#include "bounds.h"
+
+struct FrameCache {
+  GLuint framebuffer = 0;
+  GLuint renderbuffers[3] = {0, 0, 0};   // Static image, frame and depth.
+  int width = 0;
+  int height = 0;
+  bool usable = true;                    // False if the framebuffer is unsupported.
+
+  bool staticValid = false;              // The static image shows the scene.
+  bool frameValid = false;               // The frame is the static image with damage drawn.
+  int damage[4] = {0, 0, 0, 0};          // x, y, width and height of the last damage.
+};
+
+/*
+ * Make the next frame draw the static image again.
+ */
+void invalidateFrameCache(FrameCache *cache);
+
+/*
+ * Show a frame through the cache at the size of the viewport:
+ *
+ * - If the static image is invalid or the viewport changed size,
+ *   drawStatic draws it (clearing first), with the cache's framebuffer
+ *   bound.
+ * - If drawMoving is set, the frame is restored from the static image
+ *   within damage (x, y, width and height in window coordinates) and
+ *   drawMoving draws there.
+ * - The result is copied to the framebuffer that was bound.
+ *
+ * Returns false, drawing nothing, if the cache cannot be used; draw the
+ * frame directly instead.
+ */
+bool drawCachedFrame(FrameCache *cache, const std::function<void()> &drawStatic,
+                     const std::function<void()> &drawMoving, const int damage[4]);
+
+/*
+ * The window rectangle (x, y, width and height) box covers with the
+ * current matrices, clipped to the viewport, or the whole viewport if
+ * part of it is behind the eye.
+ */
+void screenRectangle(const BoundingBox &box, int rectangle[4]);
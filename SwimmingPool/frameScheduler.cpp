@@ -0,0 +1,118 @@
+/*
+ * Drawing the window only when there is something new to show.
+ * See frameScheduler.h.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include "glFunctions.h"
+#include "GL/glut.h"
+#include "frameScheduler.h"
+#include "profiler.h"
+
+using namespace std;
+
+static double framesPerSecond = 0;
+static double interval = 0;              // Seconds between frames.
+static bool (*animating)() = NULL;
+
+static bool requested = false;           // requestFrame since the last frame began.
+static bool waiting = false;             // A frame is wanted, since waitingSince.
+static double waitingSince = 0;
+static bool timerSet = false;
+static bool started = false;             // A frame has begun, at lastStart.
+static double lastStart = 0;
+
+static FrameStats stats = {0, 0, 0};
+
+static double now() {
+  return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+ * When the frame wanted now should start: one interval after the last
+ * began, but not before it was wanted.
+ */
+static double deadline() {
+  return started ? max(lastStart + interval, waitingSince) : waitingSince;
+}
+
+static void timerFired(int) {
+  timerSet = false;
+  if (requested || animating())
+    glutPostRedisplay();
+  else
+    waiting = false;
+}
+
+/*
+ * Set the timer for the deadline of the frame now wanted, unless it is
+ * already set.
+ */
+static void schedule() {
+  double time = now();
+  if (!waiting) {
+    waiting = true;
+    waitingSince = time;
+  }
+  if (timerSet)
+    return;
+  timerSet = true;
+  glutTimerFunc((unsigned int) max(ceil((deadline() - time) * 1000), 0.0), timerFired, 0);
+}
+
+static void printFrameStats() {
+  cout << "Drew " << stats.drawn << " frames";
+  if (framesPerSecond > 0)
+    cout << " at up to " << framesPerSecond << " a second, " << stats.late << " late and "
+         << stats.dropped << " dropped";
+  cout << "." << endl;
+}
+
+void startFrameScheduler(double rate, bool (*isAnimating)()) {
+  framesPerSecond = rate;
+  interval = (rate > 0) ? 1 / rate : 0;
+  animating = isAnimating;
+  atexit(printFrameStats);
+  requestFrame();
+}
+
+void requestFrame() {
+  requested = true;
+  schedule();
+}
+
+void beginFrame() {
+  double time = now();
+  if (waiting && interval > 0) {
+    double lateness = time - deadline();
+    if (lateness > interval / 4) {
+      stats.late++;
+      stats.dropped += (long long) (lateness / interval);
+    }
+  }
+  stats.drawn++;
+  profileCounter("late frames", stats.late);
+  profileCounter("dropped frames", stats.dropped);
+
+  requested = false;
+  waiting = false;
+  started = true;
+  lastStart = time;
+}
+
+void endFrame() {
+  if (!requested && !animating())
+    return;
+  // Still moving, so the next frame was due an interval after this one
+  // began, however long this one took.
+  waiting = true;
+  waitingSince = lastStart;
+  schedule();
+}
+
+FrameStats frameStats() {
+  return stats;
+}
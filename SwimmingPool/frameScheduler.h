@@ -0,0 +1,46 @@
+#pragma once
+/*
+ * Drawing the window only when there is something new to show.
+ *
+ * Nothing is drawn until something calls requestFrame, or while the
+ * animation test given to startFrameScheduler says something is moving.
+ * Frames are then started from a GLUT timer no more often than the
+ * target rate, each on the deadline one frame interval after the last
+ * began, so a burst of input makes one frame rather than one per event
+ * (the input handlers only record the input, and the frame applies it)
+ * and nothing is drawn at all while the scene is still. At a rate of 0
+ * frames are started as soon as they are wanted and the buffer swap,
+ * with vsync, paces them.
+ *
+ * A frame that starts more than a quarter of an interval after its
+ * deadline is late, and each whole interval it missed is a dropped
+ * frame. The counts go to the profiler and are printed on exit.
+ */
+
+/*
+ * Start scheduling frames for the current window at framesPerSecond, with
+ * animating returning whether frames are needed regardless of requests.
+ */
+void startFrameScheduler(double framesPerSecond, bool (*animating)());
+
+/*
+ * Draw a frame at the next deadline. Call it too when something starts
+ * moving, as the animation test is only asked after each frame.
+ */
+void requestFrame();
+
+/*
+ * Bracket drawing a frame, in the display callback: beginFrame keeps the
+ * statistics, endFrame starts waiting for the next frame if one is
+ * needed.
+ */
+void beginFrame();
+void endFrame();
+
+struct FrameStats {
+  long long drawn;
+  long long late;
+  long long dropped;
+};
+
+FrameStats frameStats();
@@ -0,0 +1,55 @@
+/*
+ * OpenGL entry point loading. See glFunctions.h.
+ */
+#include <cstring>
+#include <iostream>
+#include "glFunctions.h"
+
+using namespace std;
+
+#ifdef _WIN32
+
+#define GL_FUNCTION(ret, name, params) name##_t name = NULL;
+GL_FUNCTIONS
+GL_OPTIONAL_FUNCTIONS
+#undef GL_FUNCTION
+
+bool loadGLFunctions() {
+  bool found = true;
+#define GL_FUNCTION(ret, name, params) \
+  name = (name##_t) wglGetProcAddress(#name); \
+  if (name == NULL) { \
+    cerr << "OpenGL function " #name " is not available." << endl; \
+    found = false; \
+  }
+  GL_FUNCTIONS
+#undef GL_FUNCTION
+#define GL_FUNCTION(ret, name, params) name = (name##_t) wglGetProcAddress(#name);
+  GL_OPTIONAL_FUNCTIONS
+#undef GL_FUNCTION
+  return found;
+}
+
+#else
+
+bool loadGLFunctions() {
+  return true;
+}
+
+#endif // _WIN32
+
+bool hasGLExtension(const char *name) {
+  const char *extensions = (const char *) glGetString(GL_EXTENSIONS);
+  if (extensions == NULL)
+    return false;
+
+  // Match whole names only, not names the one wanted is a prefix of.
+  size_t length = strlen(name);
+  for (const char *found = strstr(extensions, name); found != NULL; found = strstr(found + 1, name)) {
+    bool starts = found == extensions || found[-1] == ' ';
+    bool ends = found[length] == ' ' || found[length] == '\0';
+    if (starts && ends)
+      return true;
+  }
+  return false;
+}
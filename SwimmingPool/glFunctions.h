@@ -0,0 +1,172 @@
+#pragma once
+/*
+ * Access to the OpenGL entry points and constants newer than OpenGL 1.1.
+ *
+ * Windows' opengl32.dll only exports OpenGL 1.1, so there the newer
+ * functions are function pointers that loadGLFunctions() looks up with
+ * wglGetProcAddress, and the constants are defined here. Elsewhere the
+ * GL library exports everything directly and glext.h declares it.
+ *
+ * Include this instead of GL/gl.h in any file that uses these functions.
+ */
+#include "platform.h"
+
+#ifndef _WIN32
+#define GL_GLEXT_PROTOTYPES
+#endif
+#include "GL/gl.h"
+
+#ifdef _WIN32
+
+#include <cstddef>
+
+typedef ptrdiff_t GLsizeiptr;
+typedef ptrdiff_t GLintptr;
+typedef char GLchar;
+typedef __int64 GLint64;
+typedef unsigned __int64 GLuint64;
+typedef struct __GLsync *GLsync;
+
+#define GL_MAP_WRITE_BIT                  0x0002
+#define GL_MAP_INVALIDATE_RANGE_BIT       0x0004
+#define GL_MAP_UNSYNCHRONIZED_BIT         0x0020
+#define GL_MAP_PERSISTENT_BIT             0x0040
+#define GL_MAP_COHERENT_BIT               0x0080
+#define GL_SYNC_FLUSH_COMMANDS_BIT        0x0001
+#define GL_TEXTURE_BASE_LEVEL             0x813C
+#define GL_TEXTURE_MAX_LEVEL              0x813D
+#define GL_DEPTH_COMPONENT24              0x81A6
+#define GL_R32UI                          0x8236
+#define GL_RG32UI                         0x823C
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT   0x83F0
+#define GL_TEXTURE0                       0x84C0
+#define GL_COMBINE                        0x8570
+#define GL_COMBINE_RGB                    0x8571
+#define GL_COMBINE_ALPHA                  0x8572
+#define GL_CONSTANT                       0x8576
+#define GL_SOURCE0_RGB                    0x8580
+#define GL_SOURCE0_ALPHA                  0x8588
+#define GL_OPERAND0_RGB                   0x8590
+#define GL_OPERAND0_ALPHA                 0x8598
+#define GL_RGBA32F                        0x8814
+#define GL_QUERY_RESULT                   0x8866
+#define GL_QUERY_RESULT_AVAILABLE         0x8867
+#define GL_ARRAY_BUFFER                   0x8892
+#define GL_ELEMENT_ARRAY_BUFFER           0x8893
+#define GL_STREAM_DRAW                    0x88E0
+#define GL_PIXEL_UNPACK_BUFFER            0x88EC
+#define GL_STATIC_DRAW                    0x88E4
+#define GL_DYNAMIC_DRAW                   0x88E8
+#define GL_SAMPLES_PASSED                 0x8914
+#define GL_UNIFORM_BUFFER                 0x8A11
+#define GL_FRAGMENT_SHADER                0x8B30
+#define GL_VERTEX_SHADER                  0x8B31
+#define GL_COMPILE_STATUS                 0x8B81
+#define GL_LINK_STATUS                    0x8B82
+#define GL_INFO_LOG_LENGTH                0x8B84
+#define GL_TEXTURE_BUFFER                 0x8C2A
+#define GL_FRAMEBUFFER_BINDING            0x8CA6
+#define GL_READ_FRAMEBUFFER               0x8CA8
+#define GL_DRAW_FRAMEBUFFER               0x8CA9
+#define GL_FRAMEBUFFER_COMPLETE           0x8CD5
+#define GL_COLOR_ATTACHMENT0              0x8CE0
+#define GL_COLOR_ATTACHMENT1              0x8CE1
+#define GL_DEPTH_ATTACHMENT               0x8D00
+#define GL_FRAMEBUFFER                    0x8D40
+#define GL_RENDERBUFFER                   0x8D41
+#define GL_TIMESTAMP                      0x8E28
+#define GL_SYNC_GPU_COMMANDS_COMPLETE     0x9117
+#define GL_TIMEOUT_EXPIRED                0x911B
+#define GL_WAIT_FAILED                    0x911D
+
+/*
+ * Every function loadGLFunctions() looks up, as
+ * GL_FUNCTION(return type, name, parameter list).
+ */
+#define GL_FUNCTIONS \
+  GL_FUNCTION(void, glGenBuffers, (GLsizei n, GLuint *buffers)) \
+  GL_FUNCTION(void, glDeleteBuffers, (GLsizei n, const GLuint *buffers)) \
+  GL_FUNCTION(void, glBindBuffer, (GLenum target, GLuint buffer)) \
+  GL_FUNCTION(void, glBufferData, (GLenum target, GLsizeiptr size, const void *data, GLenum usage)) \
+  GL_FUNCTION(void, glBufferSubData, (GLenum target, GLintptr offset, GLsizeiptr size, const void *data)) \
+  GL_FUNCTION(void *, glMapBufferRange, (GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access)) \
+  GL_FUNCTION(GLboolean, glUnmapBuffer, (GLenum target)) \
+  GL_FUNCTION(GLsync, glFenceSync, (GLenum condition, GLbitfield flags)) \
+  GL_FUNCTION(GLenum, glClientWaitSync, (GLsync sync, GLbitfield flags, GLuint64 timeout)) \
+  GL_FUNCTION(void, glDeleteSync, (GLsync sync)) \
+  GL_FUNCTION(void, glCompressedTexImage2D, (GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLint border, GLsizei imageSize, const void *data)) \
+  GL_FUNCTION(void, glCompressedTexSubImage2D, (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLsizei imageSize, const void *data)) \
+  GL_FUNCTION(void, glActiveTexture, (GLenum texture)) \
+  GL_FUNCTION(void, glTexBuffer, (GLenum target, GLenum internalformat, GLuint buffer)) \
+  GL_FUNCTION(void, glGenFramebuffers, (GLsizei n, GLuint *framebuffers)) \
+  GL_FUNCTION(void, glBindFramebuffer, (GLenum target, GLuint framebuffer)) \
+  GL_FUNCTION(void, glFramebufferRenderbuffer, (GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer)) \
+  GL_FUNCTION(void, glFramebufferTexture2D, (GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level)) \
+  GL_FUNCTION(GLenum, glCheckFramebufferStatus, (GLenum target)) \
+  GL_FUNCTION(void, glBlitFramebuffer, (GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter)) \
+  GL_FUNCTION(void, glGenRenderbuffers, (GLsizei n, GLuint *renderbuffers)) \
+  GL_FUNCTION(void, glBindRenderbuffer, (GLenum target, GLuint renderbuffer)) \
+  GL_FUNCTION(void, glRenderbufferStorage, (GLenum target, GLenum internalformat, GLsizei width, GLsizei height)) \
+  GL_FUNCTION(void, glGenQueries, (GLsizei n, GLuint *ids)) \
+  GL_FUNCTION(void, glBeginQuery, (GLenum target, GLuint id)) \
+  GL_FUNCTION(void, glEndQuery, (GLenum target)) \
+  GL_FUNCTION(void, glQueryCounter, (GLuint id, GLenum target)) \
+  GL_FUNCTION(void, glGetQueryObjectiv, (GLuint id, GLenum pname, GLint *params)) \
+  GL_FUNCTION(void, glGetQueryObjectui64v, (GLuint id, GLenum pname, GLuint64 *params)) \
+  GL_FUNCTION(void, glGetInteger64v, (GLenum pname, GLint64 *data)) \
+  GL_FUNCTION(void, glGenVertexArrays, (GLsizei n, GLuint *arrays)) \
+  GL_FUNCTION(void, glDeleteVertexArrays, (GLsizei n, const GLuint *arrays)) \
+  GL_FUNCTION(void, glBindVertexArray, (GLuint array)) \
+  GL_FUNCTION(void, glEnableVertexAttribArray, (GLuint index)) \
+  GL_FUNCTION(void, glVertexAttribPointer, (GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pointer)) \
+  GL_FUNCTION(void, glVertexAttribDivisor, (GLuint index, GLuint divisor)) \
+  GL_FUNCTION(void, glDrawElementsInstanced, (GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instancecount)) \
+  GL_FUNCTION(GLuint, glCreateShader, (GLenum type)) \
+  GL_FUNCTION(void, glDeleteShader, (GLuint shader)) \
+  GL_FUNCTION(void, glShaderSource, (GLuint shader, GLsizei count, const GLchar *const *string, const GLint *length)) \
+  GL_FUNCTION(void, glCompileShader, (GLuint shader)) \
+  GL_FUNCTION(void, glGetShaderiv, (GLuint shader, GLenum pname, GLint *params)) \
+  GL_FUNCTION(void, glGetShaderInfoLog, (GLuint shader, GLsizei bufSize, GLsizei *length, GLchar *infoLog)) \
+  GL_FUNCTION(GLuint, glCreateProgram, (void)) \
+  GL_FUNCTION(void, glAttachShader, (GLuint program, GLuint shader)) \
+  GL_FUNCTION(void, glLinkProgram, (GLuint program)) \
+  GL_FUNCTION(void, glGetProgramiv, (GLuint program, GLenum pname, GLint *params)) \
+  GL_FUNCTION(void, glGetProgramInfoLog, (GLuint program, GLsizei bufSize, GLsizei *length, GLchar *infoLog)) \
+  GL_FUNCTION(void, glUseProgram, (GLuint program)) \
+  GL_FUNCTION(GLint, glGetUniformLocation, (GLuint program, const GLchar *name)) \
+  GL_FUNCTION(void, glUniform1i, (GLint location, GLint v0)) \
+  GL_FUNCTION(GLuint, glGetUniformBlockIndex, (GLuint program, const GLchar *uniformBlockName)) \
+  GL_FUNCTION(void, glUniformBlockBinding, (GLuint program, GLuint uniformBlockIndex, GLuint uniformBlockBinding)) \
+  GL_FUNCTION(void, glBindBufferBase, (GLenum target, GLuint index, GLuint buffer))
+
+/*
+ * Functions that may be missing, as above. Check for the extension that
+ * provides one before calling it.
+ */
+#define GL_OPTIONAL_FUNCTIONS \
+  GL_FUNCTION(void, glBufferStorage, (GLenum target, GLsizeiptr size, const void *data, GLbitfield flags))
+
+#define GL_FUNCTION(ret, name, params) \
+  typedef ret (APIENTRY *name##_t) params; \
+  extern name##_t name;
+GL_FUNCTIONS
+GL_OPTIONAL_FUNCTIONS
+#undef GL_FUNCTION
+
+#else
+
+#include "GL/glext.h"
+
+#endif // _WIN32
+
+/*
+ * Look up the entry points above. Must be called with a current context.
+ * Returns false, after reporting which function is missing, if the
+ * driver does not provide one of them.
+ */
+bool loadGLFunctions();
+
+/*
+ * Whether the current context supports the named extension.
+ */
+bool hasGLExtension(const char *name);
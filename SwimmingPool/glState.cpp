@@ -0,0 +1,110 @@
+/*
+ * The GL state shadow. See glState.h.
+ */
+#include <algorithm>
+#include <vector>
+#include "glState.h"
+
+using namespace std;
+
+enum Known { Unknown, Off, On };
+
+// Every capability enabled or disabled so far. There are only a dozen,
+// so a list is quicker to search than anything cleverer.
+static vector<pair<GLenum, Known> > capabilities;
+
+static vector<pair<GLenum, GLuint> > textures;
+
+static bool colorKnown = false;
+static GLfloat color[4];
+static bool blendKnown = false;
+static GLenum blendSource, blendDestination;
+
+static GLStateCounts counts = {0, 0};
+
+/*
+ * Count a call, and return whether it needs making.
+ */
+static bool needed(bool redundant) {
+  if (redundant)
+    counts.elided++;
+  else
+    counts.issued++;
+  return !redundant;
+}
+
+static Known *capability(GLenum cap) {
+  for (size_t i = 0; i < capabilities.size(); i++) {
+    if (capabilities[i].first == cap)
+      return &capabilities[i].second;
+  }
+  capabilities.push_back(make_pair(cap, Unknown));
+  return &capabilities.back().second;
+}
+
+void cachedSetEnabled(GLenum cap, bool enabled) {
+  Known *state = capability(cap);
+  Known wanted = enabled ? On : Off;
+  if (!needed(*state == wanted))
+    return;
+
+  if (enabled)
+    glEnable(cap);
+  else
+    glDisable(cap);
+  *state = wanted;
+}
+
+void cachedEnable(GLenum cap) {
+  cachedSetEnabled(cap, true);
+}
+
+void cachedDisable(GLenum cap) {
+  cachedSetEnabled(cap, false);
+}
+
+void cachedBindTexture(GLenum target, GLuint texture) {
+  for (size_t i = 0; i < textures.size(); i++) {
+    if (textures[i].first == target) {
+      if (needed(textures[i].second == texture)) {
+        glBindTexture(target, texture);
+        textures[i].second = texture;
+      }
+      return;
+    }
+  }
+  needed(false);
+  glBindTexture(target, texture);
+  textures.push_back(make_pair(target, texture));
+}
+
+void cachedColor4fv(const GLfloat *c) {
+  if (!needed(colorKnown && equal(c, c + 4, color)))
+    return;
+  glColor4fv(c);
+  colorKnown = true;
+  copy(c, c + 4, color);
+}
+
+void cachedColor4f(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) {
+  GLfloat c[4] = {red, green, blue, alpha};
+  cachedColor4fv(c);
+}
+
+void cachedBlendFunc(GLenum source, GLenum destination) {
+  if (!needed(blendKnown && blendSource == source && blendDestination == destination))
+    return;
+  glBlendFunc(source, destination);
+  blendKnown = true;
+  blendSource = source;
+  blendDestination = destination;
+}
+
+GLStateCounts glStateCounts() {
+  return counts;
+}
+
+void resetGLStateCounts() {
+  counts.issued = 0;
+  counts.elided = 0;
+}
@@ -0,0 +1,36 @@
+#pragma once
+/*
+ * A shadow of the OpenGL state the scene changes while drawing.
+ *
+ * Each function below remembers the value it last gave GL and skips the
+ * GL call when asked for the same value again, counting the calls made
+ * and skipped. Every value starts unknown, so the first call of each
+ * reaches GL. The shadow is only right while nothing else changes this
+ * state, so set enables, the bound texture, the current color and the
+ * blend function through here, and only from the thread with the
+ * context.
+ */
+#include "glFunctions.h"
+
+void cachedEnable(GLenum cap);
+void cachedDisable(GLenum cap);
+void cachedSetEnabled(GLenum cap, bool enabled);
+
+void cachedBindTexture(GLenum target, GLuint texture);
+
+void cachedColor4f(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
+void cachedColor4fv(const GLfloat *color);
+
+void cachedBlendFunc(GLenum source, GLenum destination);
+
+/*
+ * The calls made to GL and the calls skipped as redundant since the
+ * last resetGLStateCounts.
+ */
+struct GLStateCounts {
+  int issued;
+  int elided;
+};
+
+GLStateCounts glStateCounts();
+void resetGLStateCounts();
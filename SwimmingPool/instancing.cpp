@@ -0,0 +1,231 @@
+/*
+ * Hardware instanced drawing of repeated objects. See instancing.h.
+ */
+#include <algorithm>
+#include "instancing.h"
+#include "depthSort.h"
+#include "sceneShader.h"
+
+using namespace std;
+
+void addInstance(InstanceBatch *batch, SceneGraph *scene, int placement, const Model &model) {
+  for (const MeshPart &part : model.parts) {
+    InstanceGroup *group = NULL;
+    for (InstanceGroup &g : batch->groups) {
+      if (g.mesh == part.mesh && g.material == part.material) {
+        group = &g;
+        break;
+      }
+    }
+    if (group == NULL) {
+      batch->groups.push_back(InstanceGroup());
+      group = &batch->groups.back();
+      group->mesh = part.mesh;
+      group->material = part.material;
+    }
+
+    // The matrix is filled in from the node's world matrix on upload.
+    group->nodes.push_back(scene->addNode(placement, part.transform));
+    group->instances.insert(group->instances.end(), 16, 0.0f);
+    group->instances.insert(group->instances.end(), part.color, part.color + 4);
+  }
+}
+
+/*
+ * Copy the world matrix of instance i of group into its instance data.
+ */
+static void copyInstanceMatrix(InstanceGroup *group, int i, const SceneGraph &scene) {
+  const matrix4 &world = scene.world(group->nodes[i]);
+  copy(world.m, world.m + 16, group->instances.begin() + i * InstanceGroup::INSTANCE_FLOATS);
+}
+
+/*
+ * Put the world bounding box of every instance in the batch's hierarchy.
+ */
+static void buildInstanceBounds(InstanceBatch *batch, const SceneGraph &scene) {
+  vector<BoundingBox> bounds;
+  for (InstanceGroup &group : batch->groups) {
+    group.firstInstance = (int) bounds.size();
+    for (int node : group.nodes)
+      bounds.push_back(group.mesh->bounds.transform(scene.world(node)));
+  }
+  buildBVH(&batch->bvh, bounds);
+}
+
+/*
+ * Fill the group's instance buffer with its visible instances, in their
+ * order, each in the region of the level it is drawn with.
+ */
+static void uploadVisibleInstances(InstanceGroup *group, const vector<int> &levels) {
+  const size_t instanceSize = InstanceGroup::INSTANCE_FLOATS * sizeof(float);
+  vector<float> packed;
+  packed.reserve(group->instances.size());
+
+  glBindBuffer(GL_ARRAY_BUFFER, group->instanceBuffer);
+  for (size_t level = 0; level < group->vaos.size(); level++) {
+    packed.clear();
+    for (int i : group->order) {
+      if (levels[group->firstInstance + i] == (int) level) {
+        vector<float>::const_iterator data = group->instances.begin() + i * InstanceGroup::INSTANCE_FLOATS;
+        packed.insert(packed.end(), data, data + InstanceGroup::INSTANCE_FLOATS);
+      }
+    }
+
+    group->drawCounts[level] = (GLsizei) (packed.size() / InstanceGroup::INSTANCE_FLOATS);
+    glBufferSubData(GL_ARRAY_BUFFER, level * group->instanceCount * instanceSize,
+                    packed.size() * sizeof(float), packed.data());
+  }
+}
+
+/*
+ * Make the vertex array object drawing the group's instances at level
+ * of detail level, whose region of the instance buffer starts at
+ * instance level * instanceCount.
+ */
+static GLuint makeInstanceArray(const InstanceGroup &group, int level) {
+  const GLsizei vertexStride = MeshData::FLOATS_PER_VERTEX * sizeof(float);
+  const GLsizei instanceStride = InstanceGroup::INSTANCE_FLOATS * sizeof(float);
+  const size_t regionStart = (size_t) level * group.instanceCount * instanceStride;
+  GLuint vao;
+
+  glGenVertexArrays(1, &vao);
+  glBindVertexArray(vao);
+
+  // The mesh's own vertices and indices.
+  glBindBuffer(GL_ARRAY_BUFFER, group.mesh->vertexBuffer);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, group.mesh->indexBuffer);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glVertexPointer(3, GL_FLOAT, vertexStride, (const void *) 0);
+  glEnableClientState(GL_NORMAL_ARRAY);
+  glNormalPointer(GL_FLOAT, vertexStride, (const void *) (3 * sizeof(float)));
+
+  // One matrix and color per instance. A mat4 attribute takes four
+  // consecutive locations, one per column.
+  glBindBuffer(GL_ARRAY_BUFFER, group.instanceBuffer);
+  for (int column = 0; column < 4; column++) {
+    GLuint location = SCENE_INSTANCE_MATRIX + column;
+    glEnableVertexAttribArray(location);
+    glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, instanceStride,
+                          (const void *) (regionStart + column * 4 * sizeof(float)));
+    glVertexAttribDivisor(location, 1);
+  }
+  glEnableVertexAttribArray(SCENE_INSTANCE_COLOR);
+  glVertexAttribPointer(SCENE_INSTANCE_COLOR, 4, GL_FLOAT, GL_FALSE, instanceStride,
+                        (const void *) (regionStart + 16 * sizeof(float)));
+  glVertexAttribDivisor(SCENE_INSTANCE_COLOR, 1);
+
+  glBindVertexArray(0);
+  return vao;
+}
+
+void uploadInstances(InstanceBatch *batch, const SceneGraph &scene) {
+  buildInstanceBounds(batch, scene);
+
+  // Everything is visible at the finest level until the first cullInstances.
+  batch->levels.assign(batch->bvh.itemBounds.size(), 0);
+
+  MaterialFunc material = NULL;
+  for (InstanceGroup &group : batch->groups) {
+    // A group without a material is drawn with whichever the group
+    // before it left in use.
+    if (group.material != NULL)
+      material = group.material;
+    group.drawnMaterial = material;
+
+    group.instanceCount = (GLsizei) group.nodes.size();
+    group.order.clear();
+    for (int i = 0; i < group.instanceCount; i++) {
+      copyInstanceMatrix(&group, i, scene);
+      group.order.push_back(i);
+    }
+
+    size_t levelCount = group.mesh->levels.size();
+    glGenBuffers(1, &group.instanceBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, group.instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, levelCount * group.instances.size() * sizeof(float), NULL, GL_DYNAMIC_DRAW);
+
+    group.drawCounts.assign(levelCount, 0);
+    group.nearestKeys.assign(levelCount, 0);
+    for (size_t level = 0; level < levelCount; level++)
+      group.vaos.push_back(makeInstanceArray(group, (int) level));
+    uploadVisibleInstances(&group, batch->levels);
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void updateInstances(InstanceBatch *batch, const SceneGraph &scene) {
+  for (InstanceGroup &group : batch->groups) {
+    bool moved = false;
+    for (int i = 0; i < group.instanceCount; i++) {
+      if (scene.moved(group.nodes[i])) {
+        copyInstanceMatrix(&group, i, scene);
+        moved = true;
+      }
+    }
+    if (moved)
+      uploadVisibleInstances(&group, batch->levels);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  buildInstanceBounds(batch, scene);
+}
+
+int cullInstances(InstanceBatch *batch, const Frustum &frustum) {
+  vector<char> visible;
+  int count = cullBVH(batch->bvh, frustum, &visible);
+  vector<float> radii;
+  projectedRadii(frustum, batch->bvh.itemBounds, &radii);
+
+  // Instances out of view keep their level, ready for when they return.
+  vector<int> levels = batch->levels;
+  vector<DepthItem> items;
+  vector<int> order;
+  for (InstanceGroup &group : batch->groups) {
+    items.clear();
+    for (int i = 0; i < group.instanceCount; i++) {
+      int instance = group.firstInstance + i;
+      if (visible[instance]) {
+        const BoundingBox &bounds = batch->bvh.itemBounds[instance];
+        levels[instance] = selectMeshLevel(*group.mesh, radii[instance], levels[instance]);
+        DepthItem item = {depthKey(frustum.modelview, bounds, frustum.farDistance), i};
+        items.push_back(item);
+      }
+    }
+    sortByDepth(&items);
+
+    order.clear();
+    group.nearestKeys.assign(group.vaos.size(), ~0u);
+    for (const DepthItem &item : items) {
+      order.push_back(item.index);
+      unsigned &nearest = group.nearestKeys[levels[group.firstInstance + item.index]];
+      nearest = min(nearest, item.key);
+    }
+
+    // Only groups whose visible instances, their order or their levels
+    // changed need uploading.
+    int first = group.firstInstance;
+    int last = first + group.instanceCount;
+    if (order != group.order || !equal(levels.begin() + first, levels.begin() + last, batch->levels.begin() + first)) {
+      group.order.swap(order);
+      uploadVisibleInstances(&group, levels);
+    }
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  batch->levels.swap(levels);
+  return count;
+}
+
+void drawInstanceLevel(const InstanceGroup &group, int level) {
+  useSceneShader(SceneInstanced);
+  if (group.drawnMaterial != NULL)
+    group.drawnMaterial();
+  else
+    useSceneMaterial(DefaultMaterial);
+
+  const MeshLevel &meshLevel = group.mesh->levels[level];
+  glBindVertexArray(group.vaos[level]);
+  glDrawElementsInstanced(GL_TRIANGLES, meshLevel.indexCount, GL_UNSIGNED_INT,
+                          (const void *) (meshLevel.firstIndex * sizeof(GLuint)), group.drawCounts[level]);
+}
@@ -0,0 +1,95 @@
+#pragma once
+/*
+ * Hardware instanced drawing of repeated objects.
+ *
+ * Models placed any number of times are merged into an InstanceBatch.
+ * Every part that shares a mesh and material, across all the placed
+ * models, becomes one instance of a single group, and each group is drawn
+ * with one glDrawElementsInstanced. A per-instance buffer holds the part's
+ * model matrix and color.
+ *
+ * Each instance is a node in a SceneGraph, a child of the node the model
+ * was placed at, and its matrix is that node's world matrix. After the
+ * graph is updated, updateInstances rewrites the matrices of the nodes
+ * that moved.
+ *
+ * Every instance has a world space bounding box, and the boxes of the
+ * whole batch are kept in a bounding volume hierarchy. cullInstances
+ * finds the instances inside the view frustum and packs only those into
+ * the instance buffers, nearest first (see depthSort.h), so instances off
+ * screen are never drawn and those in front are drawn before what they
+ * hide. It also picks the level of detail of each visible instance from
+ * its size on screen; the instance buffer has a region per level of the
+ * mesh, and each level is drawn with its own call.
+ *
+ * The instances are drawn with the instanced scene shader (see
+ * sceneShader.h), the per instance color standing in for the color.
+ */
+#include <vector>
+#include "model.h"
+#include "sceneGraph.h"
+#include "culling.h"
+
+/*
+ * All the instances of one mesh drawn with one material.
+ * Each instance is INSTANCE_FLOATS floats: a column major model
+ * matrix followed by an RGBA color.
+ */
+struct InstanceGroup {
+  static const int INSTANCE_FLOATS = 20;
+
+  const Mesh *mesh;
+  MaterialFunc material;
+  MaterialFunc drawnMaterial = NULL;  // Its own, or the one of the group before it if
+                                      // it has none, or NULL for the default.
+  std::vector<float> instances;
+  std::vector<int> nodes;             // The scene node of each instance.
+
+  std::vector<GLuint> vaos;           // One per level of detail of the mesh.
+  GLuint instanceBuffer = 0;
+  GLsizei instanceCount = 0;
+  std::vector<GLsizei> drawCounts;    // Visible instances drawn with each level.
+  std::vector<unsigned> nearestKeys;  // The depth key of the nearest of them.
+  std::vector<int> order;             // The visible instances, nearest first.
+  int firstInstance = 0;              // Index of the group's first instance in the batch.
+};
+
+struct InstanceBatch {
+  std::vector<InstanceGroup> groups;
+
+  // Every instance of every group, group by group.
+  BoundingVolumeHierarchy bvh;
+  std::vector<int> levels;            // Level of detail last drawn with.
+};
+
+/*
+ * Add one placement of model to the batch, at node placement of scene.
+ * Each part of the model becomes a child node of placement.
+ */
+void addInstance(InstanceBatch *batch, SceneGraph *scene, int placement, const Model &model);
+
+/*
+ * Upload the instance data of every group and set up its vertex array.
+ * Call once after all the instances have been added and the scene's
+ * world matrices updated.
+ */
+void uploadInstances(InstanceBatch *batch, const SceneGraph &scene);
+
+/*
+ * Copy the world matrices of the instances whose nodes moved in the
+ * scene's last update, and re-upload the groups they belong to.
+ */
+void updateInstances(InstanceBatch *batch, const SceneGraph &scene);
+
+/*
+ * Keep only the instances at least partly inside frustum in the instance
+ * buffers, nearest first, each at the level of detail for its size on
+ * screen. Returns the number of instances visible.
+ */
+int cullInstances(InstanceBatch *batch, const Frustum &frustum);
+
+/*
+ * Draw the visible instances of group at level of detail level with the
+ * current modelview matrix and the group's material, which stays in use.
+ */
+void drawInstanceLevel(const InstanceGroup &group, int level);
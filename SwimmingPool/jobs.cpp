@@ -0,0 +1,228 @@
+/*
+ * The job system. See jobs.h.
+ */
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "jobs.h"
+
+using namespace std;
+
+struct Job {
+  function<void()> work;
+  atomic<int> *pending;
+};
+
+/*
+ * A fixed size Chase-Lev deque. Only its owner calls push and pop;
+ * anyone may steal.
+ */
+class JobDeque {
+public:
+  static const int64_t CAPACITY = 4096;
+
+  JobDeque() : top(0), bottom(0) {
+    for (int64_t i = 0; i < CAPACITY; i++)
+      items[i] = NULL;
+  }
+
+  // Returns false if the deque is full.
+  bool push(Job *job) {
+    int64_t b = bottom.load(memory_order_relaxed);
+    int64_t t = top.load(memory_order_acquire);
+    if (b - t >= CAPACITY)
+      return false;
+    items[b % CAPACITY].store(job, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    bottom.store(b + 1, memory_order_relaxed);
+    return true;
+  }
+
+  // The job pushed most recently, or NULL.
+  Job *pop() {
+    int64_t b = bottom.load(memory_order_relaxed) - 1;
+    bottom.store(b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t t = top.load(memory_order_relaxed);
+    if (t > b) {
+      bottom.store(b + 1, memory_order_relaxed);
+      return NULL;
+    }
+
+    Job *job = items[b % CAPACITY].load(memory_order_relaxed);
+    if (t == b) {
+      // The last job: race any thief for it.
+      if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+        job = NULL;
+      bottom.store(b + 1, memory_order_relaxed);
+    }
+    return job;
+  }
+
+  // The job pushed longest ago, or NULL if there is none or another
+  // thread took it first.
+  Job *steal() {
+    int64_t t = top.load(memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = bottom.load(memory_order_acquire);
+    if (t >= b)
+      return NULL;
+
+    Job *job = items[t % CAPACITY].load(memory_order_relaxed);
+    if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+      return NULL;
+    return job;
+  }
+
+private:
+  atomic<int64_t> top;
+  atomic<int64_t> bottom;
+  atomic<Job *> items[CAPACITY];
+};
+
+// One deque per member of the pool; member 0 is the thread that called
+// startJobs.
+static vector<JobDeque *> deques;
+static vector<thread> workers;
+static thread_local int member = -1;
+
+// Idle workers sleep until there are jobs queued.
+static atomic<int> queued(0);
+static atomic<bool> quitting(false);
+static mutex sleepLock;
+static condition_variable wake;
+
+static void runJob(Job *job) {
+  queued--;
+  job->work();
+  (*job->pending)--;
+  delete job;
+}
+
+/*
+ * Take a job from this member's own deque, or steal one.
+ */
+static Job *findJob() {
+  Job *job = deques[member]->pop();
+  if (job != NULL)
+    return job;
+
+  int count = (int) deques.size();
+  for (int i = 1; i < count; i++) {
+    job = deques[(member + i) % count]->steal();
+    if (job != NULL)
+      return job;
+  }
+  return NULL;
+}
+
+static void work(int index) {
+  member = index;
+  for (;;) {
+    Job *job = findJob();
+    if (job != NULL) {
+      runJob(job);
+      continue;
+    }
+
+    unique_lock<mutex> lock(sleepLock);
+    wake.wait(lock, [] { return queued > 0 || quitting; });
+    if (quitting && queued == 0)
+      return;
+  }
+}
+
+void startJobs(int threads) {
+  if (threads <= 0)
+    threads = (int) thread::hardware_concurrency();
+  threads = max(threads, 2);
+
+  member = 0;
+  quitting = false;
+  for (int i = 0; i < threads; i++)
+    deques.push_back(new JobDeque());
+  for (int i = 1; i < threads; i++)
+    workers.push_back(thread(work, i));
+}
+
+void stopJobs() {
+  {
+    lock_guard<mutex> lock(sleepLock);
+    quitting = true;
+  }
+  wake.notify_all();
+  for (size_t i = 0; i < workers.size(); i++)
+    workers[i].join();
+  workers.clear();
+
+  // Anything left is this thread's own.
+  while (Job *job = deques[0]->pop())
+    runJob(job);
+  for (size_t i = 0; i < deques.size(); i++)
+    delete deques[i];
+  deques.clear();
+  member = -1;
+}
+
+int jobThreads() {
+  return max((int) deques.size(), 1);
+}
+
+JobGroup::JobGroup() : pending(0) {
+}
+
+JobGroup::~JobGroup() {
+  wait();
+}
+
+void JobGroup::run(function<void()> work) {
+  if (member < 0) {
+    work();
+    return;
+  }
+
+  Job *job = new Job;
+  job->work = move(work);
+  job->pending = &pending;
+  pending++;
+  queued++;
+  if (!deques[member]->push(job)) {
+    runJob(job);
+    return;
+  }
+
+  // Taking the lock means a worker about to sleep either sees the job or
+  // is already waiting for this notification.
+  { lock_guard<mutex> lock(sleepLock); }
+  wake.notify_one();
+}
+
+void JobGroup::wait() {
+  while (pending > 0) {
+    Job *job = member >= 0 ? findJob() : NULL;
+    if (job != NULL)
+      runJob(job);
+    else
+      this_thread::yield();
+  }
+}
+
+void parallelFor(int count, int grain, const function<void(int first, int last)> &body) {
+  grain = max(grain, 1);
+  if (member < 0 || count <= grain) {
+    if (count > 0)
+      body(0, count);
+    return;
+  }
+
+  JobGroup group;
+  for (int first = grain; first < count; first += grain) {
+    int last = min(first + grain, count);
+    group.run([&body, first, last] { body(first, last); });
+  }
+  body(0, grain);
+  group.wait();
+}
@@ -0,0 +1,63 @@
+#pragma once
+/*
+ * A small work-stealing job system.
+ *
+ * startJobs() starts a pool of worker threads and makes the calling
+ * thread a member of it. Each member has its own deque of jobs: it pushes
+ * and pops jobs at one end without locking, and members with nothing to
+ * do steal from the other end of someone else's (a Chase-Lev deque). A
+ * member waiting for a group of jobs runs jobs itself until the group is
+ * done, so jobs may start and wait for jobs of their own.
+ *
+ * Threads outside the pool, and every thread before startJobs(), run jobs
+ * immediately instead, so code using jobs works unchanged without it.
+ */
+#include <atomic>
+#include <functional>
+
+/*
+ * Start threads - 1 workers (0 for one per core, and always at least one
+ * so jobs can run in the background). Call once, from the thread that
+ * will be the first member.
+ */
+void startJobs(int threads = 0);
+
+/*
+ * Finish the jobs queued and stop the workers. Call from the thread that
+ * called startJobs.
+ */
+void stopJobs();
+
+/*
+ * The number of threads in the pool, or 1 before startJobs.
+ */
+int jobThreads();
+
+/*
+ * Jobs that can be waited for together: run() forks, wait() joins.
+ */
+class JobGroup {
+public:
+  JobGroup();
+  ~JobGroup();
+
+  void run(std::function<void()> work);
+
+  // Run jobs until every job given to run() has finished.
+  void wait();
+
+  // Whether every job given to run() has finished, without waiting.
+  bool done() const { return pending == 0; }
+
+private:
+  JobGroup(const JobGroup &);
+  JobGroup &operator=(const JobGroup &);
+
+  std::atomic<int> pending;
+};
+
+/*
+ * Call body(first, last) over ranges covering 0 .. count - 1, as jobs of
+ * about grain indices each, and wait for them all.
+ */
+void parallelFor(int count, int grain, const std::function<void(int first, int last)> &body);
@@ -0,0 +1,267 @@
+/*
+ * Clustered forward lighting. See lightClusters.h.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "lightClusters.h"
+#include "jobs.h"
+#include "profiler.h"
+
+using namespace std;
+
+// The texels of a light: position and radius, color and the cosine of
+// the spot cutoff (-2 for a point light), spot direction and exponent.
+static const int LIGHT_FLOATS = 12;
+
+/*
+ * A light in eye coordinates, and the clusters it may reach.
+ */
+struct EyeLight {
+  vector3 position;
+  float radius;
+  int firstSlice, lastSlice;
+  int firstTile[2], lastTile[2];
+};
+
+void createLightClusters(LightClusters *clusters) {
+  glGenBuffers(3, clusters->buffers);
+  glGenTextures(3, clusters->textures);
+  const GLenum formats[3] = {GL_RG32UI, GL_R32UI, GL_RGBA32F};
+  const int units[3] = {CLUSTER_GRID_UNIT, CLUSTER_INDEX_UNIT, CLUSTER_LIGHT_UNIT};
+  for (int i = 0; i < 3; i++) {
+    glBindBuffer(GL_TEXTURE_BUFFER, clusters->buffers[i]);
+    glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+    glActiveTexture(GL_TEXTURE0 + units[i]);
+    glBindTexture(GL_TEXTURE_BUFFER, clusters->textures[i]);
+    glTexBuffer(GL_TEXTURE_BUFFER, formats[i], clusters->buffers[i]);
+  }
+  glActiveTexture(GL_TEXTURE0);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+  clusters->grid.assign(2 * CLUSTER_COUNT, 0);
+  clusters->sliceIndices.resize(CLUSTER_SLICES);
+}
+
+/*
+ * The distances from the eye of the near and far planes of a perspective
+ * projection.
+ */
+static void depthRange(const matrix4 &projection, float *nearDistance, float *farDistance) {
+  *nearDistance = projection.m[14] / (projection.m[10] - 1);
+  *farDistance = projection.m[14] / (projection.m[10] + 1);
+}
+
+/*
+ * The distance from the eye at which slice starts.
+ */
+static float sliceDistance(float nearDistance, float farDistance, int slice) {
+  return nearDistance * pow(farDistance / nearDistance, (float) slice / CLUSTER_SLICES);
+}
+
+/*
+ * Work out the mapping and the box of each cluster for a new projection
+ * or viewport.
+ */
+static void makeClusters(LightClusters *clusters) {
+  const matrix4 &p = clusters->projection;
+  const GLint *viewport = clusters->viewport;
+  float nearDistance, farDistance;
+  depthRange(p, &nearDistance, &farDistance);
+
+  ClusterMapping &mapping = clusters->mapping;
+  mapping.tileScale[0] = (float) CLUSTER_TILES / viewport[2];
+  mapping.tileScale[1] = (float) CLUSTER_TILES / viewport[3];
+  mapping.tileBias[0] = -viewport[0] * mapping.tileScale[0];
+  mapping.tileBias[1] = -viewport[1] * mapping.tileScale[1];
+  mapping.sliceScale = CLUSTER_SLICES / log(farDistance / nearDistance);
+  mapping.sliceBias = -log(nearDistance) * mapping.sliceScale;
+
+  // A point d from the eye at normalized device x is at eye
+  // x = d (x + p[8]) / p[0], and likewise for y.
+  clusters->bounds.resize(CLUSTER_COUNT);
+  for (int slice = 0; slice < CLUSTER_SLICES; slice++) {
+    float depths[2] = {sliceDistance(nearDistance, farDistance, slice),
+                       sliceDistance(nearDistance, farDistance, slice + 1)};
+    for (int y = 0; y < CLUSTER_TILES; y++) {
+      for (int x = 0; x < CLUSTER_TILES; x++) {
+        BoundingBox &box = clusters->bounds[(slice * CLUSTER_TILES + y) * CLUSTER_TILES + x];
+        box = BoundingBox();
+        for (float d : depths) {
+          for (int corner = 0; corner < 4; corner++) {
+            float ndcX = 2.0f * (x + corner % 2) / CLUSTER_TILES - 1;
+            float ndcY = 2.0f * (y + corner / 2) / CLUSTER_TILES - 1;
+            box.add(vector3(d * (ndcX + p.m[8]) / p.m[0], d * (ndcY + p.m[9]) / p.m[5], -d));
+          }
+        }
+      }
+    }
+  }
+}
+
+static bool sphereTouchesBox(const vector3 &center, float radius, const BoundingBox &box) {
+  float dx = max(max(box.min.x - center.x, center.x - box.max.x), 0.0f);
+  float dy = max(max(box.min.y - center.y, center.y - box.max.y), 0.0f);
+  float dz = max(max(box.min.z - center.z, center.z - box.max.z), 0.0f);
+  return dx * dx + dy * dy + dz * dz <= radius * radius;
+}
+
+/*
+ * The tile of a normalized device coordinate, within the grid.
+ */
+static int tileOf(float ndc) {
+  return min(max((int) floor((ndc + 1) * 0.5f * CLUSTER_TILES), 0), CLUSTER_TILES - 1);
+}
+
+/*
+ * Transform the lights into eye coordinates, leaving out those outside
+ * the depth range, and work out the slices and tiles each may reach.
+ */
+static void placeLights(LightClusters *clusters, const vector<ClusterLight> &lights,
+                        const matrix4 &modelview, vector<EyeLight> *eyeLights) {
+  const matrix4 &p = clusters->projection;
+  const ClusterMapping &mapping = clusters->mapping;
+  float nearDistance, farDistance;
+  depthRange(p, &nearDistance, &farDistance);
+
+  clusters->lights.clear();
+  eyeLights->clear();
+  vector3 origin = modelview.transformPoint(vector3(0, 0, 0));
+  for (const ClusterLight &light : lights) {
+    EyeLight eye;
+    eye.position = modelview.transformPoint(light.position);
+    eye.radius = light.radius;
+    float nearest = max(-eye.position.z - light.radius, nearDistance);
+    float farthest = -eye.position.z + light.radius;
+    if (farthest < nearDistance || nearest > farDistance)
+      continue;
+
+    eye.firstSlice = max((int) (log(nearest) * mapping.sliceScale + mapping.sliceBias), 0);
+    eye.lastSlice = min((int) (log(farthest) * mapping.sliceScale + mapping.sliceBias), CLUSTER_SLICES - 1);
+
+    // The tiles the box around the sphere covers, from its nearest and
+    // farthest corners, where a corner's device x is p[0] x / d - p[8].
+    float lows[2] = {eye.position.x - light.radius, eye.position.y - light.radius};
+    float highs[2] = {eye.position.x + light.radius, eye.position.y + light.radius};
+    float scales[2] = {p.m[0], p.m[5]};
+    float offsets[2] = {p.m[8], p.m[9]};
+    for (int axis = 0; axis < 2; axis++) {
+      float low = 1e30f, high = -1e30f;
+      for (float d : {nearest, farthest}) {
+        for (float v : {lows[axis], highs[axis]}) {
+          float ndc = scales[axis] * v / d - offsets[axis];
+          low = min(low, ndc);
+          high = max(high, ndc);
+        }
+      }
+      eye.firstTile[axis] = tileOf(low);
+      eye.lastTile[axis] = tileOf(high);
+    }
+    eyeLights->push_back(eye);
+
+    vector3 direction = modelview.transformPoint(light.spotDirection).subtract(origin).normalize();
+    bool spot = light.spotCutoff < 180.0f;
+    float texels[LIGHT_FLOATS] = {
+      eye.position.x, eye.position.y, eye.position.z, light.radius,
+      light.color[0], light.color[1], light.color[2],
+      spot ? (float) cos(light.spotCutoff * 3.1415926536 / 180.0) : -2.0f,
+      direction.x, direction.y, direction.z, light.spotExponent,
+    };
+    clusters->lights.insert(clusters->lights.end(), texels, texels + LIGHT_FLOATS);
+  }
+}
+
+/*
+ * Fill in the clusters of one slice, listing their lights in the slice's
+ * own index list with offsets from its start.
+ */
+static void binSlice(LightClusters *clusters, const vector<EyeLight> &eyeLights, int slice) {
+  vector<GLuint> &indices = clusters->sliceIndices[slice];
+  indices.clear();
+  GLuint *grid = &clusters->grid[2 * slice * CLUSTER_TILES * CLUSTER_TILES];
+  const BoundingBox *bounds = &clusters->bounds[slice * CLUSTER_TILES * CLUSTER_TILES];
+
+  // Count the lights of each cluster first, then place them.
+  int counts[CLUSTER_TILES * CLUSTER_TILES] = {};
+  vector<pair<int, GLuint> > hits;
+  for (size_t i = 0; i < eyeLights.size(); i++) {
+    const EyeLight &light = eyeLights[i];
+    if (slice < light.firstSlice || slice > light.lastSlice)
+      continue;
+    for (int y = light.firstTile[1]; y <= light.lastTile[1]; y++) {
+      for (int x = light.firstTile[0]; x <= light.lastTile[0]; x++) {
+        int cluster = y * CLUSTER_TILES + x;
+        if (sphereTouchesBox(light.position, light.radius, bounds[cluster])) {
+          hits.push_back(make_pair(cluster, (GLuint) i));
+          counts[cluster]++;
+        }
+      }
+    }
+  }
+
+  GLuint offset = 0;
+  for (int cluster = 0; cluster < CLUSTER_TILES * CLUSTER_TILES; cluster++) {
+    grid[2 * cluster] = offset;
+    grid[2 * cluster + 1] = counts[cluster];
+    offset += counts[cluster];
+  }
+  indices.resize(offset);
+  for (const pair<int, GLuint> &hit : hits)
+    indices[grid[2 * hit.first] + grid[2 * hit.first + 1] - counts[hit.first]--] = hit.second;
+}
+
+/*
+ * Upload the contents of a vector to one of the texture buffers.
+ */
+template <typename T>
+static void uploadBuffer(GLuint buffer, const vector<T> &data) {
+  glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+  // A buffer texture may not be empty, so keep at least one element.
+  glBufferData(GL_TEXTURE_BUFFER, max(data.size(), (size_t) 4) * sizeof(T), NULL, GL_STREAM_DRAW);
+  if (!data.empty())
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, data.size() * sizeof(T), data.data());
+}
+
+bool updateLightClusters(LightClusters *clusters, const vector<ClusterLight> &lights) {
+  ProfileScope scope("light clusters");
+
+  matrix4 projection, modelview;
+  GLint viewport[4];
+  glGetFloatv(GL_PROJECTION_MATRIX, projection.m);
+  glGetFloatv(GL_MODELVIEW_MATRIX, modelview.m);
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  bool changed = clusters->bounds.empty() ||
+                 memcmp(projection.m, clusters->projection.m, sizeof(projection.m)) != 0 ||
+                 memcmp(viewport, clusters->viewport, sizeof(viewport)) != 0;
+  if (changed) {
+    clusters->projection = projection;
+    copy(viewport, viewport + 4, clusters->viewport);
+    makeClusters(clusters);
+  }
+
+  vector<EyeLight> eyeLights;
+  placeLights(clusters, lights, modelview, &eyeLights);
+  parallelFor(CLUSTER_SLICES, 1, [&](int first, int last) {
+    for (int slice = first; slice < last; slice++)
+      binSlice(clusters, eyeLights, slice);
+  });
+
+  // Join the slices' index lists, moving each slice's offsets along.
+  clusters->indices.clear();
+  for (int slice = 0; slice < CLUSTER_SLICES; slice++) {
+    GLuint base = clusters->indices.size();
+    GLuint *grid = &clusters->grid[2 * slice * CLUSTER_TILES * CLUSTER_TILES];
+    for (int cluster = 0; cluster < CLUSTER_TILES * CLUSTER_TILES; cluster++)
+      grid[2 * cluster] += base;
+    const vector<GLuint> &indices = clusters->sliceIndices[slice];
+    clusters->indices.insert(clusters->indices.end(), indices.begin(), indices.end());
+  }
+  profileCounter("clustered lights", eyeLights.size());
+  profileCounter("cluster light indices", clusters->indices.size());
+
+  uploadBuffer(clusters->buffers[0], clusters->grid);
+  uploadBuffer(clusters->buffers[1], clusters->indices);
+  uploadBuffer(clusters->buffers[2], clusters->lights);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  return changed;
+}
@@ -0,0 +1,86 @@
+#pragma once
+/*
+ * Clustered forward lighting.
+ *
+ * The view frustum is cut into a grid of clusters: CLUSTER_TILES x
+ * CLUSTER_TILES tiles across the screen, each cut into CLUSTER_SLICES
+ * slices in depth, thinner near the eye and thicker far away. Every frame
+ * updateLightClusters finds the lights whose range reaches each cluster,
+ * a slice of clusters per job (see jobs.h), and uploads a list of light
+ * indices per cluster along with the lights in eye coordinates. The
+ * scene shader (see sceneShader.h) looks up the cluster of each fragment
+ * and lights it with just that cluster's lights, so a light costs
+ * something only where it reaches.
+ *
+ * The data lives in three texture buffers bound to the texture units
+ * below, which are kept for them.
+ */
+#include <vector>
+#include "glFunctions.h"
+#include "bounds.h"
+
+const int CLUSTER_TILES = 16;
+const int CLUSTER_SLICES = 24;
+const int CLUSTER_COUNT = CLUSTER_TILES * CLUSTER_TILES * CLUSTER_SLICES;
+
+// Where each cluster's lights start in the index list and how many
+// there are, the index list, and the lights.
+const int CLUSTER_GRID_UNIT = 1;
+const int CLUSTER_INDEX_UNIT = 2;
+const int CLUSTER_LIGHT_UNIT = 3;
+
+/*
+ * A point light, or a spot light if spotCutoff is under 180 degrees,
+ * in world coordinates. Its light fades out to nothing at radius.
+ */
+struct ClusterLight {
+  vector3 position;
+  float radius;
+  float color[3];
+  vector3 spotDirection;
+  float spotCutoff = 180.0f;          // In degrees, as for GL_SPOT_CUTOFF.
+  float spotExponent = 0.0f;
+};
+
+/*
+ * How the shader finds a fragment's cluster: tile = window coordinates
+ * * tileScale + tileBias, slice = log(-eye z) * sliceScale + sliceBias.
+ */
+struct ClusterMapping {
+  float tileScale[2];
+  float tileBias[2];
+  float sliceScale;
+  float sliceBias;
+};
+
+struct LightClusters {
+  GLuint buffers[3] = {0, 0, 0};      // Grid, indices and lights.
+  GLuint textures[3] = {0, 0, 0};
+
+  // The eye space box of every cluster, for the projection and viewport
+  // they were made for.
+  std::vector<BoundingBox> bounds;
+  matrix4 projection;
+  GLint viewport[4] = {0, 0, 0, 0};
+  ClusterMapping mapping;
+
+  // This frame's lights in eye coordinates, 3 RGBA texels each, and the
+  // offset and count of each cluster's indices.
+  std::vector<float> lights;
+  std::vector<GLuint> grid;
+  std::vector<GLuint> indices;
+  std::vector<std::vector<GLuint> > sliceIndices;
+};
+
+/*
+ * Create the buffers and bind them to their units.
+ * Call once with a current context.
+ */
+void createLightClusters(LightClusters *clusters);
+
+/*
+ * Bin lights into the clusters of the current projection and viewport,
+ * with the current modelview matrix as the camera, and upload them.
+ * Returns true when the mapping changed, for setSceneClusterMapping.
+ */
+bool updateLightClusters(LightClusters *clusters, const std::vector<ClusterLight> &lights);
@@ -0,0 +1,96 @@
+/*
+ * Memory mapped files. See mappedFile.h.
+ */
+#include "platform.h"
+#include "mappedFile.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile()
+  : bytes(NULL), length(0), file(INVALID_HANDLE_VALUE), mapping(NULL) {
+}
+
+bool MappedFile::open(const char *filename) {
+  close();
+
+  file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                     FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+    close();
+    return false;
+  }
+  length = (size_t) fileSize.QuadPart;
+
+  mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (mapping != NULL)
+    bytes = (const unsigned char *) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (bytes == NULL) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void MappedFile::close() {
+  if (bytes != NULL)
+    UnmapViewOfFile(bytes);
+  if (mapping != NULL)
+    CloseHandle(mapping);
+  if (file != INVALID_HANDLE_VALUE)
+    CloseHandle(file);
+  bytes = NULL;
+  length = 0;
+  mapping = NULL;
+  file = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+MappedFile::MappedFile() : bytes(NULL), length(0) {
+}
+
+bool MappedFile::open(const char *filename) {
+  close();
+
+  int file = ::open(filename, O_RDONLY);
+  if (file < 0)
+    return false;
+
+  // The mapping keeps the file open after the descriptor is closed.
+  struct stat status;
+  void *view = MAP_FAILED;
+  if (fstat(file, &status) == 0 && status.st_size > 0)
+    view = mmap(NULL, (size_t) status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+  ::close(file);
+  if (view == MAP_FAILED)
+    return false;
+
+  madvise(view, (size_t) status.st_size, MADV_SEQUENTIAL);
+  bytes = (const unsigned char *) view;
+  length = (size_t) status.st_size;
+  return true;
+}
+
+void MappedFile::close() {
+  if (bytes != NULL)
+    munmap((void *) bytes, length);
+  bytes = NULL;
+  length = 0;
+}
+
+#endif // _WIN32
+
+MappedFile::~MappedFile() {
+  close();
+}
@@ -0,0 +1,33 @@
+#pragma once
+/*
+ * A read-only view of a whole file mapped into memory.
+ *
+ * The pages are read in by the operating system as they are touched, so
+ * nothing is copied into a buffer of our own before it is used.
+ */
+#include <cstddef>
+
+class MappedFile {
+public:
+  MappedFile();
+  ~MappedFile();
+
+  // Map filename, closing any file mapped before. Returns false if the
+  // file cannot be opened or mapped.
+  bool open(const char *filename);
+  void close();
+
+  const unsigned char *data() const { return bytes; }
+  size_t size() const { return length; }
+
+private:
+  MappedFile(const MappedFile &);
+  MappedFile &operator=(const MappedFile &);
+
+  const unsigned char *bytes;
+  size_t length;
+#ifdef _WIN32
+  void *file;
+  void *mapping;
+#endif
+};
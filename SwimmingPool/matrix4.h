@@ -0,0 +1,89 @@
+#pragma once
+/*
+ * A 4x4 transformation matrix, stored in column major order
+ * so it can be handed straight to OpenGL.
+ *
+ * Header only like vector3; everything but rotation can be evaluated at
+ * compile time.
+ */
+#include <cmath>
+#include "vector3.h"
+
+class matrix4 {
+public:
+  // constructors
+  // The identity matrix.
+  constexpr matrix4() : m{1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1} {}
+
+  // methods - construction of the basic transformations, with the same
+  // meaning as glTranslatef, glRotatef (angle in degrees) and glScalef.
+  static constexpr matrix4 translation(float x, float y, float z) {
+    matrix4 r;
+    r.m[12] = x;
+    r.m[13] = y;
+    r.m[14] = z;
+    return r;
+  }
+  static matrix4 rotation(float angle, float x, float y, float z) {
+    matrix4 r;
+    vector3 axis = vector3(x, y, z).normalize();
+    float radians = (float) (angle * 3.1415926536 / 180.0);
+    float c = std::cos(radians);
+    float s = std::sin(radians);
+    float t = 1 - c;
+
+    r.m[0] = t * axis.x * axis.x + c;
+    r.m[1] = t * axis.x * axis.y + s * axis.z;
+    r.m[2] = t * axis.x * axis.z - s * axis.y;
+
+    r.m[4] = t * axis.x * axis.y - s * axis.z;
+    r.m[5] = t * axis.y * axis.y + c;
+    r.m[6] = t * axis.y * axis.z + s * axis.x;
+
+    r.m[8] = t * axis.x * axis.z + s * axis.y;
+    r.m[9] = t * axis.y * axis.z - s * axis.x;
+    r.m[10] = t * axis.z * axis.z + c;
+    return r;
+  }
+  static constexpr matrix4 scaling(float x, float y, float z) {
+    matrix4 r;
+    r.m[0] = x;
+    r.m[5] = y;
+    r.m[10] = z;
+    return r;
+  }
+
+  // methods - matrix
+  constexpr matrix4 multiply(const matrix4 &b) const {
+    matrix4 r;
+    for (int col = 0; col < 4; col++) {
+      for (int row = 0; row < 4; row++) {
+        r.m[col * 4 + row] = m[0 * 4 + row] * b.m[col * 4 + 0] +
+                             m[1 * 4 + row] * b.m[col * 4 + 1] +
+                             m[2 * 4 + row] * b.m[col * 4 + 2] +
+                             m[3 * 4 + row] * b.m[col * 4 + 3];
+      }
+    }
+    return r;
+  }
+  // Post-multiply by a basic transformation, like the gl functions do.
+  constexpr matrix4 translate(float x, float y, float z) const {
+    return multiply(translation(x, y, z));
+  }
+  matrix4 rotate(float angle, float x, float y, float z) const {
+    return multiply(rotation(angle, x, y, z));
+  }
+  constexpr matrix4 scale(float x, float y, float z) const {
+    return multiply(scaling(x, y, z));
+  }
+
+  // methods - vector
+  constexpr vector3 transformPoint(const vector3 &p) const {
+    return vector3(m[0] * p.x + m[4] * p.y + m[8] * p.z + m[12],
+                   m[1] * p.x + m[5] * p.y + m[9] * p.z + m[13],
+                   m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14]);
+  }
+
+  // data elements
+  float m[16];
+};
@@ -0,0 +1,348 @@
+/*
+ * Retained triangle meshes. See mesh.h.
+ */
+#include <cassert>
+#include <cmath>
+#include "mesh.h"
+#include "sceneShader.h"
+#include "vectorBatch.h"
+
+using namespace std;
+
+#define MESH_PI 3.1415926536
+
+GLuint MeshData::addVertex(vector3 position, vector3 normal) {
+  GLuint index = vertexCount();
+  vertices.push_back(position.x);
+  vertices.push_back(position.y);
+  vertices.push_back(position.z);
+  vertices.push_back(normal.x);
+  vertices.push_back(normal.y);
+  vertices.push_back(normal.z);
+  return index;
+}
+
+void MeshData::addTriangle(GLuint a, GLuint b, GLuint c) {
+  indices.push_back(a);
+  indices.push_back(b);
+  indices.push_back(c);
+}
+
+void MeshData::addFlatTriangle(vector3 a, vector3 b, vector3 c) {
+  vector3 normal = b.subtract(a).cross(c.subtract(a)).normalize();
+  GLuint first = addVertex(a, normal);
+  addVertex(b, normal);
+  addVertex(c, normal);
+  addTriangle(first, first + 1, first + 2);
+}
+
+void MeshData::addFlatQuad(vector3 a, vector3 b, vector3 c, vector3 d) {
+  vector3 normal = b.subtract(a).cross(c.subtract(a)).normalize();
+  GLuint first = addVertex(a, normal);
+  addVertex(b, normal);
+  addVertex(c, normal);
+  addVertex(d, normal);
+  addTriangle(first, first + 1, first + 2);
+  addTriangle(first, first + 2, first + 3);
+}
+
+Mesh uploadMesh(const MeshData &data) {
+  return uploadMeshLevels(vector<MeshData>(1, data), vector<float>(1, 0.0f));
+}
+
+Mesh uploadMeshLevels(const vector<MeshData> &levels, const vector<float> &minPixels) {
+  assert(!levels.empty() && levels.size() == minPixels.size());
+  Mesh mesh;
+  const GLsizei stride = MeshData::FLOATS_PER_VERTEX * sizeof(float);
+
+  // Append the levels one after another, moving each level's
+  // indices past the vertices of the levels before it.
+  vector<float> vertices;
+  vector<GLuint> indices;
+  for (size_t i = 0; i < levels.size(); i++) {
+    const MeshData &data = levels[i];
+    GLuint firstVertex = (GLuint) (vertices.size() / MeshData::FLOATS_PER_VERTEX);
+    MeshLevel level;
+    level.firstIndex = (GLsizei) indices.size();
+    level.indexCount = (GLsizei) data.indices.size();
+    level.minPixels = minPixels[i];
+    mesh.levels.push_back(level);
+
+    vertices.insert(vertices.end(), data.vertices.begin(), data.vertices.end());
+    for (GLuint index : data.indices)
+      indices.push_back(firstVertex + index);
+  }
+
+  glGenVertexArrays(1, &mesh.vao);
+  glBindVertexArray(mesh.vao);
+
+  glGenBuffers(1, &mesh.vertexBuffer);
+  glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+
+  glGenBuffers(1, &mesh.indexBuffer);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+  // Offsets into the bound vertex buffer.
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glVertexPointer(3, GL_FLOAT, stride, (const void *) 0);
+  glEnableClientState(GL_NORMAL_ARRAY);
+  glNormalPointer(GL_FLOAT, stride, (const void *) (3 * sizeof(float)));
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  const vector<float> &finest = levels[0].vertices;
+  for (size_t i = 0; i < finest.size(); i += MeshData::FLOATS_PER_VERTEX)
+    mesh.bounds.add(vector3(finest[i], finest[i + 1], finest[i + 2]));
+  mesh.data.vertices.swap(vertices);
+  mesh.data.indices.swap(indices);
+  return mesh;
+}
+
+int selectMeshLevel(const Mesh &mesh, float pixels, int current) {
+  int level = current;
+  while (level > 0 && pixels >= mesh.levels[level - 1].minPixels * 1.1f)
+    level--;
+  while (level + 1 < (int) mesh.levels.size() && pixels < mesh.levels[level].minPixels * 0.9f)
+    level++;
+  return level;
+}
+
+void drawMesh(const Mesh &mesh) {
+  useSceneShader(0);
+  glBindVertexArray(mesh.vao);
+  glDrawElements(GL_TRIANGLES, mesh.levels[0].indexCount, GL_UNSIGNED_INT, (const void *) 0);
+}
+
+void deleteMesh(Mesh *mesh) {
+  glDeleteVertexArrays(1, &mesh->vao);
+  glDeleteBuffers(1, &mesh->vertexBuffer);
+  glDeleteBuffers(1, &mesh->indexBuffer);
+  *mesh = Mesh();
+}
+
+MeshData cubeMeshData() {
+  MeshData data;
+
+  vector3 a = vector3(-0.5, -0.5, 0.5);
+  vector3 b = vector3(0.5, -0.5, 0.5);
+  vector3 c = vector3(0.5, 0.5, 0.5);
+  vector3 d = vector3(-0.5, 0.5, 0.5);
+  vector3 e = vector3(0.5, -0.5, -0.5);
+  vector3 f = vector3(0.5, 0.5, -0.5);
+  vector3 g = vector3(-0.5, 0.5, -0.5);
+  vector3 h = vector3(-0.5, -0.5, -0.5);
+
+  data.addFlatQuad(b, e, f, c);
+  data.addFlatQuad(h, a, d, g);
+  data.addFlatQuad(a, b, c, d);
+  data.addFlatQuad(e, h, g, f);
+  data.addFlatQuad(c, f, g, d);
+  data.addFlatQuad(e, b, a, h);
+
+  return data;
+}
+
+/*
+ * Append triangle a, b, c, ordered so it faces the way its vertex
+ * normals point on average. Degenerate triangles are dropped.
+ */
+static void addFacingTriangle(MeshData *data, GLuint a, GLuint b, GLuint c) {
+  const float *va = &data->vertices[a * MeshData::FLOATS_PER_VERTEX];
+  const float *vb = &data->vertices[b * MeshData::FLOATS_PER_VERTEX];
+  const float *vc = &data->vertices[c * MeshData::FLOATS_PER_VERTEX];
+  vector3 pa(va[0], va[1], va[2]);
+  vector3 face = vector3(vb[0], vb[1], vb[2]).subtract(pa).cross(vector3(vc[0], vc[1], vc[2]).subtract(pa));
+  vector3 normal = vector3(va[3] + vb[3] + vc[3], va[4] + vb[4] + vc[4], va[5] + vb[5] + vc[5]);
+
+  float facing = face.dot(normal);
+  if (facing > 0)
+    data->addTriangle(a, b, c);
+  else if (facing < 0)
+    data->addTriangle(a, c, b);
+}
+
+/*
+ * The transformation taking the unit circle around axis to the circle of
+ * radius about it at height.
+ */
+static matrix4 ringTransform(RevolutionAxis axis, float radius, float height) {
+  if (axis == AroundY)
+    return matrix4::translation(0, height, 0).scale(radius, 1, radius);
+  return matrix4::translation(0, 0, height).scale(radius, radius, 1);
+}
+
+MeshData revolutionMeshData(const vector<ProfilePoint> &profile, int numPoints, RevolutionAxis axis) {
+  assert(numPoints > 2);
+  MeshData data;
+
+  // The unit circle around the axis, a point for each vertex of a ring.
+  vector3Batch circle;
+  circle.resize(numPoints);
+  for (int i = 0; i < numPoints; i++) {
+    double angle = i * (2 * MESH_PI / numPoints);
+    float x = (float) cos(angle), y = (float) sin(angle);
+    circle.set(i, (axis == AroundY) ? vector3(x, 0, y) : vector3(x, y, 0));
+  }
+
+  // Each ring's positions and normals, as a batch for the kernels.
+  vector3Batch positions, normals;
+  GLuint previous = 0;
+  bool previousPole = false;
+  for (const ProfilePoint &point : profile) {
+    transformPoints(ringTransform(axis, point.radius, point.height), circle, &positions);
+    transformPoints(ringTransform(axis, point.normalRadius, point.normalHeight), circle, &normals);
+    normalizeVectors(&normals);
+
+    // A point on the axis is a single vertex, otherwise a ring of them.
+    bool pole = (point.radius == 0);
+    GLuint ring = data.vertexCount();
+    for (int i = 0; i < (pole ? 1 : numPoints); i++)
+      data.addVertex(positions.get(i), normals.get(i));
+
+    if (point.join) {
+      assert(ring != 0 && !(pole && previousPole));
+      for (int i = 0; i < numPoints; i++) {
+        GLuint next = (i + 1) % numPoints;
+        if (previousPole) {
+          addFacingTriangle(&data, previous, ring + i, ring + next);
+        } else if (pole) {
+          addFacingTriangle(&data, previous + i, previous + next, ring);
+        } else {
+          addFacingTriangle(&data, previous + i, previous + next, ring + next);
+          addFacingTriangle(&data, previous + i, ring + next, ring + i);
+        }
+      }
+    }
+    previous = ring;
+    previousPole = pole;
+  }
+
+  return data;
+}
+
+MeshData circleMeshData(int numPoints) {
+  vector<ProfilePoint> profile = {
+    {0, 0, 0, 1, false},
+    {1, 0, 0, 1, true},
+  };
+  return revolutionMeshData(profile, numPoints, AroundZ);
+}
+
+MeshData cylinderMeshData(int numPoints, int length) {
+  assert(length > 0);
+  float back = (float) -length;
+  vector<ProfilePoint> profile = {
+    // One end of the cylinder.
+    {0, 0, 0, 1, false},
+    {1, 0, 0, 1, true},
+    // The middle of the cylinder.
+    {1, 0, 1, 0, false},
+    {1, back, 1, 0, true},
+    // The other end of the cylinder.
+    {1, back, 0, -1, false},
+    {0, back, 0, -1, true},
+  };
+  return revolutionMeshData(profile, numPoints, AroundZ);
+}
+
+/*
+ * The points of a unit circle from latitude firstStack * PI / numStacks - PI / 2
+ * up to the north pole, for the profile of a sphere or dome.
+ */
+static vector<ProfilePoint> sphereProfile(int numStacks, int firstStack) {
+  vector<ProfilePoint> profile;
+  for (int stack = firstStack; stack <= numStacks; stack++) {
+    double latitude = stack * MESH_PI / numStacks - MESH_PI / 2;
+    // Exactly zero at the poles, so they become single vertices.
+    float radius = (stack == 0 || stack == numStacks) ? 0.0f : (float) cos(latitude);
+    float height = (float) sin(latitude);
+    profile.push_back({radius, height, radius, height, stack != firstStack});
+  }
+  return profile;
+}
+
+MeshData sphereMeshData(int numPoints, int numStacks) {
+  assert(numStacks > 0);
+
+  if ((numStacks % 2) != 0) {
+    numStacks++;
+  }
+
+  return revolutionMeshData(sphereProfile(numStacks, 0), numPoints, AroundY);
+}
+
+MeshData domeMeshData(int numPoints, int numStacks) {
+  assert(numStacks > 0);
+
+  if ((numStacks % 2) != 0) {
+    numStacks++;
+  }
+
+  vector<ProfilePoint> profile = sphereProfile(numStacks, numStacks / 2);
+  // The base of the dome.
+  profile.push_back({1, 0, 0, -1, false});
+  profile.push_back({0, 0, 0, -1, true});
+  return revolutionMeshData(profile, numPoints, AroundY);
+}
+
+MeshData triPyramidMeshData() {
+  MeshData data;
+
+  vector3 a = vector3(-0.288675, 0, -0.5);
+  vector3 b = vector3(-0.288675, 0, 0.5);
+  vector3 c = vector3(0.433013, 0, 0);
+  vector3 d = vector3(0, 0.866025, 0);
+
+  // Bottom
+  data.addFlatTriangle(a, c, b);
+  // Sides
+  data.addFlatTriangle(b, c, d);
+  data.addFlatTriangle(c, a, d);
+  data.addFlatTriangle(a, b, d);
+
+  return data;
+}
+
+MeshData squarePyramidMeshData() {
+  MeshData data;
+
+  vector3 a = vector3(0.5, 0, 0.5);
+  vector3 b = vector3(-0.5, 0, 0.5);
+  vector3 c = vector3(-0.5, 0, -0.5);
+  vector3 d = vector3(0.5, 0, -0.5);
+  vector3 e = vector3(0, 0.707107, 0);
+
+  // Bottom
+  data.addFlatQuad(a, b, c, d);
+  // Sides
+  data.addFlatTriangle(a, d, e);
+  data.addFlatTriangle(d, c, e);
+  data.addFlatTriangle(c, b, e);
+  data.addFlatTriangle(b, a, e);
+
+  return data;
+}
+
+MeshData triPrismMeshData() {
+  MeshData data;
+
+  vector3 a = vector3(-0.5, 0, -0.5);
+  vector3 b = vector3(-0.5, 0, 0.5);
+  vector3 c = vector3(0.5, 0, 0.5);
+  vector3 d = vector3(0.5, 0, -0.5);
+  vector3 e = vector3(0.5, 0.866025, 0);
+  vector3 f = vector3(-0.5, 0.866025, 0);
+
+  // End Faces
+  data.addFlatTriangle(c, d, e);
+  data.addFlatTriangle(a, b, f);
+  // Middle Faces
+  data.addFlatQuad(b, c, e, f);
+  data.addFlatQuad(f, e, d, a);
+  data.addFlatQuad(a, d, c, b);
+
+  return data;
+}
@@ -0,0 +1,137 @@
+#pragma once
+/*
+ * Retained triangle meshes.
+ *
+ * The primitives are generated on the CPU into a MeshData: an interleaved,
+ * tightly packed float vertex array plus a triangle index array. uploadMesh
+ * copies that into a vertex buffer and index buffer once, recorded in a
+ * vertex array object, and drawMesh then draws it with one glDrawElements.
+ */
+#include <vector>
+#include "glFunctions.h"
+#include "vector3.h"
+#include "bounds.h"
+
+/*
+ * CPU side mesh.
+ * Each vertex is FLOATS_PER_VERTEX floats: position x, y, z then normal x, y, z.
+ * Every three indices form one counter clockwise (front facing) triangle.
+ */
+struct MeshData {
+  static const int FLOATS_PER_VERTEX = 6;
+
+  std::vector<float> vertices;
+  std::vector<GLuint> indices;
+
+  // Append a vertex and return its index.
+  GLuint addVertex(vector3 position, vector3 normal);
+  void addTriangle(GLuint a, GLuint b, GLuint c);
+  // Append a triangle with its own three vertices, all with the face normal.
+  void addFlatTriangle(vector3 a, vector3 b, vector3 c);
+  // Append a flat quad with corners given counter clockwise.
+  void addFlatQuad(vector3 a, vector3 b, vector3 c, vector3 d);
+
+  GLuint vertexCount() const { return (GLuint) (vertices.size() / FLOATS_PER_VERTEX); }
+};
+
+/*
+ * One level of detail of a mesh, a range of its index buffer.
+ */
+struct MeshLevel {
+  GLsizei firstIndex;
+  GLsizei indexCount;
+  float minPixels;                    // Used from this projected radius in pixels up.
+};
+
+/*
+ * GPU side mesh, ready to draw.
+ */
+struct Mesh {
+  GLuint vao = 0;
+  GLuint vertexBuffer = 0;
+  GLuint indexBuffer = 0;
+  std::vector<MeshLevel> levels;      // Finest first; always at least one.
+  BoundingBox bounds;                 // Around all the vertices of the finest level.
+  MeshData data;                      // What the buffers hold, for drawing on the
+                                      // CPU (see softwareRenderer.h).
+};
+
+/*
+ * Upload data into new buffer objects, ordered as it is; reorder it for
+ * the vertex cache first with optimizeVertexCache (see vertexCache.h).
+ * The vertex array object records the buffers and the vertex and normal
+ * array pointers. The mesh keeps a copy of what was uploaded.
+ */
+Mesh uploadMesh(const MeshData &data);
+
+/*
+ * Upload several levels of detail of the same shape, finest first, into
+ * one set of buffers. Level i is used while the mesh covers a radius of
+ * at least minPixels[i] pixels on screen; the last should be 0.
+ */
+Mesh uploadMeshLevels(const std::vector<MeshData> &levels, const std::vector<float> &minPixels);
+
+/*
+ * The level to draw a mesh covering a radius of pixels on screen with,
+ * given the level it was drawn with last. A level is only left once the
+ * radius is 10% beyond its range, so a mesh hovering around a threshold
+ * does not flicker between two levels.
+ */
+int selectMeshLevel(const Mesh &mesh, float pixels, int current);
+
+/*
+ * Draw the finest level of the mesh with the untextured scene shader and
+ * the current matrices, color and material.
+ */
+void drawMesh(const Mesh &mesh);
+
+/*
+ * Release the buffer objects of a mesh.
+ */
+void deleteMesh(Mesh *mesh);
+
+/*
+ * Primitive generators. Sizes and orientations match the display lists
+ * the scene was originally built from.
+ */
+
+/*
+ * Surfaces of revolution: a profile curve swept around an axis.
+ *
+ * Each point of the profile is a distance from the axis and a height
+ * along it, with the direction of the surface's normal there in the same
+ * terms, which need not be of unit length. A point joined to the one
+ * before it is connected to it by a band of triangles; starting a new
+ * run of points without a join makes a hard edge, such as where the side
+ * of a cylinder meets its end. A point on the axis is a single vertex.
+ * Triangles face the way their normals do.
+ */
+struct ProfilePoint {
+  float radius, height;
+  float normalRadius, normalHeight;
+  bool join;
+};
+
+enum RevolutionAxis {
+  AroundY,                            // Radius in the xz plane, from +x towards +z.
+  AroundZ,                            // Radius in the xy plane, from +x towards +y.
+};
+
+MeshData revolutionMeshData(const std::vector<ProfilePoint> &profile, int numPoints, RevolutionAxis axis);
+
+// A cube with a side length of one, centred on the origin.
+MeshData cubeMeshData();
+// A unit circle in the xy plane, centred on the origin, facing +z.
+MeshData circleMeshData(int numPoints);
+// A unit radius cylinder running from z = 0 to z = -length.
+MeshData cylinderMeshData(int numPoints, int length);
+// A unit sphere centred on the origin, made of numStacks stacks.
+MeshData sphereMeshData(int numPoints, int numStacks);
+// The top half of sphereMeshData, closed by a disc facing -y.
+MeshData domeMeshData(int numPoints, int numStacks);
+// A triangular based pyramid standing on the xz plane.
+MeshData triPyramidMeshData();
+// A square based pyramid standing on the xz plane.
+MeshData squarePyramidMeshData();
+// A triangular prism lying along the x axis.
+MeshData triPrismMeshData();
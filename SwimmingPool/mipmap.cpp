@@ -0,0 +1,313 @@
+/*
+ * Mip chain building and caching. See mipmap.h.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <utility>
+#include "platform.h"
+#include "jobs.h"
+#include "mipmap.h"
+#include "simd.h"
+#include "textureCompression.h"
+
+using namespace std;
+
+// Written at the start of the cache file. Bump the version whenever the
+// filter or the layout changes so old caches are rebuilt.
+static const char CACHE_MAGIC[4] = {'M', 'I', 'P', 'S'};
+static const uint32_t CACHE_VERSION = 2;
+
+struct CacheHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t imageHash;
+  uint64_t imageSize;
+  int32_t smallest;
+  int32_t format;
+  int32_t levelCount;
+  // Followed by the width and height of each level, as int32_t, and
+  // then the data of each level in turn.
+};
+
+// Entries in the table from linear light back to sRGB bytes.
+static const int ENCODE_SIZE = 1 << 14;
+
+/*
+ * Tables between bytes and linear light: sRGB for red, green and blue,
+ * and straight scaling for alpha.
+ */
+struct LightTables {
+  float decode[4][256];
+  unsigned char encode[4][ENCODE_SIZE];
+
+  LightTables() {
+    for (int i = 0; i < 256; i++) {
+      float c = i / 255.0f;
+      float linear = c <= 0.04045f ? c / 12.92f : pow((c + 0.055f) / 1.055f, 2.4f);
+      decode[0][i] = decode[1][i] = decode[2][i] = linear;
+      decode[3][i] = c;
+    }
+    for (int i = 0; i < ENCODE_SIZE; i++) {
+      float linear = (float) i / (ENCODE_SIZE - 1);
+      float c = linear <= 0.0031308f ? linear * 12.92f : 1.055f * pow(linear, 1 / 2.4f) - 0.055f;
+      encode[0][i] = encode[1][i] = encode[2][i] = (unsigned char) (c * 255 + 0.5f);
+      encode[3][i] = (unsigned char) (linear * 255 + 0.5f);
+    }
+  }
+};
+
+static const LightTables &lightTables() {
+  static const LightTables tables;
+  return tables;
+}
+
+/*
+ * The larger pixels one smaller pixel covers along one axis, and the
+ * share of each.
+ */
+struct BoxTaps {
+  int first;
+  int count;
+  float weight[4];
+};
+
+static vector<BoxTaps> boxTaps(int source, int destination) {
+  vector<BoxTaps> taps(destination);
+  double scale = (double) source / destination;
+
+  for (int i = 0; i < destination; i++) {
+    double start = i * scale;
+    double end = (i + 1) * scale;
+    BoxTaps &tap = taps[i];
+    tap.first = (int) start;
+    tap.count = 0;
+    for (int j = tap.first; j < source && j < end && tap.count < 4; j++) {
+      double overlap = min(end, j + 1.0) - max(start, (double) j);
+      tap.weight[tap.count++] = (float) (overlap / scale);
+    }
+  }
+  return taps;
+}
+
+/*
+ * Filter rows first .. last - 1 of destination from source.
+ */
+static void filterRows(const Bitmap &source, Bitmap *destination,
+                       const vector<BoxTaps> &columnTaps, const vector<BoxTaps> &rowTaps,
+                       int first, int last) {
+  const LightTables &tables = lightTables();
+  int floats = source.width * 4;
+  vector<float> linear[4];
+  vector<float> sum(floats);
+  for (int k = 0; k < 4; k++)
+    linear[k].resize(floats);
+
+  for (int row = first; row < last; row++) {
+    const BoxTaps &rowTap = rowTaps[row];
+
+    // Decode the larger rows this row covers into linear light.
+    for (int k = 0; k < rowTap.count; k++) {
+      const unsigned char *in = &source.pixels[(size_t) (rowTap.first + k) * floats];
+      float *out = linear[k].data();
+      for (int i = 0; i < floats; i += 4) {
+        out[i] = tables.decode[0][in[i]];
+        out[i + 1] = tables.decode[1][in[i + 1]];
+        out[i + 2] = tables.decode[2][in[i + 2]];
+        out[i + 3] = tables.decode[3][in[i + 3]];
+      }
+    }
+
+    // Weight them together down the columns...
+    float *s = sum.data();
+    lanes weight = lanesSet(rowTap.weight[0]);
+    int i = 0;
+    for (; i + LANES <= floats; i += LANES)
+      lanesStore(s + i, lanesMul(weight, lanesLoad(&linear[0][i])));
+    for (; i < floats; i++)
+      s[i] = rowTap.weight[0] * linear[0][i];
+    for (int k = 1; k < rowTap.count; k++) {
+      weight = lanesSet(rowTap.weight[k]);
+      for (i = 0; i + LANES <= floats; i += LANES)
+        lanesStore(s + i, lanesAdd(lanesLoad(s + i), lanesMul(weight, lanesLoad(&linear[k][i]))));
+      for (; i < floats; i++)
+        s[i] += rowTap.weight[k] * linear[k][i];
+    }
+
+    // ...and then along the row, back to bytes.
+    unsigned char *out = &destination->pixels[(size_t) row * destination->width * 4];
+    for (int column = 0; column < destination->width; column++) {
+      const BoxTaps &columnTap = columnTaps[column];
+      for (int c = 0; c < 4; c++) {
+        float value = 0;
+        for (int k = 0; k < columnTap.count; k++)
+          value += columnTap.weight[k] * s[(columnTap.first + k) * 4 + c];
+        int index = (int) (value * (ENCODE_SIZE - 1) + 0.5f);
+        *out++ = tables.encode[c][min(max(index, 0), ENCODE_SIZE - 1)];
+      }
+    }
+  }
+}
+
+void buildMipLevels(const Bitmap &base, int smallest, vector<Bitmap> *levels) {
+  levels->clear();
+
+  const Bitmap *source = &base;
+  while (source->width / 2 >= smallest && source->height / 2 >= smallest) {
+    Bitmap level;
+    level.width = source->width / 2;
+    level.height = source->height / 2;
+    level.pixels.resize((size_t) level.width * level.height * 4);
+
+    vector<BoxTaps> columnTaps = boxTaps(source->width, level.width);
+    vector<BoxTaps> rowTaps = boxTaps(source->height, level.height);
+    parallelFor(level.height, 32, [&](int first, int last) {
+      filterRows(*source, &level, columnTaps, rowTaps, first, last);
+    });
+
+    levels->push_back(move(level));
+    source = &levels->back();
+  }
+}
+
+static size_t mipLevelSize(MipFormat format, int width, int height) {
+  if (format == MipBC1)
+    return bc1Size(width, height);
+  return (size_t) width * height * 4;
+}
+
+/*
+ * 64 bit FNV-1a over the file, a word at a time.
+ */
+static uint64_t hashBytes(const unsigned char *bytes, size_t size) {
+  uint64_t hash = 14695981039346656037ULL;
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, bytes + i, 8);
+    hash = (hash ^ word) * 1099511628211ULL;
+  }
+  for (; i < size; i++)
+    hash = (hash ^ bytes[i]) * 1099511628211ULL;
+  return hash;
+}
+
+/*
+ * Point chain's levels into its cache if the cache holds the levels of
+ * an image with this hash and size.
+ */
+static bool readCache(const string &cacheName, uint64_t hash, uint64_t size, int smallest,
+                      MipFormat format, MipChain *chain) {
+  if (!chain->cache.open(cacheName.c_str()))
+    return false;
+
+  const unsigned char *bytes = chain->cache.data();
+  size_t length = chain->cache.size();
+  CacheHeader header;
+  if (length < sizeof(header))
+    return false;
+  memcpy(&header, bytes, sizeof(header));
+  if (memcmp(header.magic, CACHE_MAGIC, 4) != 0 || header.version != CACHE_VERSION ||
+      header.imageHash != hash || header.imageSize != size || header.smallest != smallest ||
+      header.format != format ||
+      header.levelCount <= 0 || header.levelCount > 32)
+    return false;
+
+  size_t offset = sizeof(header) + header.levelCount * 2 * sizeof(int32_t);
+  if (length < offset)
+    return false;
+  chain->levels.resize(header.levelCount);
+  for (int i = 0; i < header.levelCount; i++) {
+    int32_t levelSize[2];
+    memcpy(levelSize, bytes + sizeof(header) + i * sizeof(levelSize), sizeof(levelSize));
+    MipLevel &level = chain->levels[i];
+    level.width = levelSize[0];
+    level.height = levelSize[1];
+    if (level.width <= 0 || level.height <= 0 || level.width > 32768 || level.height > 32768)
+      return false;
+    level.data = bytes + offset;
+    level.size = mipLevelSize(format, level.width, level.height);
+    if (length - offset < level.size)
+      return false;
+    offset += level.size;
+  }
+  return offset == length;
+}
+
+static void writeCache(const string &cacheName, uint64_t hash, uint64_t size, int smallest, const MipChain &chain) {
+  FILE *file;
+  fopen_s(&file, cacheName.c_str(), "wb");
+  if (file == NULL) {
+    cerr << "Cannot write " << cacheName << endl;
+    return;
+  }
+
+  CacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CACHE_MAGIC, 4);
+  header.version = CACHE_VERSION;
+  header.imageHash = hash;
+  header.imageSize = size;
+  header.smallest = smallest;
+  header.format = chain.format;
+  header.levelCount = (int32_t) chain.levels.size();
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+  for (size_t i = 0; i < chain.levels.size(); i++) {
+    int32_t levelSize[2] = {chain.levels[i].width, chain.levels[i].height};
+    written = written && fwrite(levelSize, sizeof(levelSize), 1, file) == 1;
+  }
+  for (size_t i = 0; i < chain.levels.size(); i++) {
+    const MipLevel &level = chain.levels[i];
+    written = written && fwrite(level.data, level.size, 1, file) == 1;
+  }
+  if (fclose(file) != 0 || !written) {
+    cerr << "Cannot write " << cacheName << endl;
+    remove(cacheName.c_str());
+  }
+}
+
+bool loadMipChain(const string &filename, int smallest, MipFormat format, MipChain *chain) {
+  chain->format = format;
+  chain->levels.clear();
+  chain->built.clear();
+  chain->cache.close();
+
+  MappedFile image;
+  if (!image.open(filename.c_str())) {
+    cerr << "Cannot read " << filename << endl;
+    return false;
+  }
+  uint64_t hash = hashBytes(image.data(), image.size());
+  uint64_t size = image.size();
+  image.close();
+
+  string cacheName = filename + ".mips";
+  if (readCache(cacheName, hash, size, smallest, format, chain))
+    return true;
+  chain->cache.close();
+  chain->levels.clear();
+
+  // Build the chain, with the image itself as the first level.
+  vector<Bitmap> levels(1);
+  if (!loadBitmap(filename, &levels[0]))
+    return false;
+  vector<Bitmap> smaller;
+  buildMipLevels(levels[0], smallest, &smaller);
+  for (size_t i = 0; i < smaller.size(); i++)
+    levels.push_back(move(smaller[i]));
+
+  chain->built.resize(levels.size());
+  for (size_t i = 0; i < levels.size(); i++) {
+    if (format == MipBC1)
+      compressBC1(levels[i], &chain->built[i]);
+    else
+      chain->built[i].swap(levels[i].pixels);
+    MipLevel level = {levels[i].width, levels[i].height, chain->built[i].data(), chain->built[i].size()};
+    chain->levels.push_back(level);
+  }
+
+  writeCache(cacheName, hash, size, smallest, *chain);
+  return true;
+}
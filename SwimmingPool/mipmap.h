@@ -0,0 +1,60 @@
+#pragma once
+/*
+ * Mip chains for texture images, cached on disk.
+ *
+ * Each level halves the one before it with a box filter applied to
+ * linear light rather than to the sRGB bytes, so the smaller levels keep
+ * the brightness of the image instead of darkening its detail. Odd sizes
+ * round down as OpenGL's do, each smaller pixel taking its share of up
+ * to three larger ones. Every level is split into bands of rows run as
+ * jobs (see jobs.h), and the vertical half of the filter runs LANES
+ * floats at a time (see simd.h).
+ *
+ * The levels are kept as RGBA or compressed to BC1 (see
+ * textureCompression.h). Building the chain is done once: the result is
+ * written next to the image as <image>.mips, stamped with a hash of the
+ * image file and the format, and read back through a memory mapping as
+ * long as neither changes.
+ */
+#include <string>
+#include <vector>
+#include "bitmap.h"
+#include "mappedFile.h"
+
+enum MipFormat {
+  MipRGBA,                          // width * height RGBA pixels.
+  MipBC1                            // BC1 blocks, bc1Size(width, height) bytes.
+};
+
+// One level of a chain, bottom row first.
+struct MipLevel {
+  int width;
+  int height;
+  const unsigned char *data;
+  size_t size;                      // Bytes of data.
+};
+
+struct MipChain {
+  MipFormat format;
+  std::vector<MipLevel> levels;     // Largest first.
+
+  // The storage the levels point into: the cache file, or the levels
+  // built when the cache was missing or stale.
+  MappedFile cache;
+  std::vector<std::vector<unsigned char> > built;
+};
+
+/*
+ * Build the levels of base after the first into *levels, stopping before
+ * a level narrower or shorter than smallest.
+ */
+void buildMipLevels(const Bitmap &base, int smallest, std::vector<Bitmap> *levels);
+
+/*
+ * Fill *chain with the image in filename and its smaller levels, down to
+ * smallest as for buildMipLevels, in format. They come from the cache if
+ * it is up to date, and otherwise from loading the image, building the
+ * levels and rewriting the cache. Returns false if the image cannot be
+ * loaded.
+ */
+bool loadMipChain(const std::string &filename, int smallest, MipFormat format, MipChain *chain);
@@ -0,0 +1,45 @@
+/*
+ * Composite objects described as data. See model.h.
+ */
+#include "glState.h"
+#include "model.h"
+
+void Model::setColor(float r, float g, float b, float a) {
+  color[0] = r;
+  color[1] = g;
+  color[2] = b;
+  color[3] = a;
+}
+
+void Model::setMaterial(MaterialFunc m) {
+  material = m;
+}
+
+void Model::add(const Mesh &mesh, matrix4 transform) {
+  MeshPart part;
+  part.mesh = &mesh;
+  part.transform = transform;
+  for (int i = 0; i < 4; i++)
+    part.color[i] = color[i];
+  part.material = material;
+  parts.push_back(part);
+}
+
+void Model::add(const Model &model, matrix4 transform) {
+  for (MeshPart part : model.parts) {
+    part.transform = transform.multiply(part.transform);
+    parts.push_back(part);
+  }
+}
+
+void drawModel(const Model &model) {
+  for (const MeshPart &part : model.parts) {
+    if (part.material != NULL)
+      part.material();
+    cachedColor4fv(part.color);
+    glPushMatrix();
+    glMultMatrixf(part.transform.m);
+    drawMesh(*part.mesh);
+    glPopMatrix();
+  }
+}
@@ -0,0 +1,48 @@
+#pragma once
+/*
+ * Composite objects described as data.
+ *
+ * A Model is a flat list of mesh parts, each with the transform, color and
+ * material it is drawn with, relative to the model's own origin. Models
+ * are built once with the same vocabulary as the gl matrix functions and
+ * can then be drawn directly (drawModel) or merged into an instance batch
+ * (see instancing.h).
+ */
+#include <vector>
+#include "matrix4.h"
+#include "mesh.h"
+
+/*
+ * A function that sets the gl material properties, such as shinyMaterial.
+ */
+typedef void (*MaterialFunc)();
+
+struct MeshPart {
+  const Mesh *mesh;
+  matrix4 transform;
+  float color[4];
+  MaterialFunc material;
+};
+
+struct Model {
+  std::vector<MeshPart> parts;
+
+  // The color and material given to the parts added from now on.
+  float color[4] = {1.0, 1.0, 1.0, 0.0};
+  MaterialFunc material = NULL;
+
+  void setColor(float r, float g, float b, float a);
+  void setMaterial(MaterialFunc m);
+
+  // Add a mesh drawn with transform.
+  void add(const Mesh &mesh, matrix4 transform);
+  // Add all the parts of another model, placed with transform.
+  // They keep their own colors and materials.
+  void add(const Model &model, matrix4 transform);
+};
+
+/*
+ * Draw every part of the model with the current modelview matrix,
+ * one glDrawElements per part.
+ */
+void drawModel(const Model &model);
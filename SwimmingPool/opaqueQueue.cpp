@@ -0,0 +1,95 @@
+/*
+ * The opaque draws of a frame, nearest first. See opaqueQueue.h.
+ */
+#include "opaqueQueue.h"
+#include "profiler.h"
+#include "sceneShader.h"
+
+using namespace std;
+
+void clearOpaqueQueue(OpaqueQueue *queue) {
+  queue->draws.clear();
+  queue->order.clear();
+}
+
+/*
+ * Add a draw with key to the queue.
+ */
+static void queueDraw(OpaqueQueue *queue, const OpaqueDraw &draw, unsigned key) {
+  DepthItem item = {key, (int) queue->draws.size()};
+  queue->draws.push_back(draw);
+  queue->order.push_back(item);
+}
+
+void queueStaticBatch(OpaqueQueue *queue, const StaticBatch &batch, const Frustum &frustum) {
+  size_t bucket = 0;
+  for (size_t quad = 0; quad < batch.firstBlendedQuad; quad++) {
+    while (bucket + 1 < batch.buckets.size() && batch.buckets[bucket + 1].firstIndex <= (GLsizei) (quad * 6))
+      bucket++;
+    const BoundingBox &bounds = batch.bounds[quad];
+    if (testBox(frustum, bounds) == Outside)
+      continue;
+    OpaqueDraw draw = {&batch, quad, bucket, NULL, 0};
+    queueDraw(queue, draw, depthKey(frustum.modelview, bounds, frustum.farDistance));
+  }
+}
+
+void queueInstances(OpaqueQueue *queue, const InstanceBatch &batch) {
+  for (const InstanceGroup &group : batch.groups) {
+    for (size_t level = 0; level < group.vaos.size(); level++) {
+      if (group.drawCounts[level] == 0)
+        continue;
+      OpaqueDraw draw = {NULL, 0, 0, &group, (int) level};
+      queueDraw(queue, draw, group.nearestKeys[level]);
+    }
+  }
+}
+
+void sortOpaqueQueue(OpaqueQueue *queue) {
+  sortByDepth(&queue->order);
+}
+
+/*
+ * Make every draw of the queue, in order, with the current shading.
+ */
+static void drawQueued(const OpaqueQueue &queue) {
+  const vector<DepthItem> &order = queue.order;
+  for (size_t i = 0; i < order.size();) {
+    const OpaqueDraw &draw = queue.draws[order[i].index];
+    if (draw.group != NULL) {
+      drawInstanceLevel(*draw.group, draw.level);
+      i++;
+      continue;
+    }
+
+    size_t count = 1;
+    while (i + count < order.size()) {
+      const OpaqueDraw &next = queue.draws[order[i + count].index];
+      if (next.batch != draw.batch || next.bucket != draw.bucket || next.quad != draw.quad + count)
+        break;
+      count++;
+    }
+    drawStaticQuads(*draw.batch, draw.quad, count);
+    i += count;
+  }
+  glBindVertexArray(0);
+}
+
+void drawDepthPrepass(const OpaqueQueue &queue) {
+  ProfileScope scope("depth pre-pass", true);
+  SceneShading shading = sceneShading();
+  setSceneShading(SceneDepthOnly);
+  glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+  drawQueued(queue);
+  glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+  setSceneShading(shading);
+
+  glDepthFunc(GL_LEQUAL);
+  glDepthMask(GL_FALSE);
+}
+
+void drawOpaqueQueue(const OpaqueQueue &queue) {
+  drawQueued(queue);
+  glDepthFunc(GL_LESS);
+  glDepthMask(GL_TRUE);
+}
@@ -0,0 +1,68 @@
+#pragma once
+/*
+ * The opaque draws of a frame, nearest first.
+ *
+ * Shading fragments is most of the cost of a frame on a software
+ * rasterizer, and a fragment behind one already drawn fails the depth
+ * test before it is shaded. So each frame the opaque quads of the static
+ * batches inside the frustum, and each level of detail of an instance
+ * group with instances visible, are queued with the depth key of their
+ * nearest point (see depthSort.h), sorted and drawn nearest first. Quads
+ * that end up next to each other in the order and in their bucket are
+ * drawn with one call. A group level is one instanced draw as before,
+ * keyed by its nearest instance, with its instances already nearest
+ * first from cullInstances.
+ *
+ * A depth pre-pass draws the queue into the depth buffer alone first, so
+ * that drawing it again shaded shades only the nearest surface of each
+ * pixel, for the cost of transforming and rasterizing everything twice.
+ */
+#include <vector>
+#include "culling.h"
+#include "depthSort.h"
+#include "instancing.h"
+#include "staticBatch.h"
+
+/*
+ * A quad of a static batch, or a level of an instance group.
+ */
+struct OpaqueDraw {
+  const StaticBatch *batch;
+  size_t quad;
+  size_t bucket;
+  const InstanceGroup *group;
+  int level;
+};
+
+struct OpaqueQueue {
+  std::vector<OpaqueDraw> draws;
+  std::vector<DepthItem> order;       // Of draws, nearest first once sorted.
+};
+
+void clearOpaqueQueue(OpaqueQueue *queue);
+
+/*
+ * Queue the opaque quads of batch at least partly inside frustum.
+ */
+void queueStaticBatch(OpaqueQueue *queue, const StaticBatch &batch, const Frustum &frustum);
+
+/*
+ * Queue the levels of batch's groups with instances to draw, as left by
+ * cullInstances.
+ */
+void queueInstances(OpaqueQueue *queue, const InstanceBatch &batch);
+
+void sortOpaqueQueue(OpaqueQueue *queue);
+
+/*
+ * Draw the queue into the depth buffer alone, and leave the depth test
+ * passing only what is at the depth drawn, without writing it, for
+ * drawOpaqueQueue.
+ */
+void drawDepthPrepass(const OpaqueQueue &queue);
+
+/*
+ * Draw the queue in order with the scene shader, then put the depth test
+ * back to GL_LESS with depth writes, as it is without a pre-pass.
+ */
+void drawOpaqueQueue(const OpaqueQueue &queue);
@@ -0,0 +1,63 @@
+/*
+ * Counting how many fragments are shaded per pixel. See overdraw.h.
+ */
+#include <deque>
+#include <vector>
+#include "glFunctions.h"
+#include "overdraw.h"
+#include "profiler.h"
+
+using namespace std;
+
+/*
+ * A query around one frame, and the pixels it covered.
+ */
+struct OverdrawCount {
+  GLuint query;
+  double pixels;
+};
+
+static vector<GLuint> freeQueries;
+static deque<OverdrawCount> endedCounts;  // In the order they were ended.
+static OverdrawCount counting;
+static double lastOverdraw = -1;
+
+void beginOverdrawCount() {
+  if (freeQueries.empty()) {
+    GLuint query;
+    glGenQueries(1, &query);
+    freeQueries.push_back(query);
+  }
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  counting.query = freeQueries.back();
+  counting.pixels = (double) viewport[2] * viewport[3];
+  freeQueries.pop_back();
+  glBeginQuery(GL_SAMPLES_PASSED, counting.query);
+}
+
+void endOverdrawCount() {
+  glEndQuery(GL_SAMPLES_PASSED);
+  endedCounts.push_back(counting);
+}
+
+double overdraw() {
+  // The GPU finishes the queries in the order they were ended, so stop
+  // at the first one that is not ready.
+  while (!endedCounts.empty()) {
+    const OverdrawCount &count = endedCounts.front();
+    GLint available = 0;
+    glGetQueryObjectiv(count.query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+      break;
+
+    GLuint64 samples;
+    glGetQueryObjectui64v(count.query, GL_QUERY_RESULT, &samples);
+    profileCounter("shaded fragments", (long long) samples);
+    lastOverdraw = (count.pixels > 0) ? samples / count.pixels : 0;
+
+    freeQueries.push_back(count.query);
+    endedCounts.pop_front();
+  }
+  return lastOverdraw;
+}
@@ -0,0 +1,25 @@
+#pragma once
+/*
+ * Counting how many fragments are shaded per pixel.
+ *
+ * A GL_SAMPLES_PASSED query around the shading of a frame counts the
+ * fragments that passed the depth test, which, as the depth test runs
+ * before the fragment shader, are the fragments shaded. Divided by the
+ * pixels in the viewport that is the frame's overdraw: 1 if every pixel
+ * was shaded exactly once. Results are read once the GPU has them,
+ * without waiting, so they arrive a frame or more after the frame.
+ */
+
+/*
+ * Bracket what a frame shades. Only the thread with the context may call
+ * these, and the counts may not nest.
+ */
+void beginOverdrawCount();
+void endOverdrawCount();
+
+/*
+ * The average fragments shaded per pixel by the last frame counted whose
+ * count has come in, or -1 if none has yet. Also records the fragments
+ * shaded as the profile counter "shaded fragments".
+ */
+double overdraw();
@@ -0,0 +1,54 @@
+#pragma once
+/*
+ * Platform header.
+ *
+ * On Windows this simply pulls in Windows.h, which the OpenGL headers
+ * depend on and which provides the bitmap file structures used by the
+ * texture loader.
+ *
+ * Elsewhere (the headless Linux benchmark machines) it supplies the
+ * handful of Windows definitions the program relies on.
+ */
+
+#ifdef _WIN32
+
+#include <Windows.h>
+
+#else
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+
+// Bitmap file header, laid out exactly as it is stored on disk.
+#pragma pack(push, 2)
+typedef struct {
+  uint16_t bfType;
+  uint32_t bfSize;
+  uint16_t bfReserved1;
+  uint16_t bfReserved2;
+  uint32_t bfOffBits;
+} BITMAPFILEHEADER;
+#pragma pack(pop)
+
+// Bitmap info header, laid out exactly as it is stored on disk.
+typedef struct {
+  uint32_t biSize;
+  int32_t  biWidth;
+  int32_t  biHeight;
+  uint16_t biPlanes;
+  uint16_t biBitCount;
+  uint32_t biCompression;
+  uint32_t biSizeImage;
+  int32_t  biXPelsPerMeter;
+  int32_t  biYPelsPerMeter;
+  uint32_t biClrUsed;
+  uint32_t biClrImportant;
+} BITMAPINFOHEADER;
+
+inline int fopen_s(FILE **file, const char *filename, const char *mode) {
+  *file = fopen(filename, mode);
+  return (*file == NULL) ? errno : 0;
+}
+
+#endif // _WIN32
@@ -0,0 +1,229 @@
+/*
+ * The frame profiler. See profiler.h.
+ */
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <vector>
+#include "glFunctions.h"
+#include "profiler.h"
+
+using namespace std;
+
+/*
+ * One timed scope. Written like a seqlock: written is 0 while the other
+ * fields change, then the position of the event in the sequence of all
+ * events plus one, so a reader can tell a complete event from one being
+ * overwritten.
+ */
+struct ProfileEvent {
+  const char *name;
+  int thread;                         // 0 for the GPU, -1 for a counter.
+  int64_t start;                      // Nanoseconds since startProfiling.
+  int64_t duration;                   // Or a counter's value.
+  atomic<uint64_t> written;
+};
+
+// The most recent RING_SIZE events; event n is at events[n % RING_SIZE].
+static const uint64_t RING_SIZE = 1 << 16;
+static ProfileEvent events[RING_SIZE];
+static atomic<uint64_t> eventCount(0);
+
+static atomic<bool> recording(false);
+static chrono::steady_clock::time_point origin;
+
+// Threads are numbered from 1 in the order they first record anything,
+// so the thread that starts profiling is 1.
+static atomic<int> threadCount(0);
+static thread_local int profileThread = 0;
+
+/*
+ * A pair of GL_TIMESTAMP queries around a GPU scope. Only the thread
+ * with the context touches these.
+ */
+struct GpuTiming {
+  const char *name;
+  GLuint queries[2];
+};
+
+static vector<GpuTiming> gpuTimings;
+static vector<int> freeTimings;
+static deque<int> endedTimings;       // In the order they were ended.
+
+// Added to a GPU timestamp to put it on the CPU's timeline.
+static bool calibrated = false;
+static int64_t gpuOffset = 0;
+
+static int64_t now() {
+  return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - origin).count();
+}
+
+static int currentThread() {
+  if (profileThread == 0)
+    profileThread = ++threadCount;
+  return profileThread;
+}
+
+static void record(const char *name, int thread, int64_t start, int64_t duration) {
+  uint64_t index = eventCount.fetch_add(1, memory_order_relaxed);
+  ProfileEvent &event = events[index % RING_SIZE];
+  event.written.store(0, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  event.name = name;
+  event.thread = thread;
+  event.start = start;
+  event.duration = duration;
+  event.written.store(index + 1, memory_order_release);
+}
+
+static int beginGpuTiming(const char *name) {
+  if (!calibrated) {
+    GLint64 gpuNow;
+    glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+    gpuOffset = now() - gpuNow;
+    calibrated = true;
+  }
+
+  int index;
+  if (freeTimings.empty()) {
+    GpuTiming timing;
+    glGenQueries(2, timing.queries);
+    index = (int) gpuTimings.size();
+    gpuTimings.push_back(timing);
+  } else {
+    index = freeTimings.back();
+    freeTimings.pop_back();
+  }
+  gpuTimings[index].name = name;
+  glQueryCounter(gpuTimings[index].queries[0], GL_TIMESTAMP);
+  return index;
+}
+
+static void endGpuTiming(int index) {
+  glQueryCounter(gpuTimings[index].queries[1], GL_TIMESTAMP);
+  endedTimings.push_back(index);
+}
+
+/*
+ * Record the GPU timings that have finished, or with wait all of them.
+ * The GPU finishes them in the order they were ended, so stop at the
+ * first one that is not ready.
+ */
+static void collectGpuTimings(bool wait) {
+  while (!endedTimings.empty()) {
+    int index = endedTimings.front();
+    const GpuTiming &timing = gpuTimings[index];
+    if (!wait) {
+      GLint available = 0;
+      glGetQueryObjectiv(timing.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available)
+        break;
+    }
+
+    GLuint64 begin, end;
+    glGetQueryObjectui64v(timing.queries[0], GL_QUERY_RESULT, &begin);
+    glGetQueryObjectui64v(timing.queries[1], GL_QUERY_RESULT, &end);
+    record(timing.name, 0, (int64_t) begin + gpuOffset, (int64_t) (end - begin));
+
+    endedTimings.pop_front();
+    freeTimings.push_back(index);
+  }
+}
+
+void startProfiling() {
+  if (recording)
+    return;
+  origin = chrono::steady_clock::now();
+  currentThread();
+  recording.store(true, memory_order_release);
+}
+
+bool profiling() {
+  return recording.load(memory_order_acquire);
+}
+
+void profileFrame() {
+  if (profiling())
+    collectGpuTimings(false);
+}
+
+void profileCounter(const char *name, long long value) {
+  if (profiling())
+    record(name, -1, now(), value);
+}
+
+bool writeProfile(const string &filename, bool gpu) {
+  if (gpu)
+    collectGpuTimings(true);
+
+  FILE *out = NULL;
+  fopen_s(&out, filename.c_str(), "w");
+  if (out == NULL) {
+    cerr << "Cannot write the profile to " << filename << endl;
+    return false;
+  }
+
+  fprintf(out, "{\"traceEvents\": [\n");
+  fprintf(out, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"GPU\"}}");
+  int threads = threadCount;
+  for (int thread = 1; thread <= threads; thread++) {
+    char threadName[32];
+    if (thread == 1)
+      snprintf(threadName, sizeof(threadName), "main");
+    else
+      snprintf(threadName, sizeof(threadName), "thread %d", thread);
+    fprintf(out, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+            "\"args\": {\"name\": \"%s\"}}", thread, threadName);
+  }
+
+  // Copy each event out and keep it only if it was not being written to
+  // meanwhile.
+  uint64_t count = eventCount.load(memory_order_acquire);
+  uint64_t first = (count > RING_SIZE) ? count - RING_SIZE : 0;
+  for (uint64_t i = first; i < count; i++) {
+    const ProfileEvent &event = events[i % RING_SIZE];
+    if (event.written.load(memory_order_acquire) != i + 1)
+      continue;
+    const char *name = event.name;
+    int thread = event.thread;
+    int64_t start = event.start;
+    int64_t duration = event.duration;
+    atomic_thread_fence(memory_order_acquire);
+    if (event.written.load(memory_order_relaxed) != i + 1)
+      continue;
+
+    // Chrome traces are in microseconds.
+    if (thread < 0) {
+      fprintf(out, ",\n{\"name\": \"%s\", \"ph\": \"C\", \"pid\": 1, \"ts\": %.3f, "
+              "\"args\": {\"value\": %lld}}", name, start / 1000.0, (long long) duration);
+      continue;
+    }
+    fprintf(out, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+            "\"ts\": %.3f, \"dur\": %.3f}", name, thread == 0 ? "gpu" : "cpu", thread,
+            start / 1000.0, duration / 1000.0);
+  }
+  fprintf(out, "\n],\n\"displayTimeUnit\": \"ms\"}\n");
+  fclose(out);
+
+  cerr << "Wrote the profile to " << filename << endl;
+  return true;
+}
+
+ProfileScope::ProfileScope(const char *name, bool gpu) : name(name), start(-1), query(-1) {
+  if (!profiling())
+    return;
+  if (gpu)
+    query = beginGpuTiming(name);
+  start = now();
+}
+
+ProfileScope::~ProfileScope() {
+  if (start < 0)
+    return;
+  record(name, currentThread(), start, now() - start);
+  if (query >= 0)
+    endGpuTiming(query);
+}
@@ -0,0 +1,63 @@
+#pragma once
+/*
+ * Frame profiler.
+ *
+ * A ProfileScope times the block it is declared in on the CPU and, if
+ * asked, on the GPU too, with a pair of GL_TIMESTAMP queries read back a
+ * few frames later once the GPU has got that far. The timings go into a
+ * fixed size ring of the most recent events, which any thread can add to
+ * without locking, and writeProfile() saves the ring as a Chrome trace
+ * (load it in chrome://tracing or ui.perfetto.dev), with the GPU as a
+ * thread of its own.
+ *
+ * Nothing is recorded until startProfiling(), and until then a scope
+ * costs one test of a flag.
+ */
+#include <string>
+
+/*
+ * Start recording. Scopes that time the GPU need a current context, but
+ * profiling itself may start before there is one.
+ */
+void startProfiling();
+
+bool profiling();
+
+/*
+ * Collect the GPU timings that have finished. Call once a frame from the
+ * thread with the context.
+ */
+void profileFrame();
+
+/*
+ * Record the value of a counter at this moment; the trace graphs each
+ * counter on a track of its own.
+ */
+void profileCounter(const char *name, long long value);
+
+/*
+ * Write the recorded events as Chrome trace_event JSON. With gpu, first
+ * wait for the GPU timings still outstanding, which needs the context
+ * current; without it they are left out. Returns false, after saying
+ * why, if the file cannot be written.
+ */
+bool writeProfile(const std::string &filename, bool gpu);
+
+/*
+ * Times from its construction to the end of the enclosing block. name
+ * must outlive the profile, e.g. a string literal. gpu scopes may nest,
+ * but only on the thread with the context.
+ */
+class ProfileScope {
+public:
+  explicit ProfileScope(const char *name, bool gpu = false);
+  ~ProfileScope();
+
+private:
+  ProfileScope(const ProfileScope &);
+  ProfileScope &operator=(const ProfileScope &);
+
+  const char *name;
+  long long start;        // Nanoseconds since startProfiling, or -1.
+  int query;              // The index of the GPU query pair, or -1.
+};
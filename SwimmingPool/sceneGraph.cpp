@@ -0,0 +1,46 @@
+/*
+ * Transform hierarchy. See sceneGraph.h.
+ */
+#include <cassert>
+#include "sceneGraph.h"
+
+int SceneGraph::addNode(int parent, const matrix4 &local) {
+  assert(parent < (int) nodes.size());
+  SceneNode node;
+  node.parent = parent;
+  node.local = local;
+  node.dirty = true;
+  node.moved = false;
+  nodes.push_back(node);
+  dirty = true;
+  return (int) nodes.size() - 1;
+}
+
+void SceneGraph::setLocal(int node, const matrix4 &local) {
+  nodes[node].local = local;
+  nodes[node].dirty = true;
+  dirty = true;
+}
+
+bool SceneGraph::updateWorld() {
+  // Nothing to compute, and no moved flags to clear.
+  if (!dirty && !anyMoved)
+    return false;
+
+  anyMoved = false;
+  for (SceneNode &node : nodes) {
+    // Parents come first, so the parent's moved flag is already
+    // the one for this update.
+    bool parentMoved = (node.parent >= 0) && nodes[node.parent].moved;
+    node.moved = node.dirty || parentMoved;
+    node.dirty = false;
+
+    if (node.moved) {
+      node.world = (node.parent >= 0) ? nodes[node.parent].world.multiply(node.local) : node.local;
+      anyMoved = true;
+    }
+  }
+
+  dirty = false;
+  return anyMoved;
+}
@@ -0,0 +1,60 @@
+#pragma once
+/*
+ * A transform hierarchy for the objects placed in the scene.
+ *
+ * Every node has a transform relative to its parent and caches its world
+ * matrix, the product of its ancestors' transforms and its own. Nodes are
+ * kept in one array with every parent before its children, so bringing
+ * the world matrices up to date is a single pass over the array that only
+ * recomputes nodes below one whose transform changed. While nothing moves,
+ * updateWorld returns straight away.
+ */
+#include <vector>
+#include "matrix4.h"
+
+/*
+ * A translation, rotation (angle in degrees about an axis) and scale,
+ * applied to a point in the opposite order: scaled, then rotated, then
+ * translated, like matrix4().translate().rotate().scale().
+ */
+struct Transform {
+  vector3 translation = vector3(0, 0, 0);
+  float angle = 0;
+  vector3 axis = vector3(0, 1, 0);
+  vector3 scale = vector3(1, 1, 1);
+
+  matrix4 matrix() const {
+    return matrix4().translate(translation.x, translation.y, translation.z)
+                    .rotate(angle, axis.x, axis.y, axis.z)
+                    .scale(scale.x, scale.y, scale.z);
+  }
+};
+
+struct SceneNode {
+  int parent;                         // Index of the parent node, -1 for none.
+  matrix4 local;                      // Relative to the parent.
+  matrix4 world;                      // Cached by updateWorld.
+  bool dirty;                         // local changed since the last update.
+  bool moved;                         // world changed in the last update.
+};
+
+struct SceneGraph {
+  std::vector<SceneNode> nodes;
+  bool dirty = false;                 // Some node is dirty.
+  bool anyMoved = false;              // Some node moved in the last update.
+
+  // Add a node below parent (-1 for a root) and return its index.
+  int addNode(int parent, const matrix4 &local);
+  int addNode(int parent, const Transform &local) { return addNode(parent, local.matrix()); }
+
+  // Move a node; it and its descendants are recomputed by the next update.
+  void setLocal(int node, const matrix4 &local);
+  void setLocal(int node, const Transform &local) { setLocal(node, local.matrix()); }
+
+  const matrix4 &world(int node) const { return nodes[node].world; }
+  bool moved(int node) const { return nodes[node].moved; }
+
+  // Recompute the world matrices of the dirty nodes and their descendants,
+  // setting moved on exactly those nodes. Returns true if any moved.
+  bool updateWorld();
+};
@@ -0,0 +1,511 @@
+/*
+ * The scene's shaders. See sceneShader.h.
+ */
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include "sceneShader.h"
+#include "shader.h"
+
+using namespace std;
+
+/*
+ * Both stages of every program. Compiled with VERTEX_SHADER or
+ * FRAGMENT_SHADER defined, TEXTURED, LIT_TEXTURE, EMISSIVE, SPECULAR and
+ * INSTANCED for the features the program has, LIGHTING if it lights the
+ * color at all, PER_PIXEL to light by the clusters and fog each fragment
+ * rather than each vertex, and DEPTH_ONLY or OVERDRAW for shading other
+ * than SceneShaded. The position is invariant so that every program puts
+ * a surface at exactly the same depth, as a depth pre-pass needs.
+ */
+static const char *sceneShaderSource =
+  "struct Light {\n"
+  "  vec4 position;\n"
+  "  vec4 spotDirection;         // Normalized.\n"
+  "  vec4 ambient;\n"
+  "  vec4 diffuse;\n"
+  "  vec4 specular;\n"
+  "  vec4 spot;                  // cos(cutoff) or -2 for none, exponent, enabled.\n"
+  "};\n"
+  "\n"
+  "struct Material {\n"
+  "  vec4 specular;\n"
+  "  vec4 emission;\n"
+  "  vec4 shininess;\n"
+  "};\n"
+  "\n"
+  "layout(std140) uniform SceneUniforms {\n"
+  "  Light lights[3];\n"
+  "  Material materials[3];\n"
+  "  vec4 ambient;\n"
+  "  vec4 fogColor;\n"
+  "  vec4 fogDensity;\n"
+  "  vec4 clusterTiles;          // Tile scale and bias, see ClusterMapping.\n"
+  "  vec4 clusterSlices;         // Slice scale and bias.\n"
+  "  vec4 lightCounts;           // Enabled lights, cluster entries.\n"
+  "};\n"
+  "\n"
+  "// GL_EXP2 fog by the distance along the view direction.\n"
+  "float fogAt(vec3 eyePosition) {\n"
+  "  float f = fogDensity.x * eyePosition.z;\n"
+  "  return clamp(exp2(-1.442695 * f * f), 0.0, 1.0);\n"
+  "}\n"
+  "\n"
+  "#ifdef LIGHTING\n"
+  "\n"
+  "uniform int material;\n"
+  "uniform usamplerBuffer clusterGrid;\n"
+  "uniform usamplerBuffer clusterIndices;\n"
+  "uniform samplerBuffer clusterLights;\n"
+  "\n"
+  "// The specular factor of a light from toLight, seen from along z.\n"
+  "float highlight(Material m, vec3 normal, vec3 toLight) {\n"
+  "  float facing = max(dot(normal, normalize(toLight + vec3(0.0, 0.0, 1.0))), 0.0);\n"
+  "  return (m.shininess.x == 1.0) ? facing : pow(facing, m.shininess.x);\n"
+  "}\n"
+  "\n"
+  "// A surface of color lit by the ambient light and the spot lights, or\n"
+  "// for an emissive material its emission and the ambient light alone.\n"
+  "vec3 spotLit(Material m, vec3 eyePosition, vec3 normal, vec3 color) {\n"
+  "  vec3 lit = m.emission.rgb + color * ambient.rgb;\n"
+  "#ifndef EMISSIVE\n"
+  "  for (int i = 0; i < int(lightCounts.x); i++) {\n"
+  "    Light light = lights[i];\n"
+  "    vec3 toLight = normalize(light.position.xyz - light.position.w * eyePosition);\n"
+  "    float spot = 1.0;\n"
+  "    if (light.spot.x > -1.5) {\n"
+  "      float spotDot = dot(-toLight, light.spotDirection.xyz);\n"
+  "      if (spotDot < light.spot.x)\n"
+  "        continue;\n"
+  "      spot = (light.spot.y == 1.0) ? spotDot : pow(max(spotDot, 0.0), light.spot.y);\n"
+  "    }\n"
+  "    float diffuse = max(dot(normal, toLight), 0.0);\n"
+  "    vec3 reflected = color * (light.ambient.rgb + diffuse * light.diffuse.rgb);\n"
+  "#ifdef SPECULAR\n"
+  "    if (diffuse > 0.0)\n"
+  "      reflected += highlight(m, normal, toLight) * m.specular.rgb * light.specular.rgb;\n"
+  "#endif\n"
+  "    lit += spot * reflected;\n"
+  "  }\n"
+  "#endif\n"
+  "  return lit;\n"
+  "}\n"
+  "\n"
+  "// What the lights of the cluster at tile, which fade out to nothing at\n"
+  "// their radius, add to that. Nothing at all when no cluster has any.\n"
+  "vec3 clusterLit(Material m, vec3 eyePosition, vec3 normal, vec3 color, ivec2 tile) {\n"
+  "  vec3 lit = vec3(0.0);\n"
+  "#ifndef EMISSIVE\n"
+  "  if (lightCounts.y == 0.0)\n"
+  "    return lit;\n"
+  "  int slice = clamp(int(log(-eyePosition.z) * clusterSlices.x + clusterSlices.y), 0, CLUSTER_SLICES - 1);\n"
+  "  uvec2 range = texelFetch(clusterGrid, (slice * CLUSTER_TILES + tile.y) * CLUSTER_TILES + tile.x).xy;\n"
+  "  for (uint i = range.x; i < range.x + range.y; i++) {\n"
+  "    int index = 3 * int(texelFetch(clusterIndices, int(i)).x);\n"
+  "    vec4 position = texelFetch(clusterLights, index);\n"
+  "    vec3 toLight = position.xyz - eyePosition;\n"
+  "    float distance = length(toLight);\n"
+  "    if (distance >= position.w)\n"
+  "      continue;\n"
+  "    toLight /= distance;\n"
+  "    vec4 colorCutoff = texelFetch(clusterLights, index + 1);\n"
+  "    float strength = (1.0 - distance / position.w) * (1.0 - distance / position.w);\n"
+  "    if (colorCutoff.w > -1.5) {\n"
+  "      vec4 spotDirection = texelFetch(clusterLights, index + 2);\n"
+  "      float spotDot = dot(-toLight, spotDirection.xyz);\n"
+  "      if (spotDot < colorCutoff.w)\n"
+  "        continue;\n"
+  "      strength *= pow(spotDot, spotDirection.w);\n"
+  "    }\n"
+  "    float diffuse = max(dot(normal, toLight), 0.0);\n"
+  "    vec3 reflected = diffuse * color;\n"
+  "#ifdef SPECULAR\n"
+  "    if (diffuse > 0.0)\n"
+  "      reflected += highlight(m, normal, toLight) * m.specular.rgb;\n"
+  "#endif\n"
+  "    lit += strength * colorCutoff.rgb * reflected;\n"
+  "  }\n"
+  "#endif\n"
+  "  return lit;\n"
+  "}\n"
+  "\n"
+  "#endif\n"
+  "\n"
+  "#ifdef VERTEX_SHADER\n"
+  "\n"
+  "#ifdef INSTANCED\n"
+  "layout(location = 10) in mat4 instanceMatrix;\n"
+  "layout(location = 14) in vec4 instanceColor;\n"
+  "#endif\n"
+  "\n"
+  "#ifdef PER_PIXEL\n"
+  "out vec3 eyePosition;\n"
+  "out vec3 eyeNormal;\n"
+  "out vec3 spotLight;           // The color lit by the spot lights.\n"
+  "#else\n"
+  "out float fog;\n"
+  "#endif\n"
+  "out vec4 color;\n"
+  "out vec2 texCoord;\n"
+  "invariant gl_Position;\n"
+  "\n"
+  "void main() {\n"
+  "#ifdef INSTANCED\n"
+  "  vec4 position = gl_ModelViewMatrix * (instanceMatrix * gl_Vertex);\n"
+  "  // The inverse transpose of m, up to a positive scale.\n"
+  "  mat3 m = mat3(gl_ModelViewMatrix) * mat3(instanceMatrix);\n"
+  "  vec3 normal = mat3(cross(m[1], m[2]), cross(m[2], m[0]), cross(m[0], m[1])) * gl_Normal;\n"
+  "  color = instanceColor;\n"
+  "#else\n"
+  "  vec4 position = gl_ModelViewMatrix * gl_Vertex;\n"
+  "  vec3 normal = gl_NormalMatrix * gl_Normal;\n"
+  "  color = gl_Color;\n"
+  "#endif\n"
+  "  texCoord = gl_MultiTexCoord0.st;\n"
+  "  gl_Position = gl_ProjectionMatrix * position;\n"
+  "#ifdef PER_PIXEL\n"
+  "  eyePosition = position.xyz;\n"
+  "#else\n"
+  "  fog = fogAt(position.xyz);\n"
+  "#endif\n"
+  "\n"
+  "#ifdef LIGHTING\n"
+  "  normal = normalize(normal);\n"
+  "  vec3 lit = clamp(spotLit(materials[material], position.xyz, normal, color.rgb), 0.0, 1.0);\n"
+  "#ifdef PER_PIXEL\n"
+  "  // Only flat surfaces are lit per fragment, so the normal stays the\n"
+  "  // same length across them.\n"
+  "  eyeNormal = normal;\n"
+  "  spotLight = lit;\n"
+  "#else\n"
+  "  // The tile the vertex falls in, or the nearest one to it.\n"
+  "  vec2 device = gl_Position.xy / max(gl_Position.w, 1e-6);\n"
+  "  ivec2 tile = ivec2(clamp((device + 1.0) * (0.5 * CLUSTER_TILES), 0.0, CLUSTER_TILES - 1.0));\n"
+  "  vec3 cluster = clusterLit(materials[material], position.xyz, normal, color.rgb, tile);\n"
+  "  color.rgb = clamp(lit + cluster, 0.0, 1.0);\n"
+  "#endif\n"
+  "#endif\n"
+  "}\n"
+  "\n"
+  "#else\n"
+  "\n"
+  "uniform sampler2D image;\n"
+  "\n"
+  "#ifdef PER_PIXEL\n"
+  "in vec3 eyePosition;\n"
+  "in vec3 eyeNormal;\n"
+  "in vec3 spotLight;\n"
+  "#else\n"
+  "in float fog;\n"
+  "#endif\n"
+  "in vec4 color;\n"
+  "in vec2 texCoord;\n"
+  "out vec4 fragColor;\n"
+  "\n"
+  "void main() {\n"
+  "#if defined(DEPTH_ONLY)\n"
+  "  // Only the depth is wanted.\n"
+  "#elif defined(OVERDRAW)\n"
+  "  fragColor = vec4(0.125, 0.0625, 0.03125, 0.0);\n"
+  "#else\n"
+  "#if defined(LIGHTING) && defined(PER_PIXEL)\n"
+  "  ivec2 tile = clamp(ivec2(gl_FragCoord.xy * clusterTiles.xy + clusterTiles.zw), 0, CLUSTER_TILES - 1);\n"
+  "  vec3 cluster = clusterLit(materials[material], eyePosition, eyeNormal, color.rgb, tile);\n"
+  "  vec3 lit = clamp(spotLight + cluster, 0.0, 1.0);\n"
+  "#else\n"
+  "  vec3 lit = color.rgb;\n"
+  "#endif\n"
+  "#if defined(TEXTURED)\n"
+  "  vec4 result = vec4(texture(image, texCoord).rgb, 0.0);\n"
+  "#elif defined(LIT_TEXTURE)\n"
+  "  // What the blend function made of the lit color over the texture.\n"
+  "  vec4 result = vec4(mix(lit, texture(image, texCoord).rgb, color.a), 0.0);\n"
+  "#else\n"
+  "  vec4 result = vec4(lit, color.a);\n"
+  "#endif\n"
+  "#ifdef PER_PIXEL\n"
+  "  float fog = fogAt(eyePosition);\n"
+  "#endif\n"
+  "  fragColor = vec4(mix(fogColor.rgb, result.rgb, fog), result.a);\n"
+  "#endif\n"
+  "}\n"
+  "\n"
+  "#endif\n";
+
+static SceneBlock block;
+static GLuint uniformBuffer = 0;
+static bool changed = true;
+static bool emissive[SCENE_MATERIALS];
+static bool specular[SCENE_MATERIALS];
+
+// The lights as set. The block has them with the enabled lights that
+// differ only in color merged into one, first.
+static SceneLightBlock lights[SCENE_LIGHTS];
+
+// A program for each combination of SceneShaderFlags, EMISSIVE and
+// SPECULAR, and for the other shadings of plain and instanced geometry.
+static const int EMISSIVE = 16;
+static const int SPECULAR = 32;
+static const int DEPTH_ONLY = 64;
+static const int OVERDRAW = 128;
+static const int PROGRAM_COUNT = 256;
+
+struct SceneProgram {
+  GLuint program;
+  GLint materialLocation;
+  int material;               // The material it was last given.
+};
+
+static SceneProgram programs[PROGRAM_COUNT];
+static int usedProgram = -1;
+static int usedFlags = -1;
+static SceneMaterial usedMaterial = DefaultMaterial;
+static SceneShading usedShading = SceneShaded;
+
+/*
+ * The program to draw geometry with flags with in material. Only shaded
+ * programs look at the material, and a textured one ignores it, so is
+ * never emissive, nor lit. An emissive one has no lights to reflect.
+ */
+static int programFeatures(int flags, SceneShading shading, SceneMaterial material) {
+  if (shading == SceneDepthOnly)
+    return (flags & SceneInstanced) | DEPTH_ONLY;
+  if (shading == SceneOverdraw)
+    return (flags & SceneInstanced) | OVERDRAW;
+  if (flags & SceneTextured)
+    return flags & ~SceneLitTexture;
+  if (emissive[material])
+    return flags | EMISSIVE;
+  return specular[material] ? flags | SPECULAR : flags;
+}
+
+static SceneProgram makeSceneProgram(int features) {
+  string defines = "#version 330 compatibility\n";
+  defines += "#define CLUSTER_TILES " + to_string(CLUSTER_TILES) + "\n";
+  defines += "#define CLUSTER_SLICES " + to_string(CLUSTER_SLICES) + "\n";
+  if (features & SceneTextured)
+    defines += "#define TEXTURED\n";
+  else if (!(features & (DEPTH_ONLY | OVERDRAW)))
+    defines += "#define LIGHTING\n";
+  if (features & ScenePerPixel)
+    defines += "#define PER_PIXEL\n";
+  if (features & SceneLitTexture)
+    defines += "#define LIT_TEXTURE\n";
+  if (features & SceneInstanced)
+    defines += "#define INSTANCED\n";
+  if (features & EMISSIVE)
+    defines += "#define EMISSIVE\n";
+  if (features & SPECULAR)
+    defines += "#define SPECULAR\n";
+  if (features & DEPTH_ONLY)
+    defines += "#define DEPTH_ONLY\n";
+  if (features & OVERDRAW)
+    defines += "#define OVERDRAW\n";
+
+  string vertexSource = defines + "#define VERTEX_SHADER\n" + sceneShaderSource;
+  string fragmentSource = defines + "#define FRAGMENT_SHADER\n" + sceneShaderSource;
+  GLuint vertexShader = compileShader(GL_VERTEX_SHADER, vertexSource.c_str(), "scene vertex");
+  GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentSource.c_str(), "scene fragment");
+
+  SceneProgram p;
+  p.program = linkProgram(vertexShader, fragmentShader, "scene");
+  glUniformBlockBinding(p.program, glGetUniformBlockIndex(p.program, "SceneUniforms"), 0);
+  p.materialLocation = glGetUniformLocation(p.program, "material");
+  glUseProgram(p.program);
+  glUniform1i(glGetUniformLocation(p.program, "clusterGrid"), CLUSTER_GRID_UNIT);
+  glUniform1i(glGetUniformLocation(p.program, "clusterIndices"), CLUSTER_INDEX_UNIT);
+  glUniform1i(glGetUniformLocation(p.program, "clusterLights"), CLUSTER_LIGHT_UNIT);
+  p.material = DefaultMaterial;
+  return p;
+}
+
+/*
+ * Make the programs the materials as set now may draw with, if they
+ * have not been made yet.
+ */
+static void makeScenePrograms() {
+  int allFlags = SceneTextured | SceneInstanced | SceneLitTexture | ScenePerPixel;
+  for (int flags = 0; flags <= allFlags; flags++) {
+    for (int shading = SceneShaded; shading <= SceneOverdraw; shading++) {
+      for (int material = 0; material < SCENE_MATERIALS; material++) {
+        int features = programFeatures(flags, (SceneShading) shading, (SceneMaterial) material);
+        if (programs[features].program == 0)
+          programs[features] = makeSceneProgram(features);
+      }
+    }
+  }
+  glUseProgram(usedProgram >= 0 ? programs[usedProgram].program : 0);
+}
+
+void createSceneShader() {
+  makeScenePrograms();
+
+  glGenBuffers(1, &uniformBuffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, uniformBuffer);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(block), &block, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  glBindBufferBase(GL_UNIFORM_BUFFER, 0, uniformBuffer);
+  changed = true;
+}
+
+void setSceneLight(int index, const SceneLight &light) {
+  SceneLightBlock &l = lights[index];
+  copy(light.position, light.position + 4, l.position);
+  // The shader wants the direction normalized, as GL normalizes it.
+  float length = sqrt(light.spotDirection[0] * light.spotDirection[0] +
+                      light.spotDirection[1] * light.spotDirection[1] +
+                      light.spotDirection[2] * light.spotDirection[2]);
+  for (int i = 0; i < 3; i++)
+    l.spotDirection[i] = light.spotDirection[i] / length;
+  copy(light.ambient, light.ambient + 4, l.ambient);
+  copy(light.diffuse, light.diffuse + 4, l.diffuse);
+  copy(light.specular, light.specular + 4, l.specular);
+  // A cutoff of 180 degrees is no spot at all.
+  l.spot[0] = (light.spotCutoff >= 180.0f) ? -2.0f : (float) cos(light.spotCutoff * 3.1415926536 / 180.0);
+  l.spot[1] = light.spotExponent;
+  changed = true;
+}
+
+void setSceneLightEnabled(int index, bool enabled) {
+  lights[index].spot[2] = enabled ? 1.0f : 0.0f;
+  changed = true;
+}
+
+void setSceneAmbient(const float ambient[4]) {
+  copy(ambient, ambient + 4, block.ambient);
+  changed = true;
+}
+
+void setSceneMaterial(SceneMaterial material, const SceneMaterialProperties &properties) {
+  SceneMaterialBlock &m = block.materials[material];
+  copy(properties.specular, properties.specular + 4, m.specular);
+  copy(properties.emission, properties.emission + 4, m.emission);
+  m.shininess[0] = properties.shininess;
+  emissive[material] = properties.emissive;
+  specular[material] = properties.specular[0] != 0 || properties.specular[1] != 0 || properties.specular[2] != 0;
+  changed = true;
+  // Once the programs exist, any the material now needs is made.
+  if (uniformBuffer != 0)
+    makeScenePrograms();
+}
+
+void setSceneFog(const float color[4], float density) {
+  copy(color, color + 4, block.fogColor);
+  block.fogDensity[0] = density;
+  changed = true;
+}
+
+void setSceneClusterMapping(const ClusterMapping &mapping) {
+  copy(mapping.tileScale, mapping.tileScale + 2, block.clusterTiles);
+  copy(mapping.tileBias, mapping.tileBias + 2, block.clusterTiles + 2);
+  block.clusterSlices[0] = mapping.sliceScale;
+  block.clusterSlices[1] = mapping.sliceBias;
+  changed = true;
+}
+
+void setSceneClusterEntries(int entries) {
+  if (block.lightCounts[1] == (float) entries)
+    return;
+  block.lightCounts[1] = (float) entries;
+  changed = true;
+}
+
+/*
+ * Whether two lights light a surface the same but for their colors.
+ */
+static bool samePlace(const SceneLightBlock &a, const SceneLightBlock &b) {
+  return equal(a.position, a.position + 4, b.position) &&
+         equal(a.spotDirection, a.spotDirection + 3, b.spotDirection) &&
+         a.spot[0] == b.spot[0] && a.spot[1] == b.spot[1];
+}
+
+/*
+ * Put the enabled lights in the block, adding the colors of each light
+ * in the same place as one before it to that one, since what a light
+ * reflects is in proportion to its colors.
+ */
+static void mergeSceneLights() {
+  int count = 0;
+  for (const SceneLightBlock &light : lights) {
+    if (light.spot[2] == 0.0f)
+      continue;
+    int i = 0;
+    while (i < count && !samePlace(block.lights[i], light))
+      i++;
+    SceneLightBlock &merged = block.lights[i];
+    if (i == count) {
+      merged = light;
+      count++;
+      continue;
+    }
+    for (int c = 0; c < 4; c++) {
+      merged.ambient[c] += light.ambient[c];
+      merged.diffuse[c] += light.diffuse[c];
+      merged.specular[c] += light.specular[c];
+    }
+  }
+  for (int i = count; i < SCENE_LIGHTS; i++)
+    block.lights[i] = SceneLightBlock();
+  block.lightCounts[0] = (float) count;
+}
+
+void updateSceneShader() {
+  if (!changed)
+    return;
+  mergeSceneLights();
+  glBindBuffer(GL_UNIFORM_BUFFER, uniformBuffer);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(block), &block);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  changed = false;
+}
+
+/*
+ * Bind the program for the flags and material in use, and give it the
+ * material if it does not have it already.
+ */
+static void applySceneShader() {
+  if (usedFlags < 0)
+    return;
+
+  int features = programFeatures(usedFlags, usedShading, usedMaterial);
+  SceneProgram &p = programs[features];
+  if (features != usedProgram) {
+    glUseProgram(p.program);
+    usedProgram = features;
+  }
+  if (p.material != usedMaterial) {
+    glUniform1i(p.materialLocation, usedMaterial);
+    p.material = usedMaterial;
+  }
+}
+
+void useSceneShader(int flags) {
+  usedFlags = flags;
+  applySceneShader();
+}
+
+void useSceneMaterial(SceneMaterial material) {
+  usedMaterial = material;
+  applySceneShader();
+}
+
+void setSceneShading(SceneShading shading) {
+  usedShading = shading;
+  applySceneShader();
+}
+
+SceneShading sceneShading() {
+  return usedShading;
+}
+
+SceneMaterial sceneMaterial() {
+  return usedMaterial;
+}
+
+const SceneBlock &sceneUniforms() {
+  return block;
+}
+
+bool sceneMaterialEmissive(SceneMaterial material) {
+  return emissive[material];
+}
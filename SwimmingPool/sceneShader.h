@@ -0,0 +1,170 @@
+#pragma once
+/*
+ * The scene's shaders: lighting and fog in place of the fixed function
+ * pipeline.
+ *
+ * One source is compiled into a program per combination of features.
+ * Untextured surfaces are lit by the spot lights with the fixed function
+ * lighting equation under GL_COLOR_MATERIAL (the color is the ambient
+ * and diffuse material), with a non-local viewer and one sided lighting,
+ * and then by the lights of their cluster (see lightClusters.h), which
+ * have no ambient part. Textured surfaces take their color straight from
+ * the texture and an alpha of 0 (opaque under the scene's blend
+ * function), as the GL_REPLACE texture environment did, unless they are
+ * lit through a layer of their color (see SceneLitTexture). Surfaces with
+ * an emissive material show their emission and the ambient light,
+ * without the spot lights. Everything is then fogged like GL_EXP2 fog.
+ *
+ * Surfaces are lit by the spot lights at their vertices, as the fixed
+ * function pipeline lit them. Meshes are lit by the lights of their
+ * clusters and fogged there too, since their vertices are close enough
+ * together, but the large quads of the deck and walls have too few
+ * vertices to show those small lights at all, so they are drawn with
+ * ScenePerPixel, which lights them by the clusters and fogs them per
+ * fragment. Only materials with a specular color get the specular term,
+ * and lights that differ only in color, like the three spot lights at
+ * the eye, are merged into one before they are uploaded.
+ *
+ * The lights, materials and fog live in one uniform buffer shared by
+ * every program, uploaded by updateSceneShader when they have changed.
+ */
+#include "glFunctions.h"
+#include "lightClusters.h"
+
+/*
+ * What the geometry drawn next has, for useSceneShader.
+ */
+enum SceneShaderFlags {
+  SceneTextured = 1,        // Color from texture unit 0 instead of lighting.
+  SceneInstanced = 2,       // Per instance matrix and color attributes.
+  SceneLitTexture = 4,      // The color lit, over texture unit 0 showing through
+                            // as much as its alpha, as a layer of the color
+                            // blended over the texture looked. Opaque.
+  ScenePerPixel = 8,        // Lit by the clusters and fogged per fragment instead
+                            // of per vertex.
+};
+
+/*
+ * What the programs do with the fragments they draw, for setSceneShading.
+ */
+enum SceneShading {
+  SceneShaded,              // Light, texture and fog them as above.
+  SceneDepthOnly,           // Nothing, for drawing depth alone with color writes off.
+  SceneOverdraw,            // Add 1/8 red, 1/16 green and 1/32 blue under additive
+                            // blending, so the color shows how often a pixel was drawn.
+};
+
+// The attribute locations of the per instance matrix, which takes four
+// consecutive locations, one per column, and color. They are clear of
+// the locations some drivers alias to the vertex, normal and color.
+const GLuint SCENE_INSTANCE_MATRIX = 10;
+const GLuint SCENE_INSTANCE_COLOR = 14;
+
+const int SCENE_LIGHTS = 3;
+
+enum SceneMaterial { DefaultMaterial, ShinyMaterial, GlowingMaterial, SCENE_MATERIALS };
+
+/*
+ * A spot light, in eye coordinates.
+ */
+struct SceneLight {
+  float position[4];
+  float spotDirection[3];
+  float ambient[4];
+  float diffuse[4];
+  float specular[4];
+  float spotCutoff;         // In degrees, as for GL_SPOT_CUTOFF.
+  float spotExponent;
+};
+
+/*
+ * The parts of a material that the color does not replace.
+ */
+struct SceneMaterialProperties {
+  float specular[4];
+  float emission[4];
+  float shininess;
+  bool emissive;            // Drawn without the spot lights.
+};
+
+/*
+ * The uniform block, laid out by std140 rules, which with nothing but
+ * vec4s is just the members in order.
+ */
+struct SceneLightBlock {
+  float position[4];
+  float spotDirection[4];   // Normalized.
+  float ambient[4];
+  float diffuse[4];
+  float specular[4];
+  float spot[4];            // cos(cutoff) or -2 for none, exponent, enabled.
+};
+
+struct SceneMaterialBlock {
+  float specular[4];
+  float emission[4];
+  float shininess[4];
+};
+
+struct SceneBlock {
+  SceneLightBlock lights[SCENE_LIGHTS];
+  SceneMaterialBlock materials[SCENE_MATERIALS];
+  float ambient[4];
+  float fogColor[4];
+  float fogDensity[4];
+  float clusterTiles[4];
+  float clusterSlices[4];
+  float lightCounts[4];     // The lights in use at the start of lights, cluster entries.
+};
+
+/*
+ * Compile every program and create the uniform buffer.
+ * Call once with a current context.
+ */
+void createSceneShader();
+
+void setSceneLight(int index, const SceneLight &light);
+void setSceneLightEnabled(int index, bool enabled);
+void setSceneAmbient(const float ambient[4]);
+void setSceneMaterial(SceneMaterial material, const SceneMaterialProperties &properties);
+void setSceneFog(const float color[4], float density);
+void setSceneClusterMapping(const ClusterMapping &mapping);
+
+/*
+ * How many entries this frame's lights made in the clusters. With none,
+ * the clusters are not looked at.
+ */
+void setSceneClusterEntries(int entries);
+
+/*
+ * Upload the uniform buffer if anything above changed since the last
+ * call. Call once a frame before drawing.
+ */
+void updateSceneShader();
+
+/*
+ * Draw with the program for flags (a combination of SceneShaderFlags)
+ * and the current material from now on.
+ */
+void useSceneShader(int flags);
+
+/*
+ * Shade everything drawn from now on with shading, SceneShaded to begin
+ * with.
+ */
+void setSceneShading(SceneShading shading);
+SceneShading sceneShading();
+
+/*
+ * Make material the current material, like the glMaterial calls it
+ * replaces: it stays current until the next call.
+ */
+void useSceneMaterial(SceneMaterial material);
+SceneMaterial sceneMaterial();
+
+/*
+ * The uniform block as last set, and whether a material is emissive,
+ * for shading the same way without the programs (see softwareRenderer.h).
+ */
+const SceneBlock &sceneUniforms();
+bool sceneMaterialEmissive(SceneMaterial material);
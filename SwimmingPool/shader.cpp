@@ -0,0 +1,51 @@
+/*
+ * GLSL shader compilation helpers. See shader.h.
+ */
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include "shader.h"
+
+using namespace std;
+
+GLuint compileShader(GLenum type, const char *source, const char *name) {
+  GLuint shader = glCreateShader(type);
+  glShaderSource(shader, 1, &source, NULL);
+  glCompileShader(shader);
+
+  GLint status;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+  if (!status) {
+    GLint length = 0;
+    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+    vector<GLchar> log(length + 1);
+    glGetShaderInfoLog(shader, length, NULL, log.data());
+    cerr << "Compiling shader " << name << " failed:" << endl << log.data() << endl;
+    exit(1);
+  }
+  return shader;
+}
+
+GLuint linkProgram(GLuint vertexShader, GLuint fragmentShader, const char *name) {
+  GLuint program = glCreateProgram();
+  glAttachShader(program, vertexShader);
+  if (fragmentShader != 0)
+    glAttachShader(program, fragmentShader);
+  glLinkProgram(program);
+
+  GLint status;
+  glGetProgramiv(program, GL_LINK_STATUS, &status);
+  if (!status) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+    vector<GLchar> log(length + 1);
+    glGetProgramInfoLog(program, length, NULL, log.data());
+    cerr << "Linking program " << name << " failed:" << endl << log.data() << endl;
+    exit(1);
+  }
+
+  glDeleteShader(vertexShader);
+  if (fragmentShader != 0)
+    glDeleteShader(fragmentShader);
+  return program;
+}
@@ -0,0 +1,20 @@
+#pragma once
+/*
+ * GLSL shader compilation helpers.
+ */
+#include "glFunctions.h"
+
+/*
+ * Compile a vertex or fragment shader from source.
+ * name is only used in error messages.
+ * Prints the info log and exits if compilation fails.
+ */
+GLuint compileShader(GLenum type, const char *source, const char *name);
+
+/*
+ * Link a program from a vertex shader and an optional fragment shader
+ * (0 to keep the fixed function fragment processing, fog included).
+ * The shaders are flagged for deletion with the program.
+ * Prints the info log and exits if linking fails.
+ */
+GLuint linkProgram(GLuint vertexShader, GLuint fragmentShader, const char *name);
@@ -0,0 +1,69 @@
+#pragma once
+/*
+ * A minimal abstraction over the SIMD registers the compiler targets.
+ *
+ * lanes holds LANES floats: an AVX register, an SSE register, or a plain
+ * float when neither is available. Loops that process LANES elements at
+ * a time with the lanes* operations below compile to whichever is in use.
+ * Loads and stores do not need aligned pointers. lanesLessMask(a, b) has
+ * bit i set if lane i of a is less than lane i of b, and
+ * lanesSelectLess(a, b, x, y) takes lane i from x where it is, else from y.
+ */
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+typedef __m256 lanes;
+#define LANES 8
+#define lanesSet(f) _mm256_set1_ps(f)
+#define lanesLoad(p) _mm256_loadu_ps(p)
+#define lanesStore(p, a) _mm256_storeu_ps(p, a)
+#define lanesAdd(a, b) _mm256_add_ps(a, b)
+#define lanesSub(a, b) _mm256_sub_ps(a, b)
+#define lanesMul(a, b) _mm256_mul_ps(a, b)
+#define lanesDiv(a, b) _mm256_div_ps(a, b)
+#define lanesSqrt(a) _mm256_sqrt_ps(a)
+#define lanesMax(a, b) _mm256_max_ps(a, b)
+#define lanesMin(a, b) _mm256_min_ps(a, b)
+#define lanesLessMask(a, b) _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LT_OQ))
+inline lanes lanesSelectLess(lanes a, lanes b, lanes x, lanes y) {
+  return _mm256_blendv_ps(y, x, _mm256_cmp_ps(a, b, _CMP_LT_OQ));
+}
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+typedef __m128 lanes;
+#define LANES 4
+#define lanesSet(f) _mm_set1_ps(f)
+#define lanesLoad(p) _mm_loadu_ps(p)
+#define lanesStore(p, a) _mm_storeu_ps(p, a)
+#define lanesAdd(a, b) _mm_add_ps(a, b)
+#define lanesSub(a, b) _mm_sub_ps(a, b)
+#define lanesMul(a, b) _mm_mul_ps(a, b)
+#define lanesDiv(a, b) _mm_div_ps(a, b)
+#define lanesSqrt(a) _mm_sqrt_ps(a)
+#define lanesMax(a, b) _mm_max_ps(a, b)
+#define lanesMin(a, b) _mm_min_ps(a, b)
+#define lanesLessMask(a, b) _mm_movemask_ps(_mm_cmplt_ps(a, b))
+inline lanes lanesSelectLess(lanes a, lanes b, lanes x, lanes y) {
+  lanes less = _mm_cmplt_ps(a, b);
+  return _mm_or_ps(_mm_and_ps(less, x), _mm_andnot_ps(less, y));
+}
+#else
+typedef float lanes;
+#define LANES 1
+#define lanesSet(f) (f)
+#define lanesLoad(p) (*(p))
+#define lanesStore(p, a) (*(p) = (a))
+#define lanesAdd(a, b) ((a) + (b))
+#define lanesSub(a, b) ((a) - (b))
+#define lanesMul(a, b) ((a) * (b))
+#define lanesDiv(a, b) ((a) / (b))
+#define lanesSqrt(a) std::sqrt(a)
+#define lanesMax(a, b) std::max(a, b)
+#define lanesMin(a, b) std::min(a, b)
+#define lanesLessMask(a, b) ((a) < (b) ? 1 : 0)
+inline lanes lanesSelectLess(lanes a, lanes b, lanes x, lanes y) {
+  return a < b ? x : y;
+}
+#endif
@@ -0,0 +1,1114 @@
+/*
+ * Drawing the scene on the CPU. See softwareRenderer.h.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include "glState.h"
+#include "platform.h"
+#include "profiler.h"
+#include "simd.h"
+#include "softwareRenderer.h"
+
+using namespace std;
+
+// How far beyond the viewport, in viewport widths and heights from its
+// center, triangles are clipped to, keeping window coordinates small
+// without clipping most triangles that reach off the screen.
+static const float GUARD_BAND = 4.0f;
+
+// The corners of a static quad, split as uploadStaticBatch splits them.
+static const GLuint QUAD_INDICES[6] = {0, 1, 3, 1, 2, 3};
+
+static const int FULL_MASK = (1 << LANES) - 1;
+
+// Corners transformed for the triangles of a chunk, by index, so that the
+// triangles around a corner transform it once. A grid's rows are up to
+// this many corners apart.
+static const int VERTEX_CACHE = 1024;
+
+/*
+ * A corner of a triangle being clipped: its clip coordinates, then its
+ * eye position, normal and texture coordinates.
+ */
+struct ClipVertex {
+  float clip[4];
+  float attributes[8];
+};
+
+/*
+ * A corner in the vertex cache, for the draw whose generation it has.
+ */
+struct CachedVertex {
+  unsigned generation;
+  GLuint index;
+  ClipVertex vertex;
+};
+
+static thread_local vector<CachedVertex> vertexCache;
+static thread_local unsigned cacheGeneration = 0;
+
+/*
+ * What every pixel of a frame is shaded with.
+ */
+struct Shading {
+  const SceneBlock *uniforms;
+  const LightClusters *clusters;
+  const MipChain *texture;            // NULL until it has loaded.
+  bool emissive[SCENE_MATERIALS];
+};
+
+void resizeSoftwareRenderer(SoftwareRenderer *renderer, int width, int height) {
+  renderer->width = width;
+  renderer->height = height;
+  renderer->stride = (width + SOFTWARE_BLOCK - 1) / SOFTWARE_BLOCK * SOFTWARE_BLOCK;
+  renderer->rows = (height + SOFTWARE_BLOCK - 1) / SOFTWARE_BLOCK * SOFTWARE_BLOCK;
+  renderer->tilesAcross = (width + SOFTWARE_TILE - 1) / SOFTWARE_TILE;
+  renderer->tilesDown = (height + SOFTWARE_TILE - 1) / SOFTWARE_TILE;
+
+  size_t pixels = (size_t) renderer->stride * renderer->rows;
+  renderer->color.assign(pixels, 0);
+  renderer->depth.assign(pixels, 0.0f);
+  renderer->visible.assign(pixels, NULL);
+  renderer->farthest.assign(pixels / (SOFTWARE_BLOCK * SOFTWARE_BLOCK), 1.0f);
+  for (SoftwareChunk &chunk : renderer->chunks)
+    chunk.bins.clear();
+}
+
+void loadSoftwareTexture(SoftwareRenderer *renderer, const string &filename, int smallest) {
+  renderer->loading.run([renderer, filename, smallest] {
+    ProfileScope scope("software texture");
+    if (!loadMipChain(filename, smallest, MipRGBA, &renderer->texture))
+      renderer->texture.levels.clear();
+  });
+}
+
+bool softwareTextureLoaded(const SoftwareRenderer &renderer) {
+  return renderer.loading.done();
+}
+
+void beginSoftwareFrame(SoftwareRenderer *renderer, const matrix4 &projection, const LightClusters &clusters) {
+  renderer->projection = projection;
+  renderer->clusters = &clusters;
+  renderer->draws.clear();
+}
+
+void addSoftwareDraw(SoftwareRenderer *renderer, const SoftwareDraw &draw) {
+  if (draw.triangleCount > 0)
+    renderer->draws.push_back(draw);
+}
+
+/*
+ * Add quads first to first + count - 1 of batch, one draw each.
+ */
+static void addQuads(SoftwareRenderer *renderer, const StaticBatch &batch, size_t first, size_t count,
+                     const matrix4 &view, bool blended) {
+  for (size_t i = first; i < first + count; i++) {
+    const StaticQuad &quad = batch.quads[i];
+    SoftwareDraw draw;
+    draw.vertices = quad.vertices;
+    draw.stride = StaticQuad::FLOATS_PER_VERTEX;
+    draw.normalOffset = 5;
+    draw.texCoordOffset = quad.textured ? 3 : -1;
+    draw.indices = QUAD_INDICES;
+    draw.triangleCount = 2;
+    draw.columns = 0;
+    draw.modelview = view;
+    copy(quad.color, quad.color + 4, draw.color);
+    draw.material = DefaultMaterial;
+    draw.flags = quad.lit ? SceneLitTexture : quad.textured ? SceneTextured : 0;
+    draw.blended = blended;
+    addSoftwareDraw(renderer, draw);
+  }
+}
+
+/*
+ * Add the instances of group drawn at level, nearest first, one draw each.
+ */
+static void addInstances(SoftwareRenderer *renderer, const InstanceGroup &group, int level,
+                         const InstanceBatch &batch, const matrix4 &view) {
+  // The material is whichever the group's material function makes current.
+  if (group.drawnMaterial != NULL)
+    group.drawnMaterial();
+  else
+    useSceneMaterial(DefaultMaterial);
+
+  const Mesh &mesh = *group.mesh;
+  const MeshLevel &meshLevel = mesh.levels[level];
+  SoftwareDraw draw;
+  draw.vertices = mesh.data.vertices.data();
+  draw.stride = MeshData::FLOATS_PER_VERTEX;
+  draw.normalOffset = 3;
+  draw.texCoordOffset = -1;
+  draw.indices = mesh.data.indices.data() + meshLevel.firstIndex;
+  draw.triangleCount = meshLevel.indexCount / 3;
+  draw.columns = 0;
+  draw.material = sceneMaterial();
+  draw.flags = 0;
+  draw.blended = false;
+  for (int instance : group.order) {
+    if (batch.levels[group.firstInstance + instance] != level)
+      continue;
+    const float *values = &group.instances[instance * InstanceGroup::INSTANCE_FLOATS];
+    matrix4 model;
+    copy(values, values + 16, model.m);
+    draw.modelview = view.multiply(model);
+    copy(values + 16, values + 20, draw.color);
+    addSoftwareDraw(renderer, draw);
+  }
+}
+
+void addSoftwareOpaqueQueue(SoftwareRenderer *renderer, const OpaqueQueue &queue,
+                            const InstanceBatch &batch, const matrix4 &view) {
+  for (const DepthItem &item : queue.order) {
+    const OpaqueDraw &draw = queue.draws[item.index];
+    if (draw.group != NULL)
+      addInstances(renderer, *draw.group, draw.level, batch, view);
+    else
+      addQuads(renderer, *draw.batch, draw.quad, 1, view, false);
+  }
+}
+
+void addSoftwareBlended(SoftwareRenderer *renderer, const StaticBatch &batch, const matrix4 &view) {
+  addQuads(renderer, batch, batch.firstBlendedQuad, batch.quads.size() - batch.firstBlendedQuad, view, true);
+}
+
+/*
+ * The indices of the corners of triangle of draw.
+ */
+static void triangleCorners(const SoftwareDraw &draw, int triangle, GLuint corners[3]) {
+  if (draw.indices != NULL) {
+    copy(draw.indices + 3 * triangle, draw.indices + 3 * triangle + 3, corners);
+    return;
+  }
+  int quad = triangle / 2;
+  GLuint a = (quad / draw.columns) * (draw.columns + 1) + quad % draw.columns;
+  GLuint c = a + draw.columns + 2;
+  corners[0] = a;
+  corners[1] = (triangle % 2 == 0) ? a + 1 : c;
+  corners[2] = (triangle % 2 == 0) ? c : a + draw.columns + 1;
+}
+
+/*
+ * The inverse transpose of the upper 3x3 of m, up to a positive scale,
+ * column major.
+ */
+static void normalMatrix(const matrix4 &m, float normal[9]) {
+  vector3 columns[3] = {vector3(m.m[0], m.m[1], m.m[2]), vector3(m.m[4], m.m[5], m.m[6]),
+                        vector3(m.m[8], m.m[9], m.m[10])};
+  vector3 cofactors[3] = {columns[1].cross(columns[2]), columns[2].cross(columns[0]),
+                          columns[0].cross(columns[1])};
+  float sign = (columns[0].dot(cofactors[0]) < 0) ? -1.0f : 1.0f;
+  for (int i = 0; i < 3; i++) {
+    normal[3 * i] = sign * cofactors[i].x;
+    normal[3 * i + 1] = sign * cofactors[i].y;
+    normal[3 * i + 2] = sign * cofactors[i].z;
+  }
+}
+
+static void transformVertex(const SoftwareDraw &draw, const float normal[9], const matrix4 &projection,
+                            GLuint index, ClipVertex *out) {
+  const float *v = draw.vertices + (size_t) index * draw.stride;
+  const float *m = draw.modelview.m;
+  float *a = out->attributes;
+  for (int i = 0; i < 3; i++)
+    a[i] = m[i] * v[0] + m[4 + i] * v[1] + m[8 + i] * v[2] + m[12 + i];
+  const float *p = projection.m;
+  for (int i = 0; i < 4; i++)
+    out->clip[i] = p[i] * a[0] + p[4 + i] * a[1] + p[8 + i] * a[2] + p[12 + i];
+  const float *n = v + draw.normalOffset;
+  for (int i = 0; i < 3; i++)
+    a[3 + i] = normal[i] * n[0] + normal[3 + i] * n[1] + normal[6 + i] * n[2];
+  if (draw.texCoordOffset >= 0) {
+    a[6] = v[draw.texCoordOffset];
+    a[7] = v[draw.texCoordOffset + 1];
+  } else {
+    a[6] = a[7] = 0.0f;
+  }
+}
+
+/*
+ * The distance of v inside clipping plane plane: the near plane, then
+ * the guard band's sides.
+ */
+static float planeDistance(const ClipVertex &v, int plane) {
+  const float *c = v.clip;
+  switch (plane) {
+  case 0: return c[2] + c[3];
+  case 1: return GUARD_BAND * c[3] - c[0];
+  case 2: return GUARD_BAND * c[3] + c[0];
+  case 3: return GUARD_BAND * c[3] - c[1];
+  default: return GUARD_BAND * c[3] + c[1];
+  }
+}
+
+/*
+ * Where the edge from inside, distance in inside the plane, to outside,
+ * distance out outside it, crosses it. Always worked out from the inside
+ * corner, so the triangles on either side of an edge clip it alike.
+ */
+static ClipVertex crossing(const ClipVertex &inside, const ClipVertex &outside, float in, float out) {
+  float t = in / (in - out);
+  ClipVertex v;
+  for (int i = 0; i < 4; i++)
+    v.clip[i] = inside.clip[i] + t * (outside.clip[i] - inside.clip[i]);
+  for (int i = 0; i < 8; i++)
+    v.attributes[i] = inside.attributes[i] + t * (outside.attributes[i] - inside.attributes[i]);
+  return v;
+}
+
+/*
+ * The plane a x + b y + c through values at window points x, y.
+ */
+static void planeThrough(const float x[3], const float y[3], const float values[3], float inverseArea,
+                         float plane[3]) {
+  float d1 = values[1] - values[0], d2 = values[2] - values[0];
+  plane[0] = (d1 * (y[2] - y[0]) - d2 * (y[1] - y[0])) * inverseArea;
+  plane[1] = (d2 * (x[1] - x[0]) - d1 * (x[2] - x[0])) * inverseArea;
+  plane[2] = values[0] - plane[0] * x[0] - plane[1] * y[0];
+}
+
+/*
+ * Set up a clipped triangle, if it faces the eye and covers any pixel
+ * centers, and bin it.
+ */
+static void setupTriangle(const SoftwareRenderer &renderer, const SoftwareDraw &draw, const ClipVertex *corners[3],
+                          SoftwareChunk *chunk) {
+  float x[3], y[3], z[3], inverseW[3];
+  for (int i = 0; i < 3; i++) {
+    const float *c = corners[i]->clip;
+    inverseW[i] = 1.0f / c[3];
+    x[i] = (c[0] * inverseW[i] + 1.0f) * 0.5f * renderer.width;
+    y[i] = (c[1] * inverseW[i] + 1.0f) * 0.5f * renderer.height;
+    z[i] = (c[2] * inverseW[i] + 1.0f) * 0.5f;
+  }
+
+  // Counter clockwise in the window faces the eye.
+  float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+  if (!(area > 0.0f))
+    return;
+
+  SoftwareTriangle t;
+  t.box[0] = max((int) ceil(min(min(x[0], x[1]), x[2]) - 0.5f), 0);
+  t.box[1] = max((int) ceil(min(min(y[0], y[1]), y[2]) - 0.5f), 0);
+  t.box[2] = min((int) floor(max(max(x[0], x[1]), x[2]) - 0.5f), renderer.width - 1);
+  t.box[3] = min((int) floor(max(max(y[0], y[1]), y[2]) - 0.5f), renderer.height - 1);
+  if (t.box[0] > t.box[2] || t.box[1] > t.box[3])
+    return;
+
+  for (int i = 0; i < 3; i++) {
+    int a = i, b = (i + 1) % 3;
+    t.flipped[i] = x[b] < x[a] || (x[b] == x[a] && y[b] < y[a]);
+    if (t.flipped[i])
+      swap(a, b);
+    // Positive to the left of a to b, inside a counter clockwise triangle.
+    t.edges[i][0] = y[a] - y[b];
+    t.edges[i][1] = x[b] - x[a];
+    t.edges[i][2] = x[a] * y[b] - y[a] * x[b];
+  }
+
+  float inverseArea = 1.0f / area;
+  planeThrough(x, y, z, inverseArea, t.depth);
+  planeThrough(x, y, inverseW, inverseArea, t.inverseW);
+  float weight1[3] = {0.0f, inverseW[1], 0.0f};
+  float weight2[3] = {0.0f, 0.0f, inverseW[2]};
+  planeThrough(x, y, weight1, inverseArea, t.weights[0]);
+  planeThrough(x, y, weight2, inverseArea, t.weights[1]);
+  if (draw.texCoordOffset >= 0) {
+    for (int i = 0; i < 2; i++) {
+      float overW[3];
+      for (int corner = 0; corner < 3; corner++)
+        overW[corner] = corners[corner]->attributes[6 + i] * inverseW[corner];
+      planeThrough(x, y, overW, inverseArea, t.texCoordsOverW[i]);
+    }
+  }
+  for (int i = 0; i < 8; i++) {
+    t.corner[i] = corners[0]->attributes[i];
+    t.toCorner1[i] = corners[1]->attributes[i] - t.corner[i];
+    t.toCorner2[i] = corners[2]->attributes[i] - t.corner[i];
+  }
+  t.nearest = max(min(min(z[0], z[1]), z[2]), 0.0f);
+  t.draw = &draw;
+
+  int index = (int) chunk->triangles.size();
+  chunk->triangles.push_back(t);
+  for (int ty = t.box[1] / SOFTWARE_TILE; ty <= t.box[3] / SOFTWARE_TILE; ty++) {
+    for (int tx = t.box[0] / SOFTWARE_TILE; tx <= t.box[2] / SOFTWARE_TILE; tx++)
+      chunk->bins[ty * renderer.tilesAcross + tx].push_back(index);
+  }
+}
+
+/*
+ * Clip triangle of draw to the near plane and the guard band, and set up
+ * what is left of it.
+ */
+static void clipTriangle(const SoftwareRenderer &renderer, const SoftwareDraw &draw, const float normal[9],
+                         int triangle, SoftwareChunk *chunk) {
+  GLuint indices[3];
+  triangleCorners(draw, triangle, indices);
+  ClipVertex corners[3];
+  for (int i = 0; i < 3; i++) {
+    CachedVertex &cached = vertexCache[indices[i] % VERTEX_CACHE];
+    if (cached.generation != cacheGeneration || cached.index != indices[i]) {
+      transformVertex(draw, normal, renderer.projection, indices[i], &cached.vertex);
+      cached.generation = cacheGeneration;
+      cached.index = indices[i];
+    }
+    corners[i] = cached.vertex;
+  }
+
+  // Drop it if it is all outside any side of the view volume, and take
+  // the quick way if it is all inside the clipping planes.
+  int outsideAll = 63, outsideAny = 0;
+  for (int i = 0; i < 3; i++) {
+    const float *c = corners[i].clip;
+    int outside = (c[0] > c[3]) | (c[0] < -c[3]) << 1 | (c[1] > c[3]) << 2 | (c[1] < -c[3]) << 3 |
+                  (c[2] > c[3]) << 4 | (c[2] < -c[3]) << 5;
+    outsideAll &= outside;
+    for (int plane = 0; plane < 5; plane++) {
+      if (planeDistance(corners[i], plane) < 0.0f)
+        outsideAny |= 1 << plane;
+    }
+  }
+  if (outsideAll != 0)
+    return;
+  if (outsideAny == 0) {
+    const ClipVertex *fan[3] = {&corners[0], &corners[1], &corners[2]};
+    setupTriangle(renderer, draw, fan, chunk);
+    return;
+  }
+
+  // Each plane can add one corner to the polygon.
+  ClipVertex polygons[2][8];
+  int count = 3;
+  copy(corners, corners + 3, polygons[0]);
+  int current = 0;
+  for (int plane = 0; plane < 5 && count > 0; plane++) {
+    if (!(outsideAny & (1 << plane)))
+      continue;
+    const ClipVertex *in = polygons[current];
+    ClipVertex *out = polygons[1 - current];
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+      const ClipVertex &a = in[i], &b = in[(i + 1) % count];
+      float da = planeDistance(a, plane), db = planeDistance(b, plane);
+      if (da >= 0.0f)
+        out[kept++] = a;
+      if ((da >= 0.0f) != (db >= 0.0f))
+        out[kept++] = (da >= 0.0f) ? crossing(a, b, da, db) : crossing(b, a, db, da);
+    }
+    count = kept;
+    current = 1 - current;
+  }
+
+  const ClipVertex *polygon = polygons[current];
+  for (int i = 1; i + 1 < count; i++) {
+    const ClipVertex *fan[3] = {&polygon[0], &polygon[i], &polygon[i + 1]};
+    setupTriangle(renderer, draw, fan, chunk);
+  }
+}
+
+/*
+ * Set up the triangles of chunk index of the frame.
+ */
+static void setupChunk(SoftwareRenderer *renderer, int index, int triangleCount) {
+  SoftwareChunk &chunk = renderer->chunks[index];
+  chunk.triangles.clear();
+  chunk.bins.resize(renderer->tilesAcross * renderer->tilesDown);
+  for (vector<int> &bin : chunk.bins)
+    bin.clear();
+
+  int first = index * SOFTWARE_CHUNK_TRIANGLES;
+  int last = min(first + SOFTWARE_CHUNK_TRIANGLES, triangleCount);
+  const vector<int> &firsts = renderer->firstTriangles;
+  size_t drawIndex = upper_bound(firsts.begin(), firsts.end(), first) - firsts.begin() - 1;
+  float normal[9];
+  normalMatrix(renderer->draws[drawIndex].modelview, normal);
+  // A new generation of the cache for each draw.
+  if (vertexCache.empty())
+    vertexCache.resize(VERTEX_CACHE, CachedVertex{0, 0, {}});
+  cacheGeneration++;
+  for (int triangle = first; triangle < last; triangle++) {
+    while (triangle >= firsts[drawIndex] + renderer->draws[drawIndex].triangleCount) {
+      drawIndex++;
+      normalMatrix(renderer->draws[drawIndex].modelview, normal);
+      cacheGeneration++;
+    }
+    clipTriangle(*renderer, renderer->draws[drawIndex], normal, triangle - firsts[drawIndex], &chunk);
+  }
+}
+
+/*
+ * The RGBA texel at p, each channel 16 bits from the last.
+ */
+static inline uint64_t spreadTexel(const unsigned char *p) {
+  uint32_t packed;
+  memcpy(&packed, p, 4);
+  uint64_t texel = packed;
+  texel = (texel | texel << 16) & 0x0000FFFF0000FFFFull;
+  return (texel | texel << 8) & 0x00FF00FF00FF00FFull;
+}
+
+/*
+ * The texel at s, t of level, filtered bilinearly and repeated, as
+ * spreadTexel spreads them but 256 times over. The weights are 8 bit
+ * fractions, as texture units have them, which lets a multiply filter
+ * every channel at once.
+ */
+static uint64_t bilinear(const MipLevel &level, float s, float t) {
+  const uint64_t HALF = 0x0080008000800080ull, LOW = 0x00FF00FF00FF00FFull;
+  float u = s * level.width - 0.5f, v = t * level.height - 0.5f;
+  float fu = floor(u), fv = floor(v);
+  uint64_t au = (uint64_t) ((u - fu) * 256.0f + 0.5f), av = (uint64_t) ((v - fv) * 256.0f + 0.5f);
+  int x0 = (int) fu, y0 = (int) fv;
+  if (x0 < 0 || x0 >= level.width) {
+    x0 %= level.width;
+    x0 += (x0 < 0) ? level.width : 0;
+  }
+  if (y0 < 0 || y0 >= level.height) {
+    y0 %= level.height;
+    y0 += (y0 < 0) ? level.height : 0;
+  }
+  int x1 = (x0 + 1 == level.width) ? 0 : x0 + 1;
+  int y1 = (y0 + 1 == level.height) ? 0 : y0 + 1;
+  const unsigned char *rows[2] = {level.data + (size_t) y0 * level.width * 4, level.data + (size_t) y1 * level.width * 4};
+  uint64_t bottom = ((spreadTexel(rows[0] + x0 * 4) * (256 - au) + spreadTexel(rows[0] + x1 * 4) * au + HALF) >> 8) & LOW;
+  uint64_t top = ((spreadTexel(rows[1] + x0 * 4) * (256 - au) + spreadTexel(rows[1] + x1 * 4) * au + HALF) >> 8) & LOW;
+  return bottom * (256 - av) + top * av;
+}
+
+static inline void texelColor(uint64_t texel, float rgb[3]) {
+  for (int i = 0; i < 3; i++)
+    rgb[i] = ((texel >> (16 * i)) & 0xFFFF) * (1.0f / (255.0f * 256.0f));
+}
+
+/*
+ * The mip level to sample texture at where t has texture coordinates s,
+ * tc and w = 1 / (1 / w): log2 of how many texels of the first level a
+ * step of one pixel crosses.
+ */
+static float textureLod(const MipChain &texture, const SoftwareTriangle &t, float w, float s, float tc) {
+  // d(s / (1 / w)) = (d(s / w) - s d(1 / w)) w.
+  const float *sPlane = t.texCoordsOverW[0], *tPlane = t.texCoordsOverW[1];
+  float width = (float) texture.levels[0].width, height = (float) texture.levels[0].height;
+  float dsdx = (sPlane[0] - s * t.inverseW[0]) * w * width;
+  float dtdx = (tPlane[0] - tc * t.inverseW[0]) * w * height;
+  float dsdy = (sPlane[1] - s * t.inverseW[1]) * w * width;
+  float dtdy = (tPlane[1] - tc * t.inverseW[1]) * w * height;
+  float rho = max(dsdx * dsdx + dtdx * dtdx, dsdy * dsdy + dtdy * dtdy);
+  return 0.5f * log2(max(rho, 1e-20f));
+}
+
+/*
+ * Sample texture at s, t and level of detail lod with trilinear
+ * filtering.
+ */
+static void sampleTexture(const MipChain &texture, float lod, float s, float t, float rgb[3]) {
+  const vector<MipLevel> &levels = texture.levels;
+  int last = (int) levels.size() - 1;
+  if (lod <= 0.0f) {
+    texelColor(bilinear(levels[0], s, t), rgb);
+  } else if (lod >= last) {
+    texelColor(bilinear(levels[last], s, t), rgb);
+  } else {
+    int level = (int) lod;
+    float fraction = lod - level;
+    float finer[3], coarser[3];
+    texelColor(bilinear(levels[level], s, t), finer);
+    texelColor(bilinear(levels[level + 1], s, t), coarser);
+    for (int i = 0; i < 3; i++)
+      rgb[i] = finer[i] + fraction * (coarser[i] - finer[i]);
+  }
+}
+
+/*
+ * f of each lane of a in mask, where there is no lanes operation for it.
+ * The other lanes are left as they were.
+ */
+template <class F>
+static inline lanes eachLane(lanes a, int mask, F f) {
+  float values[LANES];
+  lanesStore(values, a);
+  for (int i = 0; i < LANES; i++) {
+    if (mask & (1 << i))
+      values[i] = f(values[i]);
+  }
+  return lanesLoad(values);
+}
+
+/*
+ * e^-x for x >= 0, good to about 1e-5 of it: e^-(x / 64) from the first
+ * terms of its Taylor series, squared six times.
+ */
+static inline lanes expNegativeLanes(lanes x) {
+  lanes one = lanesSet(1.0f);
+  lanes y = lanesMul(lanesMin(x, lanesSet(100.0f)), lanesSet(-1.0f / 64.0f));
+  lanes e = one;
+  for (int term = 6; term > 0; term--)
+    e = lanesAdd(one, lanesMul(lanesMul(y, lanesSet(1.0f / term)), e));
+  for (int i = 0; i < 6; i++)
+    e = lanesMul(e, e);
+  return e;
+}
+
+static inline lanes dotLanes(const lanes a[3], const lanes b[3]) {
+  return lanesAdd(lanesAdd(lanesMul(a[0], b[0]), lanesMul(a[1], b[1])), lanesMul(a[2], b[2]));
+}
+
+static inline void normalizeLanes(lanes v[3]) {
+  lanes zero = lanesSet(0.0f);
+  lanes length = lanesSqrt(dotLanes(v, v));
+  lanes scale = lanesSelectLess(zero, length, lanesDiv(lanesSet(1.0f), length), zero);
+  for (int i = 0; i < 3; i++)
+    v[i] = lanesMul(v[i], scale);
+}
+
+/*
+ * The specular factor of a surface with normal lit from toLight, seen by
+ * a non-local viewer, where it faces the light (diffuse > 0).
+ */
+static inline lanes specularLanes(const lanes normal[3], const lanes toLight[3], lanes diffuse, float shininess,
+                                  int mask) {
+  lanes zero = lanesSet(0.0f);
+  mask &= lanesLessMask(zero, diffuse);
+  if (mask == 0)
+    return zero;
+  lanes half[3] = {toLight[0], toLight[1], lanesAdd(toLight[2], lanesSet(1.0f))};
+  normalizeLanes(half);
+  lanes factor = lanesMax(dotLanes(normal, half), zero);
+  if (shininess != 1.0f)
+    factor = eachLane(factor, mask, [shininess](float f) { return pow(f, shininess); });
+  return lanesSelectLess(zero, diffuse, factor, zero);
+}
+
+/*
+ * Add the lights of cluster to lit, in the lanes of mask.
+ */
+static void addClusterLights(const Shading &shading, int cluster, const SceneMaterialBlock &m, const float color[4],
+                             const lanes eye[3], const lanes normal[3], int mask, lanes lit[3]) {
+  const LightClusters &clusters = *shading.clusters;
+  lanes zero = lanesSet(0.0f);
+  float active[LANES];
+  for (int i = 0; i < LANES; i++)
+    active[i] = (mask & (1 << i)) ? 1.0f : 0.0f;
+  lanes activeLanes = lanesLoad(active);
+
+  GLuint first = clusters.grid[2 * cluster], count = clusters.grid[2 * cluster + 1];
+  for (GLuint i = first; i < first + count; i++) {
+    const float *light = &clusters.lights[12 * clusters.indices[i]];
+    lanes toLight[3];
+    for (int k = 0; k < 3; k++)
+      toLight[k] = lanesSub(lanesSet(light[k]), eye[k]);
+    lanes distance = lanesSqrt(dotLanes(toLight, toLight));
+    // Out of reach in the lanes not asked for.
+    lanes radius = lanesMul(lanesSet(light[3]), activeLanes);
+    int reached = lanesLessMask(distance, radius);
+    if (reached == 0)
+      continue;
+    for (int k = 0; k < 3; k++)
+      toLight[k] = lanesDiv(toLight[k], distance);
+    lanes fade = lanesSub(lanesSet(1.0f), lanesDiv(distance, lanesSet(light[3])));
+    lanes strength = lanesMul(fade, fade);
+    lanes spotDot = zero, cutoff = lanesSet(-2.0f);
+    if (light[7] > -1.5f) {
+      lanes direction[3] = {lanesSet(light[8]), lanesSet(light[9]), lanesSet(light[10])};
+      spotDot = lanesSub(zero, dotLanes(toLight, direction));
+      cutoff = lanesSet(light[7]);
+      reached &= ~lanesLessMask(spotDot, cutoff);
+      if (reached == 0)
+        continue;
+      float exponent = light[11];
+      strength = lanesMul(strength, eachLane(spotDot, reached, [exponent](float f) { return pow(f, exponent); }));
+    }
+    lanes diffuse = lanesMax(dotLanes(normal, toLight), zero);
+    lanes specular = specularLanes(normal, toLight, diffuse, m.shininess[0], reached);
+    for (int k = 0; k < 3; k++) {
+      lanes added = lanesAdd(lit[k], lanesMul(lanesMul(strength, lanesSet(light[4 + k])),
+                                              lanesAdd(lanesMul(diffuse, lanesSet(color[k])),
+                                                       lanesMul(specular, lanesSet(m.specular[k])))));
+      added = lanesSelectLess(distance, radius, added, lit[k]);
+      lit[k] = lanesSelectLess(spotDot, cutoff, lit[k], added);
+    }
+  }
+}
+
+/*
+ * The spotLit and clusterLit functions of the scene shader together,
+ * for the lanes of mask at window positions x, y: lit by the spot lights
+ * and the lights of their clusters.
+ */
+static void lightUp(const Shading &shading, const SceneMaterialBlock &m, const float color[4], const lanes eye[3],
+                    const lanes eyeNormal[3], lanes x, float y, int mask, lanes lit[3]) {
+  const SceneBlock &u = *shading.uniforms;
+  lanes zero = lanesSet(0.0f);
+  lanes normal[3] = {eyeNormal[0], eyeNormal[1], eyeNormal[2]};
+  normalizeLanes(normal);
+  for (int i = 0; i < 3; i++)
+    lit[i] = lanesSet(m.emission[i] + color[i] * u.ambient[i]);
+
+  // The viewer's spot lights are all in the same place pointing the same
+  // way, so work out how each lights the surface only once.
+  const SceneLightBlock *placed = NULL;
+  int reached = 0;
+  lanes spot, spotDot, cutoff, diffuse, specular;
+  for (int l = 0; l < SCENE_LIGHTS; l++) {
+    const SceneLightBlock &light = u.lights[l];
+    if (light.spot[2] == 0.0f)
+      continue;
+    if (placed == NULL || !equal(light.position, light.position + 4, placed->position) ||
+        !equal(light.spotDirection, light.spotDirection + 3, placed->spotDirection) ||
+        !equal(light.spot, light.spot + 2, placed->spot)) {
+      placed = &light;
+      lanes toLight[3];
+      for (int i = 0; i < 3; i++)
+        toLight[i] = lanesSub(lanesSet(light.position[i]), lanesMul(lanesSet(light.position[3]), eye[i]));
+      normalizeLanes(toLight);
+      reached = mask;
+      spot = lanesSet(1.0f);
+      spotDot = zero;
+      cutoff = lanesSet(-2.0f);
+      if (light.spot[0] > -1.5f) {
+        lanes direction[3] = {lanesSet(light.spotDirection[0]), lanesSet(light.spotDirection[1]),
+                              lanesSet(light.spotDirection[2])};
+        spotDot = lanesSub(zero, dotLanes(toLight, direction));
+        cutoff = lanesSet(light.spot[0]);
+        reached &= ~lanesLessMask(spotDot, cutoff);
+        float exponent = light.spot[1];
+        spot = (exponent == 1.0f) ? spotDot
+                                  : eachLane(lanesMax(spotDot, zero), reached, [exponent](float f) { return pow(f, exponent); });
+      }
+      diffuse = lanesMax(dotLanes(normal, toLight), zero);
+      specular = specularLanes(normal, toLight, diffuse, m.shininess[0], reached);
+    }
+    if (reached == 0)
+      continue;
+    for (int i = 0; i < 3; i++) {
+      lanes added = lanesAdd(lit[i], lanesMul(spot, lanesAdd(lanesMul(lanesSet(color[i]), lanesAdd(lanesSet(light.ambient[i]), lanesMul(diffuse, lanesSet(light.diffuse[i])))),
+                                                          lanesMul(lanesMul(specular, lanesSet(m.specular[i])), lanesSet(light.specular[i])))));
+      lit[i] = lanesSelectLess(spotDot, cutoff, lit[i], added);
+    }
+  }
+
+  // The lights of each lane's cluster, all at once where the lanes share
+  // one, as they mostly do.
+  const LightClusters &clusters = *shading.clusters;
+  if (clusters.indices.empty())
+    return;
+  int tileY = min(max((int) (y * u.clusterTiles[1] + u.clusterTiles[3]), 0), CLUSTER_TILES - 1);
+  float xs[LANES], zs[LANES];
+  lanesStore(xs, x);
+  lanesStore(zs, eye[2]);
+  int laneClusters[LANES];
+  for (int i = 0; i < LANES; i++) {
+    if (!(mask & (1 << i)))
+      continue;
+    int tileX = min(max((int) (xs[i] * u.clusterTiles[0] + u.clusterTiles[2]), 0), CLUSTER_TILES - 1);
+    int slice = min(max((int) (log(-zs[i]) * u.clusterSlices[0] + u.clusterSlices[1]), 0), CLUSTER_SLICES - 1);
+    laneClusters[i] = (slice * CLUSTER_TILES + tileY) * CLUSTER_TILES + tileX;
+  }
+  for (int left = mask; left != 0;) {
+    int first = 0;
+    while (!(left & (1 << first)))
+      first++;
+    int same = 0;
+    for (int i = first; i < LANES; i++) {
+      if ((left & (1 << i)) && laneClusters[i] == laneClusters[first])
+        same |= 1 << i;
+    }
+    addClusterLights(shading, laneClusters[first], m, color, eye, normal, same, lit);
+    left &= ~same;
+  }
+}
+
+/*
+ * Shade triangle t at the centers of the pixels of mask among the LANES
+ * from x on in row y, as the scene shader would for its draw.
+ */
+static void shade(const Shading &shading, const SoftwareTriangle &t, int x, int y, int mask, lanes rgba[4]) {
+  const SoftwareDraw &draw = *t.draw;
+  float offsets[LANES];
+  for (int i = 0; i < LANES; i++)
+    offsets[i] = x + i + 0.5f;
+  lanes px = lanesLoad(offsets);
+  float py = y + 0.5f;
+  auto planeAt = [px, py](const float plane[3]) {
+    return lanesAdd(lanesAdd(lanesMul(lanesSet(plane[0]), px), lanesSet(plane[1] * py)), lanesSet(plane[2]));
+  };
+  lanes w = lanesDiv(lanesSet(1.0f), planeAt(t.inverseW));
+  lanes b1 = lanesMul(planeAt(t.weights[0]), w);
+  lanes b2 = lanesMul(planeAt(t.weights[1]), w);
+  lanes a[8];
+  for (int i = 0; i < 8; i++) {
+    a[i] = lanesAdd(lanesAdd(lanesSet(t.corner[i]), lanesMul(b1, lanesSet(t.toCorner1[i]))),
+                    lanesMul(b2, lanesSet(t.toCorner2[i])));
+  }
+  const lanes *eye = a, *normal = a + 3;
+  lanes zero = lanesSet(0.0f), one = lanesSet(1.0f);
+
+  // The texture, where there is one, a lane at a time, at one level of
+  // detail for all of them, as GPUs choose one for each 2 x 2 pixels.
+  float texels[3][LANES] = {};
+  if ((draw.flags & (SceneTextured | SceneLitTexture)) && shading.texture != NULL) {
+    float ws[LANES], ss[LANES], ts[LANES];
+    lanesStore(ws, w);
+    lanesStore(ss, a[6]);
+    lanesStore(ts, a[7]);
+    int first = 0;
+    while (!(mask & (1 << first)))
+      first++;
+    float lod = textureLod(*shading.texture, t, ws[first], ss[first], ts[first]);
+    for (int i = first; i < LANES; i++) {
+      if (!(mask & (1 << i)))
+        continue;
+      float texel[3];
+      sampleTexture(*shading.texture, lod, ss[i], ts[i], texel);
+      for (int k = 0; k < 3; k++)
+        texels[k][i] = texel[k];
+    }
+  }
+
+  if (draw.flags & SceneTextured) {
+    for (int i = 0; i < 3; i++)
+      rgba[i] = lanesLoad(texels[i]);
+    rgba[3] = zero;
+  } else {
+    const SceneBlock &u = *shading.uniforms;
+    const SceneMaterialBlock &m = u.materials[draw.material];
+    lanes lit[3];
+    if (shading.emissive[draw.material]) {
+      for (int i = 0; i < 3; i++)
+        lit[i] = lanesSet(m.emission[i] + draw.color[i] * u.ambient[i]);
+    } else {
+      lightUp(shading, m, draw.color, eye, normal, px, py, mask, lit);
+    }
+    for (int i = 0; i < 3; i++)
+      rgba[i] = lanesMin(lanesMax(lit[i], zero), one);
+    rgba[3] = lanesSet(draw.color[3]);
+
+    if (draw.flags & SceneLitTexture) {
+      // What the blend function made of the lit color over the texture.
+      lanes alpha = lanesSet(draw.color[3]);
+      for (int i = 0; i < 3; i++)
+        rgba[i] = lanesAdd(rgba[i], lanesMul(alpha, lanesSub(lanesLoad(texels[i]), rgba[i])));
+      rgba[3] = zero;
+    }
+  }
+
+  // GL_EXP2 fog by the distance along the view direction.
+  const SceneBlock &u = *shading.uniforms;
+  lanes density = lanesMul(lanesSet(u.fogDensity[0]), lanesMax(eye[2], lanesSub(zero, eye[2])));
+  lanes fog = lanesMin(lanesMax(expNegativeLanes(lanesMul(density, density)), zero), one);
+  for (int i = 0; i < 3; i++) {
+    lanes fogColor = lanesSet(u.fogColor[i]);
+    rgba[i] = lanesAdd(fogColor, lanesMul(fog, lanesSub(rgba[i], fogColor)));
+  }
+}
+
+static inline unsigned packColor(const float rgb[3]) {
+  unsigned packed = 255u << 24;
+  for (int i = 0; i < 3; i++)
+    packed |= (unsigned) (min(max(rgb[i], 0.0f), 1.0f) * 255.0f + 0.5f) << (8 * i);
+  return packed;
+}
+
+/*
+ * packColor for each lane of rgb.
+ */
+static inline void packLanes(const lanes rgb[3], unsigned packed[LANES]) {
+  float channels[3][LANES];
+  for (int k = 0; k < 3; k++) {
+    lanes clamped = lanesMin(lanesMax(rgb[k], lanesSet(0.0f)), lanesSet(1.0f));
+    lanesStore(channels[k], lanesAdd(lanesMul(clamped, lanesSet(255.0f)), lanesSet(0.5f)));
+  }
+  for (int i = 0; i < LANES; i++)
+    packed[i] = 255u << 24 | (unsigned) channels[0][i] | (unsigned) channels[1][i] << 8 | (unsigned) channels[2][i] << 16;
+}
+
+/*
+ * Rasterize t over the blocks of the tile at x0, y0 that it reaches,
+ * calling pixels(index, x, y, mask, depths) for each run of LANES pixels
+ * from index, at x, y, of which those of mask are covered by it nearer
+ * than the depth there, and keeping the farthest depth of each block it
+ * changed up to date.
+ */
+template <class Pixels>
+static void rasterize(SoftwareRenderer *renderer, const SoftwareTriangle &t, int x0, int y0, Pixels pixels) {
+  const int stride = renderer->stride;
+  const int blocksAcross = stride / SOFTWARE_BLOCK;
+  float *depths = renderer->depth.data();
+  float offsets[LANES];
+  for (int i = 0; i < LANES; i++)
+    offsets[i] = i + 0.5f;
+  lanes laneOffsets = lanesLoad(offsets);
+  lanes zero = lanesSet(0.0f);
+
+  int firstX = max(t.box[0], x0) / SOFTWARE_BLOCK * SOFTWARE_BLOCK;
+  int firstY = max(t.box[1], y0) / SOFTWARE_BLOCK * SOFTWARE_BLOCK;
+  int lastX = min(t.box[2], x0 + SOFTWARE_TILE - 1);
+  int lastY = min(t.box[3], y0 + SOFTWARE_TILE - 1);
+  for (int by = firstY; by <= lastY; by += SOFTWARE_BLOCK) {
+    for (int bx = firstX; bx <= lastX; bx += SOFTWARE_BLOCK) {
+      float &farthest = renderer->farthest[(by / SOFTWARE_BLOCK) * blocksAcross + bx / SOFTWARE_BLOCK];
+      if (t.nearest >= farthest)
+        continue;
+
+      // Skip the block if it is outside an edge, and skip the edge tests
+      // if it is inside all three, with a margin for rounding.
+      float low[2] = {bx + 0.5f, by + 0.5f};
+      float high[2] = {bx + SOFTWARE_BLOCK - 0.5f, by + SOFTWARE_BLOCK - 0.5f};
+      bool outside = false, covered = true;
+      for (int e = 0; e < 3; e++) {
+        float sign = t.flipped[e] ? -1.0f : 1.0f;
+        float a = sign * t.edges[e][0], b = sign * t.edges[e][1], c = sign * t.edges[e][2];
+        float most = a * (a > 0 ? high[0] : low[0]) + b * (b > 0 ? high[1] : low[1]) + c;
+        float least = a * (a > 0 ? low[0] : high[0]) + b * (b > 0 ? low[1] : high[1]) + c;
+        float margin = 1e-5f * (fabs(a) * high[0] + fabs(b) * high[1] + fabs(c));
+        outside |= most < -margin;
+        covered &= least > margin;
+      }
+      if (outside)
+        continue;
+
+      bool changed = false;
+      for (int y = by; y < by + SOFTWARE_BLOCK; y++) {
+        float py = y + 0.5f;
+        float rowEdges[3], rowDepth = t.depth[1] * py + t.depth[2];
+        for (int e = 0; e < 3; e++)
+          rowEdges[e] = t.edges[e][1] * py + t.edges[e][2];
+        for (int x = bx; x < bx + SOFTWARE_BLOCK; x += LANES) {
+          lanes px = lanesAdd(lanesSet((float) x), laneOffsets);
+          int mask = FULL_MASK;
+          if (!covered) {
+            for (int e = 0; e < 3; e++) {
+              lanes edge = lanesAdd(lanesMul(lanesSet(t.edges[e][0]), px), lanesSet(rowEdges[e]));
+              int negative = lanesLessMask(edge, zero);
+              mask &= t.flipped[e] ? negative : ~negative;
+            }
+            if (mask == 0)
+              continue;
+          }
+          int index = y * stride + x;
+          lanes z = lanesAdd(lanesMul(lanesSet(t.depth[0]), px), lanesSet(rowDepth));
+          mask &= lanesLessMask(z, lanesLoad(depths + index));
+          if (mask == 0)
+            continue;
+          float zs[LANES];
+          lanesStore(zs, z);
+          pixels(index, x, y, mask, zs);
+          changed = true;
+        }
+      }
+
+      if (changed) {
+        lanes most = lanesLoad(depths + by * stride + bx);
+        for (int y = by; y < by + SOFTWARE_BLOCK; y++) {
+          for (int x = bx; x < bx + SOFTWARE_BLOCK; x += LANES)
+            most = lanesMax(most, lanesLoad(depths + y * stride + x));
+        }
+        float values[LANES];
+        lanesStore(values, most);
+        farthest = *max_element(values, values + LANES);
+      }
+    }
+  }
+}
+
+/*
+ * Draw tile: clear it, rasterize the opaque triangles binned to it, shade
+ * what they left, then draw the blended triangles over it.
+ */
+static void drawTile(SoftwareRenderer *renderer, const Shading &shading, int tile, int chunkCount) {
+  const int stride = renderer->stride;
+  int x0 = (tile % renderer->tilesAcross) * SOFTWARE_TILE;
+  int y0 = (tile / renderer->tilesAcross) * SOFTWARE_TILE;
+  int x1 = min(x0 + SOFTWARE_TILE, renderer->width);
+  int y1 = min(y0 + SOFTWARE_TILE, renderer->height);
+
+  for (int y = y0; y < y1; y++) {
+    fill(renderer->depth.begin() + y * stride + x0, renderer->depth.begin() + y * stride + x1, 1.0f);
+    fill(renderer->visible.begin() + y * stride + x0, renderer->visible.begin() + y * stride + x1, nullptr);
+  }
+  int blocksAcross = stride / SOFTWARE_BLOCK;
+  for (int by = y0 / SOFTWARE_BLOCK; by < (y1 + SOFTWARE_BLOCK - 1) / SOFTWARE_BLOCK; by++) {
+    for (int bx = x0 / SOFTWARE_BLOCK; bx < (x1 + SOFTWARE_BLOCK - 1) / SOFTWARE_BLOCK; bx++)
+      renderer->farthest[by * blocksAcross + bx] = 1.0f;
+  }
+
+  float *depths = renderer->depth.data();
+  const SoftwareTriangle **visible = renderer->visible.data();
+  for (int c = 0; c < chunkCount; c++) {
+    const SoftwareChunk &chunk = renderer->chunks[c];
+    for (int index : chunk.bins[tile]) {
+      const SoftwareTriangle &t = chunk.triangles[index];
+      if (t.draw->blended)
+        continue;
+      rasterize(renderer, t, x0, y0, [&t, depths, visible](int index, int, int, int mask, const float *z) {
+        for (int i = 0; i < LANES; i++) {
+          if (mask & (1 << i)) {
+            depths[index + i] = z[i];
+            visible[index + i] = &t;
+          }
+        }
+      });
+    }
+  }
+
+  // Shade LANES pixels at a time, once for each triangle among them.
+  unsigned clear = packColor(renderer->clearColor);
+  unsigned *colors = renderer->color.data();
+  for (int y = y0; y < y1; y++) {
+    for (int x = x0; x < x1; x += LANES) {
+      int index = y * stride + x;
+      int left = (x1 - x >= LANES) ? FULL_MASK : (1 << (x1 - x)) - 1;
+      for (int i = 0; i < LANES; i++) {
+        if ((left & (1 << i)) && visible[index + i] == NULL) {
+          colors[index + i] = clear;
+          left &= ~(1 << i);
+        }
+      }
+      while (left != 0) {
+        int first = 0;
+        while (!(left & (1 << first)))
+          first++;
+        const SoftwareTriangle *t = visible[index + first];
+        int mask = 0;
+        for (int i = first; i < LANES; i++) {
+          if ((left & (1 << i)) && visible[index + i] == t)
+            mask |= 1 << i;
+        }
+        lanes rgba[4];
+        unsigned packed[LANES];
+        shade(shading, *t, x, y, mask, rgba);
+        packLanes(rgba, packed);
+        for (int i = 0; i < LANES; i++) {
+          if (mask & (1 << i))
+            colors[index + i] = packed[i];
+        }
+        left &= ~mask;
+      }
+    }
+  }
+
+  for (int c = 0; c < chunkCount; c++) {
+    const SoftwareChunk &chunk = renderer->chunks[c];
+    for (int index : chunk.bins[tile]) {
+      const SoftwareTriangle &t = chunk.triangles[index];
+      if (!t.draw->blended)
+        continue;
+      rasterize(renderer, t, x0, y0, [&t, &shading, depths, colors](int index, int x, int y, int mask, const float *z) {
+        lanes rgba[4];
+        shade(shading, t, x, y, mask, rgba);
+        // The scene's blend function, GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA.
+        float behind[3][LANES];
+        for (int i = 0; i < LANES; i++) {
+          for (int k = 0; k < 3; k++)
+            behind[k][i] = (colors[index + i] >> (8 * k)) & 255;
+        }
+        lanes opacity = lanesSub(lanesSet(1.0f), rgba[3]);
+        lanes behindScale = lanesMul(rgba[3], lanesSet(1.0f / 255.0f));
+        for (int k = 0; k < 3; k++)
+          rgba[k] = lanesAdd(lanesMul(rgba[k], opacity), lanesMul(lanesLoad(behind[k]), behindScale));
+        unsigned packed[LANES];
+        packLanes(rgba, packed);
+        for (int i = 0; i < LANES; i++) {
+          if (mask & (1 << i)) {
+            depths[index + i] = z[i];
+            colors[index + i] = packed[i];
+          }
+        }
+      });
+    }
+  }
+}
+
+void drawSoftwareFrame(SoftwareRenderer *renderer) {
+  int triangleCount = 0;
+  renderer->firstTriangles.clear();
+  for (const SoftwareDraw &draw : renderer->draws) {
+    renderer->firstTriangles.push_back(triangleCount);
+    triangleCount += draw.triangleCount;
+  }
+  int chunkCount = (triangleCount + SOFTWARE_CHUNK_TRIANGLES - 1) / SOFTWARE_CHUNK_TRIANGLES;
+  if ((int) renderer->chunks.size() < chunkCount)
+    renderer->chunks.resize(chunkCount);
+
+  {
+    ProfileScope scope("software setup");
+    parallelFor(chunkCount, 1, [renderer, triangleCount](int first, int last) {
+      for (int chunk = first; chunk < last; chunk++)
+        setupChunk(renderer, chunk, triangleCount);
+    });
+  }
+  long long setUp = 0;
+  for (int c = 0; c < chunkCount; c++)
+    setUp += renderer->chunks[c].triangles.size();
+  profileCounter("software triangles", setUp);
+
+  Shading shading;
+  shading.uniforms = &sceneUniforms();
+  shading.clusters = renderer->clusters;
+  bool textured = softwareTextureLoaded(*renderer) && !renderer->texture.levels.empty();
+  shading.texture = textured ? &renderer->texture : NULL;
+  for (int i = 0; i < SCENE_MATERIALS; i++)
+    shading.emissive[i] = sceneMaterialEmissive((SceneMaterial) i);
+
+  {
+    ProfileScope scope("software tiles");
+    parallelFor(renderer->tilesAcross * renderer->tilesDown, 1, [renderer, &shading, chunkCount](int first, int last) {
+      for (int tile = first; tile < last; tile++)
+        drawTile(renderer, shading, tile, chunkCount);
+    });
+  }
+}
+
+void presentSoftwareFrame(SoftwareRenderer *renderer) {
+  ProfileScope scope("present", true);
+  int width = renderer->width, height = renderer->height;
+  if (renderer->presentTexture == 0) {
+    glGenTextures(1, &renderer->presentTexture);
+    glGenFramebuffers(1, &renderer->presentFramebuffer);
+  }
+  cachedBindTexture(GL_TEXTURE_2D, renderer->presentTexture);
+  if (renderer->presentSize[0] != width || renderer->presentSize[1] != height) {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    renderer->presentSize[0] = width;
+    renderer->presentSize[1] = height;
+  }
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, renderer->stride);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, renderer->color.data());
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+  GLint target;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &target);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, renderer->presentFramebuffer);
+  glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, renderer->presentTexture, 0);
+  glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+  glBindFramebuffer(GL_FRAMEBUFFER, target);
+}
+
+bool writeSoftwareFrame(const SoftwareRenderer &renderer, const string &filename) {
+  FILE *file;
+  fopen_s(&file, filename.c_str(), "wb");
+  if (file == NULL) {
+    cerr << "Cannot write " << filename << endl;
+    return false;
+  }
+  fprintf(file, "P6\n%d %d\n255\n", renderer.width, renderer.height);
+  // The framebuffer's rows run bottom to top, PPM rows top to bottom.
+  vector<unsigned char> row(renderer.width * 3);
+  for (int y = renderer.height - 1; y >= 0; y--) {
+    for (int x = 0; x < renderer.width; x++) {
+      unsigned pixel = renderer.color[y * renderer.stride + x];
+      for (int i = 0; i < 3; i++)
+        row[x * 3 + i] = (unsigned char) (pixel >> (8 * i));
+    }
+    fwrite(row.data(), 1, row.size(), file);
+  }
+  fclose(file);
+  return true;
+}
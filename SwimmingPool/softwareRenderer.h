@@ -0,0 +1,190 @@
+#pragma once
+/*
+ * Drawing the scene on the CPU, for machines whose OpenGL is itself a
+ * generic software rasterizer.
+ *
+ * A frame is a list of draws, each triangles with one state like a
+ * glDrawElements call with the scene shader, opaque ones first, nearest
+ * first (see opaqueQueue.h), then blended ones in the order to blend
+ * them. drawSoftwareFrame draws them into a framebuffer in memory:
+ *
+ * - Setup: the triangles, a chunk of SOFTWARE_CHUNK_TRIANGLES at a time
+ *   as jobs (see jobs.h), are transformed, clipped to the near plane and
+ *   a guard band around the viewport, culled if they face away, and set
+ *   up as edge functions and planes over the window. Each chunk bins its
+ *   triangles into the SOFTWARE_TILE pixel square tiles they touch.
+ *
+ * - Tiles: each tile is then a job of its own, so no two threads ever
+ *   touch the same pixels. It takes the bins of every chunk in order and
+ *   first rasterizes only the opaque triangles, LANES pixels at a time
+ *   (see simd.h), keeping the nearest triangle of each pixel in a
+ *   visibility buffer. The depth test is hierarchical: the farthest depth
+ *   of every SOFTWARE_BLOCK pixel square block is kept, and a triangle is
+ *   skipped over a block all of which is nearer than it, and only tested
+ *   against the block's pixels where its edges cross it. Every pixel is
+ *   then shaded once, by the triangle left in it, like the scene shader
+ *   shades it (see sceneShader.h) but all at the pixel, where the shader
+ *   does much of it at the vertices: lit by the spot lights and the
+ *   lights of its cluster (see lightClusters.h), textured from the mip
+ *   chain with trilinear filtering and fogged. Last the blended
+ *   triangles are rasterized, shaded and blended as they come.
+ *
+ * The edge shared by two triangles is set up from its two corners in the
+ * same order for both, so every pixel along it is covered by exactly one
+ * of them, however the arithmetic rounds.
+ *
+ * The framebuffer can be shown in the window, copied through a texture
+ * to the framebuffer that is bound, or written to an image file.
+ */
+#include <string>
+#include <vector>
+#include "glFunctions.h"
+#include "instancing.h"
+#include "jobs.h"
+#include "lightClusters.h"
+#include "matrix4.h"
+#include "mipmap.h"
+#include "opaqueQueue.h"
+#include "sceneShader.h"
+#include "staticBatch.h"
+
+const int SOFTWARE_TILE = 64;
+const int SOFTWARE_BLOCK = 8;
+const int SOFTWARE_CHUNK_TRIANGLES = 1024;
+
+/*
+ * Triangles drawn with one state. Each vertex is stride floats, starting
+ * with its position, and with its normal and texture coordinates at the
+ * offsets given. Every three indices are a triangle, counter clockwise
+ * in front; without indices the vertices are a grid of columns quads
+ * across, each split into triangles as water.h splits the water's.
+ */
+struct SoftwareDraw {
+  const float *vertices;
+  int stride;
+  int normalOffset;
+  int texCoordOffset;                 // -1 if untextured.
+  const GLuint *indices;
+  int triangleCount;
+  int columns;                        // Of the grid, without indices.
+  matrix4 modelview;
+  float color[4];
+  SceneMaterial material;
+  int flags;                          // SceneTextured or SceneLitTexture, as for useSceneShader.
+  bool blended;                       // Blended over what is behind it, after the opaque draws.
+};
+
+/*
+ * A triangle set up for rasterizing and shading. Every plane is a x +
+ * b y + c over window coordinates.
+ */
+struct SoftwareTriangle {
+  // Each edge's function, from its corners in a fixed order: a pixel is
+  // inside if it is >= 0, or < 0 if the edge is flipped.
+  float edges[3][3];
+  bool flipped[3];
+  float depth[3];                     // Window depth.
+  float inverseW[3];                  // 1 / w, and the barycentric
+  float weights[2][3];                // weights of corners 1 and 2 over w.
+  float texCoordsOverW[2][3];         // s / w and t / w, if textured.
+  // Corner 0's eye position, normal and texture coordinates, then the
+  // differences from them to corners 1 and 2.
+  float corner[8];
+  float toCorner1[8];
+  float toCorner2[8];
+  float nearest;                      // The least depth of any of it.
+  int box[4];                         // Pixels it may cover, first and last x and y.
+  const SoftwareDraw *draw;
+};
+
+/*
+ * The setup of one chunk of a frame's triangles, and each tile's share
+ * of them.
+ */
+struct SoftwareChunk {
+  std::vector<SoftwareTriangle> triangles;
+  std::vector<std::vector<int> > bins;
+};
+
+struct SoftwareRenderer {
+  int width = 0;
+  int height = 0;
+  int stride = 0;                     // Pixels per row, padded to whole blocks.
+  int rows = 0;                       // Rows, likewise.
+  int tilesAcross = 0;
+  int tilesDown = 0;
+
+  // RGBA pixels, bottom row first as OpenGL has them, and their depths.
+  // The padding has a depth of 0, so nothing is ever drawn there.
+  std::vector<unsigned> color;
+  std::vector<float> depth;
+  std::vector<float> farthest;        // Of each block.
+  std::vector<const SoftwareTriangle *> visible;
+  float clearColor[4] = {0.0, 0.0, 0.0, 0.0};
+
+  // This frame.
+  matrix4 projection;
+  std::vector<SoftwareDraw> draws;
+  std::vector<int> firstTriangles;    // Of each draw, counting every draw before it.
+  std::vector<SoftwareChunk> chunks;
+  const LightClusters *clusters = NULL;
+
+  // The texture, loaded by a job, with no levels if it failed to load.
+  MipChain texture;
+  JobGroup loading;
+
+  // For showing the framebuffer.
+  GLuint presentTexture = 0;
+  GLuint presentFramebuffer = 0;
+  int presentSize[2] = {0, 0};
+};
+
+/*
+ * Make the framebuffer width x height pixels.
+ */
+void resizeSoftwareRenderer(SoftwareRenderer *renderer, int width, int height);
+
+/*
+ * Start loading the mip chain of filename, down to smallest, as RGBA
+ * (see mipmap.h). Until it has loaded, textured surfaces are black.
+ */
+void loadSoftwareTexture(SoftwareRenderer *renderer, const std::string &filename, int smallest);
+bool softwareTextureLoaded(const SoftwareRenderer &renderer);
+
+/*
+ * Start a frame seen through projection, cleared to clearColor and lit
+ * by the scene shader's lights and clusters.
+ */
+void beginSoftwareFrame(SoftwareRenderer *renderer, const matrix4 &projection, const LightClusters &clusters);
+
+void addSoftwareDraw(SoftwareRenderer *renderer, const SoftwareDraw &draw);
+
+/*
+ * Add the draws of queue, in its order, as drawOpaqueQueue would draw
+ * them with view as the modelview matrix. The instance groups are those
+ * of batch, whose levels they are drawn with.
+ */
+void addSoftwareOpaqueQueue(SoftwareRenderer *renderer, const OpaqueQueue &queue,
+                            const InstanceBatch &batch, const matrix4 &view);
+
+/*
+ * Add the blended quads of batch, as drawStaticBlended would draw them.
+ */
+void addSoftwareBlended(SoftwareRenderer *renderer, const StaticBatch &batch, const matrix4 &view);
+
+/*
+ * Draw the frame's draws into the framebuffer.
+ */
+void drawSoftwareFrame(SoftwareRenderer *renderer);
+
+/*
+ * Copy the framebuffer to the bottom left of the bound framebuffer.
+ * Call with a current context.
+ */
+void presentSoftwareFrame(SoftwareRenderer *renderer);
+
+/*
+ * Write the framebuffer as a binary PPM image. Reports the problem on
+ * cerr and returns false if the file cannot be written.
+ */
+bool writeSoftwareFrame(const SoftwareRenderer &renderer, const std::string &filename);
@@ -0,0 +1,183 @@
+/*
+ * Static geometry batching. See staticBatch.h.
+ */
+#include <algorithm>
+#include "glState.h"
+#include "vector3.h"
+#include "profiler.h"
+#include "sceneShader.h"
+#include "staticBatch.h"
+
+using namespace std;
+
+void StaticBatch::setColor(float r, float g, float b, float a) {
+  color[0] = r;
+  color[1] = g;
+  color[2] = b;
+  color[3] = a;
+}
+
+void StaticBatch::setLayer(float r, float g, float b, float a) {
+  layer[0] = r;
+  layer[1] = g;
+  layer[2] = b;
+  layer[3] = a;
+}
+
+void StaticBatch::addQuad(const float corners[4][3], const float texCoords[4][2]) {
+  vector3 first = vector3(corners[0][0], corners[0][1], corners[0][2]);
+  vector3 second = vector3(corners[1][0], corners[1][1], corners[1][2]);
+  vector3 last = vector3(corners[3][0], corners[3][1], corners[3][2]);
+  vector3 normal = second.subtract(first).cross(last.subtract(first)).normalize();
+
+  StaticQuad quad;
+  float *v = quad.vertices;
+  for (int i = 0; i < 4; i++) {
+    *v++ = corners[i][0];
+    *v++ = corners[i][1];
+    *v++ = corners[i][2];
+    *v++ = (texCoords != NULL) ? texCoords[i][0] : 0.0f;
+    *v++ = (texCoords != NULL) ? texCoords[i][1] : 0.0f;
+    *v++ = normal.x;
+    *v++ = normal.y;
+    *v++ = normal.z;
+  }
+
+  quad.textured = (texCoords != NULL);
+  quad.lit = quad.textured && layer[3] != 1.0f;
+  for (int i = 0; i < 4; i++)
+    quad.color[i] = quad.lit ? layer[i] : quad.textured ? 1.0f : color[i];
+  // Otherwise the texture replaces the color, including its alpha.
+  if (quad.textured && !quad.lit)
+    quad.color[3] = 0.0f;
+
+  quads.push_back(quad);
+}
+
+/*
+ * Only untextured quads with a non-zero alpha are blended with what is
+ * behind them (the blend function is GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA).
+ */
+static bool isBlended(const StaticQuad &q) {
+  return !q.textured && q.color[3] != 0.0f;
+}
+
+static bool sameState(const StaticQuad &a, const StaticQuad &b) {
+  return a.textured == b.textured && a.lit == b.lit && equal(a.color, a.color + 4, b.color);
+}
+
+/*
+ * Draw order: opaque quads first so blended quads land on top of them,
+ * then textured before untextured, unlit before lit, then by color. The
+ * sort is stable so blended quads of the same state keep the order they
+ * were added in.
+ */
+static bool drawsBefore(const StaticQuad &a, const StaticQuad &b) {
+  if (isBlended(a) != isBlended(b))
+    return !isBlended(a);
+  if (a.textured != b.textured)
+    return a.textured;
+  if (a.lit != b.lit)
+    return !a.lit;
+  return lexicographical_compare(a.color, a.color + 4, b.color, b.color + 4);
+}
+
+void uploadStaticBatch(StaticBatch *batch) {
+  stable_sort(batch->quads.begin(), batch->quads.end(), drawsBefore);
+
+  vector<float> vertices;
+  vector<GLuint> indices;
+  vertices.reserve(batch->quads.size() * 4 * StaticQuad::FLOATS_PER_VERTEX);
+  indices.reserve(batch->quads.size() * 6);
+
+  batch->buckets.clear();
+  batch->bounds.clear();
+  for (size_t i = 0; i < batch->quads.size(); i++) {
+    const StaticQuad &quad = batch->quads[i];
+    BoundingBox box;
+    for (int corner = 0; corner < 4; corner++) {
+      const float *v = quad.vertices + corner * StaticQuad::FLOATS_PER_VERTEX;
+      box.add(vector3(v[0], v[1], v[2]));
+    }
+    batch->bounds.push_back(box);
+
+    if (i == 0 || !sameState(quad, batch->quads[i - 1])) {
+      StaticBucket bucket;
+      bucket.textured = quad.textured;
+      bucket.lit = quad.lit;
+      copy(quad.color, quad.color + 4, bucket.color);
+      bucket.firstIndex = (GLsizei) indices.size();
+      bucket.indexCount = 0;
+      batch->buckets.push_back(bucket);
+    }
+
+    GLuint first = (GLuint) (i * 4);
+    // Split along the same diagonal as GL_QUADS, so the lighting is
+    // interpolated across the quad exactly as before.
+    GLuint quadIndices[6] = {first, first + 1, first + 3, first + 1, first + 2, first + 3};
+    indices.insert(indices.end(), quadIndices, quadIndices + 6);
+    vertices.insert(vertices.end(), quad.vertices, quad.vertices + 4 * StaticQuad::FLOATS_PER_VERTEX);
+    batch->buckets.back().indexCount += 6;
+  }
+
+  batch->firstBlended = batch->buckets.size();
+  batch->firstBlendedQuad = batch->quads.size();
+  for (size_t i = 0; i < batch->buckets.size(); i++) {
+    const StaticBucket &bucket = batch->buckets[i];
+    if (!bucket.textured && bucket.color[3] != 0.0f) {
+      batch->firstBlended = i;
+      batch->firstBlendedQuad = bucket.firstIndex / 6;
+      break;
+    }
+  }
+
+  const GLsizei stride = StaticQuad::FLOATS_PER_VERTEX * sizeof(float);
+
+  glGenVertexArrays(1, &batch->vao);
+  glBindVertexArray(batch->vao);
+
+  glGenBuffers(1, &batch->vertexBuffer);
+  glBindBuffer(GL_ARRAY_BUFFER, batch->vertexBuffer);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+
+  glGenBuffers(1, &batch->indexBuffer);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch->indexBuffer);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glVertexPointer(3, GL_FLOAT, stride, (const void *) 0);
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+  glTexCoordPointer(2, GL_FLOAT, stride, (const void *) (3 * sizeof(float)));
+  glEnableClientState(GL_NORMAL_ARRAY);
+  glNormalPointer(GL_FLOAT, stride, (const void *) (5 * sizeof(float)));
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/*
+ * Draw count indices from index first on with the state of bucket.
+ */
+static void drawIndices(const StaticBucket &bucket, GLsizei first, GLsizei count) {
+  useSceneShader(ScenePerPixel | (bucket.lit ? SceneLitTexture : bucket.textured ? SceneTextured : 0));
+  useSceneMaterial(DefaultMaterial);
+  cachedColor4fv(bucket.color);
+  glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, (const void *) (first * sizeof(GLuint)));
+}
+
+void drawStaticQuads(const StaticBatch &batch, size_t first, size_t count) {
+  GLsizei firstIndex = (GLsizei) (first * 6);
+  size_t bucket = 0;
+  while (bucket + 1 < batch.buckets.size() && batch.buckets[bucket + 1].firstIndex <= firstIndex)
+    bucket++;
+  glBindVertexArray(batch.vao);
+  drawIndices(batch.buckets[bucket], firstIndex, (GLsizei) (count * 6));
+}
+
+void drawStaticBlended(const StaticBatch &batch) {
+  ProfileScope scope("blended quads", true);
+  glBindVertexArray(batch.vao);
+  for (size_t i = batch.firstBlended; i < batch.buckets.size(); i++)
+    drawIndices(batch.buckets[i], batch.buckets[i].firstIndex, batch.buckets[i].indexCount);
+  glBindVertexArray(0);
+}
@@ -0,0 +1,85 @@
+#pragma once
+/*
+ * Static geometry batching.
+ *
+ * Quads that never change (the deck tiles, pool sides, walls and ceiling)
+ * are collected once at startup. Uploading the batch sorts them by render
+ * state - opaque before blended, then by whether they are textured and
+ * lit and by color - and packs them into one vertex buffer, so drawing
+ * the batch costs one glDrawElements per distinct state.
+ *
+ * The opaque quads are drawn in whatever order the frame wants them (see
+ * opaqueQueue.h), a run of quads of the same state at a time, and any
+ * blended quads then all together on top.
+ */
+#include <vector>
+#include "glFunctions.h"
+#include "bounds.h"
+
+struct StaticQuad {
+  static const int FLOATS_PER_VERTEX = 8;  // Position x, y, z, s, t, then the normal.
+
+  float vertices[4 * FLOATS_PER_VERTEX];
+  bool textured;
+  bool lit;                 // Textured and lit through a layer of color.
+  float color[4];
+};
+
+/*
+ * A run of quads drawn with the same state.
+ */
+struct StaticBucket {
+  bool textured;
+  bool lit;
+  float color[4];
+  GLsizei firstIndex;
+  GLsizei indexCount;
+};
+
+struct StaticBatch {
+  std::vector<StaticQuad> quads;
+  std::vector<StaticBucket> buckets;
+  size_t firstBlended = 0;            // Buckets from here on are blended.
+  size_t firstBlendedQuad = 0;        // And quads.
+  std::vector<BoundingBox> bounds;    // Of each quad.
+
+  GLuint vao = 0;
+  GLuint vertexBuffer = 0;
+  GLuint indexBuffer = 0;
+
+  // The color given to the untextured quads added from now on,
+  // like glColor4f. Textured quads replace their color with the texture.
+  float color[4] = {1.0, 1.0, 1.0, 0.0};
+  void setColor(float r, float g, float b, float a);
+
+  // The layer textured quads added from now on are seen through, lit
+  // like an untextured quad of its color and drawn in the same pass (see
+  // SceneLitTexture). As with the color the alpha is how much shows
+  // through, so an alpha of 1, as to begin with, is no layer at all.
+  float layer[4] = {1.0, 1.0, 1.0, 1.0};
+  void setLayer(float r, float g, float b, float a);
+
+  // Add a quad with its corners given counter clockwise, facing the
+  // side they are counter clockwise from. texCoords may be NULL for an
+  // untextured quad.
+  void addQuad(const float corners[4][3], const float texCoords[4][2]);
+};
+
+/*
+ * Sort the quads into buckets and upload them.
+ * Call once after all the quads have been added.
+ */
+void uploadStaticBatch(StaticBatch *batch);
+
+/*
+ * Draw count opaque quads from quad first on, which must all be in the
+ * same bucket, with the scene shader and the current matrices. Leaves
+ * the batch's vertex array bound.
+ */
+void drawStaticQuads(const StaticBatch &batch, size_t first, size_t count);
+
+/*
+ * Draw the blended buckets like drawStaticQuads, timed as a profile scope
+ * of their own.
+ */
+void drawStaticBlended(const StaticBatch &batch);
@@ -0,0 +1,212 @@
+/*
+ * BC1 compression. See textureCompression.h.
+ */
+#include <algorithm>
+#include <cmath>
+#include "jobs.h"
+#include "textureCompression.h"
+
+using namespace std;
+
+static int quantize565(const float color[3]) {
+  int r = (int) (min(max(color[0], 0.0f), 255.0f) * 31 / 255 + 0.5f);
+  int g = (int) (min(max(color[1], 0.0f), 255.0f) * 63 / 255 + 0.5f);
+  int b = (int) (min(max(color[2], 0.0f), 255.0f) * 31 / 255 + 0.5f);
+  return (r << 11) | (g << 5) | b;
+}
+
+static void expand565(int packed, float color[3]) {
+  int r = (packed >> 11) & 31;
+  int g = (packed >> 5) & 63;
+  int b = packed & 31;
+  color[0] = (float) ((r << 3) | (r >> 2));
+  color[1] = (float) ((g << 2) | (g >> 4));
+  color[2] = (float) ((b << 3) | (b >> 2));
+}
+
+/*
+ * Choose the nearest of the four colors between endpoints a and b for
+ * each pixel. Returns the total squared error.
+ */
+static float chooseIndices(const float pixels[16][3], int a, int b, int indices[16]) {
+  float palette[4][3];
+  expand565(a, palette[0]);
+  expand565(b, palette[1]);
+  for (int c = 0; c < 3; c++) {
+    palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+    palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+  }
+
+  float total = 0;
+  for (int i = 0; i < 16; i++) {
+    float best = 1e30f;
+    for (int p = 0; p < 4; p++) {
+      float dr = pixels[i][0] - palette[p][0];
+      float dg = pixels[i][1] - palette[p][1];
+      float db = pixels[i][2] - palette[p][2];
+      float error = dr * dr + dg * dg + db * db;
+      if (error < best) {
+        best = error;
+        indices[i] = p;
+      }
+    }
+    total += best;
+  }
+  return total;
+}
+
+/*
+ * The endpoints that best fit the pixels, by least squares, if each
+ * pixel is at the fraction of the way from a to b its index gives.
+ * Returns false if the indices do not pin down two endpoints.
+ */
+static bool refitEndpoints(const float pixels[16][3], const int indices[16], int *a, int *b) {
+  static const float weights[4] = {1, 0, 2.0f / 3, 1.0f / 3};
+  float aa = 0, ab = 0, bb = 0;
+  float ax[3] = {0, 0, 0};
+  float bx[3] = {0, 0, 0};
+  for (int i = 0; i < 16; i++) {
+    float w = weights[indices[i]];
+    aa += w * w;
+    ab += w * (1 - w);
+    bb += (1 - w) * (1 - w);
+    for (int c = 0; c < 3; c++) {
+      ax[c] += w * pixels[i][c];
+      bx[c] += (1 - w) * pixels[i][c];
+    }
+  }
+
+  float determinant = aa * bb - ab * ab;
+  if (fabs(determinant) < 1e-6f)
+    return false;
+  float first[3], second[3];
+  for (int c = 0; c < 3; c++) {
+    first[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+    second[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+  }
+  *a = quantize565(first);
+  *b = quantize565(second);
+  return true;
+}
+
+/*
+ * Encode one block of 16 RGB pixels, row by row.
+ */
+static void encodeBlock(const float pixels[16][3], unsigned char *out) {
+  float mean[3] = {0, 0, 0};
+  for (int i = 0; i < 16; i++)
+    for (int c = 0; c < 3; c++)
+      mean[c] += pixels[i][c] / 16;
+
+  float covariance[6] = {0, 0, 0, 0, 0, 0};
+  for (int i = 0; i < 16; i++) {
+    float r = pixels[i][0] - mean[0];
+    float g = pixels[i][1] - mean[1];
+    float b = pixels[i][2] - mean[2];
+    covariance[0] += r * r;
+    covariance[1] += r * g;
+    covariance[2] += r * b;
+    covariance[3] += g * g;
+    covariance[4] += g * b;
+    covariance[5] += b * b;
+  }
+
+  // The principal axis, by a few rounds of power iteration.
+  float axis[3] = {1, 1, 1};
+  for (int round = 0; round < 4; round++) {
+    float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+    float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+    float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+    float length = max(max(fabs(x), fabs(y)), fabs(z));
+    if (length < 1e-6f)
+      break;
+    axis[0] = x / length;
+    axis[1] = y / length;
+    axis[2] = z / length;
+  }
+
+  // Start from the pixels furthest along the axis in either direction.
+  int lowest = 0, highest = 0;
+  float low = 1e30f, high = -1e30f;
+  for (int i = 0; i < 16; i++) {
+    float along = pixels[i][0] * axis[0] + pixels[i][1] * axis[1] + pixels[i][2] * axis[2];
+    if (along < low) {
+      low = along;
+      lowest = i;
+    }
+    if (along > high) {
+      high = along;
+      highest = i;
+    }
+  }
+
+  int a = quantize565(pixels[highest]);
+  int b = quantize565(pixels[lowest]);
+  int indices[16];
+  float error = chooseIndices(pixels, a, b, indices);
+
+  int refitA, refitB;
+  int refitIndices[16];
+  if (refitEndpoints(pixels, indices, &refitA, &refitB)) {
+    float refitError = chooseIndices(pixels, refitA, refitB, refitIndices);
+    if (refitError < error) {
+      a = refitA;
+      b = refitB;
+      copy(refitIndices, refitIndices + 16, indices);
+    }
+  }
+
+  // The first endpoint must be the larger to select the four color
+  // mode; swapping the endpoints swaps 0 with 1 and 2 with 3. Equal
+  // endpoints can only mean one color.
+  if (a < b) {
+    swap(a, b);
+    for (int i = 0; i < 16; i++)
+      indices[i] ^= 1;
+  } else if (a == b) {
+    fill(indices, indices + 16, 0);
+  }
+
+  unsigned int bits = 0;
+  for (int i = 0; i < 16; i++)
+    bits |= (unsigned int) indices[i] << (2 * i);
+  out[0] = (unsigned char) a;
+  out[1] = (unsigned char) (a >> 8);
+  out[2] = (unsigned char) b;
+  out[3] = (unsigned char) (b >> 8);
+  out[4] = (unsigned char) bits;
+  out[5] = (unsigned char) (bits >> 8);
+  out[6] = (unsigned char) (bits >> 16);
+  out[7] = (unsigned char) (bits >> 24);
+}
+
+/*
+ * Encode block rows first .. last - 1. Blocks over the right or top edge
+ * repeat the last column or row of pixels.
+ */
+static void encodeBlockRows(const Bitmap &image, unsigned char *blocks, int first, int last) {
+  int blocksAcross = (image.width + 3) / 4;
+  for (int blockRow = first; blockRow < last; blockRow++) {
+    for (int blockColumn = 0; blockColumn < blocksAcross; blockColumn++) {
+      float pixels[16][3];
+      for (int y = 0; y < 4; y++) {
+        int row = min(blockRow * 4 + y, image.height - 1);
+        for (int x = 0; x < 4; x++) {
+          int column = min(blockColumn * 4 + x, image.width - 1);
+          const unsigned char *pixel = &image.pixels[((size_t) row * image.width + column) * 4];
+          for (int c = 0; c < 3; c++)
+            pixels[y * 4 + x][c] = pixel[c];
+        }
+      }
+      encodeBlock(pixels, blocks + ((size_t) blockRow * blocksAcross + blockColumn) * 8);
+    }
+  }
+}
+
+void compressBC1(const Bitmap &image, vector<unsigned char> *blocks) {
+  blocks->resize(bc1Size(image.width, image.height));
+  unsigned char *out = blocks->data();
+  parallelFor((image.height + 3) / 4, 16, [&](int first, int last) {
+    encodeBlockRows(image, out, first, last);
+  });
+}
@@ -0,0 +1,27 @@
+#pragma once
+/*
+ * BC1 (S3TC DXT1) texture compression.
+ *
+ * BC1 stores each 4x4 block of pixels in 8 bytes: two RGB 5:6:5
+ * endpoint colors and a 2 bit index per pixel choosing an endpoint or one
+ * of the two colors a third and two thirds of the way between them, one
+ * eighth of the size of RGBA. The encoder picks the endpoints along the
+ * principal axis of the block's colors and then refits them by least
+ * squares to the indices chosen, keeping whichever fits better. Rows of
+ * blocks are encoded as jobs (see jobs.h).
+ */
+#include <cstddef>
+#include <vector>
+#include "bitmap.h"
+
+// Bytes of BC1 data for a width x height image.
+inline size_t bc1Size(int width, int height) {
+  return (size_t) ((width + 3) / 4) * ((height + 3) / 4) * 8;
+}
+
+/*
+ * Compress the RGB of image into *blocks, bottom row of blocks first and
+ * left to right along each row, as glCompressedTexImage2D expects.
+ * Alpha is dropped.
+ */
+void compressBC1(const Bitmap &image, std::vector<unsigned char> *blocks);
@@ -0,0 +1,199 @@
+/*
+ * Texture streaming. See textureStream.h.
+ */
+#include <algorithm>
+#include <cstring>
+#include "glState.h"
+#include "profiler.h"
+#include "textureStream.h"
+#include "textureCompression.h"
+
+using namespace std;
+
+// Bytes in each segment of the ring.
+static const size_t SEGMENT_SIZE = 512 * 1024;
+
+TextureStream::TextureStream()
+  : state(Idle), texture(0), smallest(1), format(MipRGBA), loaded(false), succeeded(false),
+    level(-1), row(0), ring(0), mapped(NULL), segment(0) {
+  for (int i = 0; i < RING_SEGMENTS; i++)
+    fences[i] = NULL;
+}
+
+TextureStream::~TextureStream() {
+  loading.wait();
+}
+
+void TextureStream::start(GLuint name, const string &file, int smallestSize, MipFormat mipFormat) {
+  loading.wait();
+  release();
+
+  texture = name;
+  filename = file;
+  smallest = smallestSize;
+  format = mipFormat;
+  state = Loading;
+  loaded = false;
+  loading.run([this] {
+    ProfileScope scope("load texture");
+    succeeded = loadMipChain(filename, smallest, format, &chain);
+    loaded = true;
+  });
+}
+
+bool TextureStream::update(size_t budget) {
+  if (state == Loading) {
+    if (!loaded)
+      return false;
+    loading.wait();
+    if (!succeeded) {
+      state = Idle;
+      return true;
+    }
+    beginStreaming();
+  }
+  if (state != Streaming)
+    return true;
+
+  ProfileScope scope("stream texture", true);
+  cachedBindTexture(GL_TEXTURE_2D, texture);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring);
+  size_t sent = 0;
+  while (level >= 0 && sent < budget) {
+    size_t bytes = uploadChunk();
+    if (bytes == 0)
+      break;
+    sent += bytes;
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  if (level < 0)
+    release();
+  return done();
+}
+
+/*
+ * Give the texture storage for every level, make the smallest one
+ * resident, and set up the ring for the rest.
+ */
+void TextureStream::beginStreaming() {
+  int last = (int) chain.levels.size() - 1;
+  cachedBindTexture(GL_TEXTURE_2D, texture);
+  for (int i = 0; i <= last; i++) {
+    const MipLevel &mip = chain.levels[i];
+    const void *data = (i == last) ? mip.data : NULL;
+    if (format == MipBC1)
+      glCompressedTexImage2D(GL_TEXTURE_2D, i, GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+                             mip.width, mip.height, 0, (GLsizei) mip.size, data);
+    else
+      glTexImage2D(GL_TEXTURE_2D, i, GL_RGB8, mip.width, mip.height, 0,
+                   GL_RGBA, GL_UNSIGNED_BYTE, data);
+  }
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, last);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, last);
+
+  glGenBuffers(1, &ring);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring);
+  GLsizeiptr size = (GLsizeiptr) (SEGMENT_SIZE * RING_SEGMENTS);
+  if (hasGLExtension("GL_ARB_buffer_storage")) {
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags);
+    mapped = (unsigned char *) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+  } else {
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  level = last - 1;
+  row = 0;
+  segment = 0;
+  state = Streaming;
+}
+
+/*
+ * Send the next band of rows through the next segment of the ring.
+ * Returns the bytes sent, or 0 if the segment is still in use.
+ */
+size_t TextureStream::uploadChunk() {
+  GLsync &fence = fences[segment];
+  if (fence != NULL) {
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+      return 0;
+    glDeleteSync(fence);
+    fence = NULL;
+  }
+
+  // Whole rows, or whole rows of blocks, that fit in a segment.
+  const MipLevel &mip = chain.levels[level];
+  int rows;
+  size_t first, bytes;
+  if (format == MipBC1) {
+    size_t blockRow = bc1Size(mip.width, 4);
+    rows = min(mip.height - row, (int) (SEGMENT_SIZE / blockRow) * 4);
+    first = row / 4 * blockRow;
+    bytes = (rows + 3) / 4 * blockRow;
+  } else {
+    size_t pixelRow = (size_t) mip.width * 4;
+    rows = min(mip.height - row, (int) (SEGMENT_SIZE / pixelRow));
+    first = row * pixelRow;
+    bytes = rows * pixelRow;
+  }
+
+  size_t offset = segment * SEGMENT_SIZE;
+  if (mapped != NULL) {
+    memcpy(mapped + offset, mip.data + first, bytes);
+  } else {
+    // The fence already says the GPU is done with this segment.
+    GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+    void *destination = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, bytes, access);
+    if (destination == NULL)
+      return 0;
+    memcpy(destination, mip.data + first, bytes);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+  }
+
+  if (format == MipBC1)
+    glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, row, mip.width, rows,
+                              GL_COMPRESSED_RGB_S3TC_DXT1_EXT, (GLsizei) bytes, (const void *) offset);
+  else
+    glTexSubImage2D(GL_TEXTURE_2D, level, 0, row, mip.width, rows,
+                    GL_RGBA, GL_UNSIGNED_BYTE, (const void *) offset);
+  fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  segment = (segment + 1) % RING_SEGMENTS;
+
+  row += rows;
+  if (row == mip.height) {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+    level--;
+    row = 0;
+  }
+  return bytes;
+}
+
+/*
+ * Free the ring and the chain in memory. The texture keeps its images.
+ */
+void TextureStream::release() {
+  for (int i = 0; i < RING_SEGMENTS; i++) {
+    if (fences[i] != NULL)
+      glDeleteSync(fences[i]);
+    fences[i] = NULL;
+  }
+  if (ring != 0) {
+    if (mapped != NULL) {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring);
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &ring);
+  }
+  ring = 0;
+  mapped = NULL;
+  level = -1;
+
+  chain.levels.clear();
+  chain.built.clear();
+  chain.cache.close();
+  state = Idle;
+}
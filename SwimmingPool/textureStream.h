@@ -0,0 +1,75 @@
+#pragma once
+/*
+ * Streaming a texture's mip chain in without stalling the frame.
+ *
+ * A job (see jobs.h) loads the chain (see mipmap.h), from the cache or
+ * by building it. Once it is in memory, update() makes the smallest level
+ * resident straight away, as a blurry stand in, and then copies the
+ * larger levels a band of rows at a time into a ring of pixel buffer
+ * segments, from which glTexSubImage2D (or glCompressedTexSubImage2D)
+ * takes them without the driver copying them again. Each segment has a
+ * fence; if the GPU is still reading the next one, the upload waits until
+ * the next frame rather than blocking. GL_TEXTURE_BASE_LEVEL follows the
+ * largest level that is complete, so the texture never samples a level
+ * still being filled.
+ *
+ * The ring is mapped once, persistently, where ARB_buffer_storage is
+ * available, and a segment at a time otherwise.
+ */
+#include <atomic>
+#include <string>
+#include "glFunctions.h"
+#include "jobs.h"
+#include "mipmap.h"
+
+class TextureStream {
+public:
+  TextureStream();
+  ~TextureStream();
+
+  // Start loading the mip chain of filename as for loadMipChain, to be
+  // streamed into texture by update(). Any stream still in progress is
+  // abandoned. Call with a current context.
+  void start(GLuint texture, const std::string &filename, int smallest, MipFormat format);
+
+  // Upload up to budget bytes of the chain, if it has loaded. Call once
+  // a frame with a current context. Leaves texture bound to
+  // GL_TEXTURE_2D while streaming. Returns done().
+  bool update(size_t budget);
+
+  // True once every level is resident, or the chain failed to load and
+  // the texture was left without images.
+  bool done() const { return state == Idle; }
+
+private:
+  enum State { Idle, Loading, Streaming };
+  static const int RING_SEGMENTS = 4;
+
+  TextureStream(const TextureStream &);
+  TextureStream &operator=(const TextureStream &);
+
+  void beginStreaming();
+  size_t uploadChunk();
+  void release();
+
+  State state;
+  GLuint texture;
+  std::string filename;
+  int smallest;
+  MipFormat format;
+
+  // Written by the loading job, which sets loaded when it finishes.
+  JobGroup loading;
+  std::atomic<bool> loaded;
+  bool succeeded;
+  MipChain chain;
+
+  // The level being streamed and the next row of it to send.
+  int level;
+  int row;
+
+  GLuint ring;
+  unsigned char *mapped;            // The whole ring, if persistently mapped.
+  GLsync fences[RING_SEGMENTS];     // One per segment, NULL if free.
+  int segment;                      // The next segment to fill.
+};
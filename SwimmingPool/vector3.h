@@ -2,25 +2,54 @@
 /*
  * Unit 8 Section 3 Objective 1 - vector3.h
  * Author Steve Leung
+ *
+ * Header only, so every operation inlines into its callers. Everything but
+ * normalize, reflect and distance can be evaluated at compile time.
+ * See vectorBatch.h for operations on many vectors at once.
  */
+#include <cmath>
+
 class vector3 {
 public:
   // constructors
-  vector3() {};
-  vector3(float x1, float y1, float z1) : x(x1), y(y1), z(z1) {};
-  //  vector3(vector4 v4) : x(v4.x), y(v4.y), z(v4.z) {};
+  constexpr vector3() : x(0), y(0), z(0) {}
+  constexpr vector3(float x1, float y1, float z1) : x(x1), y(y1), z(z1) {}
 
   // methods - vector
-  vector3 normalize();
-  vector3 add(vector3 v);
-  vector3 subtract(vector3 v);
-  vector3 scalar(float f);
-  float dot(vector3 v);
-  vector3 cross(vector3 v);
-  vector3 reflect(vector3 norm);
+  // A zero length vector normalizes to the zero vector.
+  vector3 normalize() const {
+    float lengthSquared = dot(*this);
+    float scale = (lengthSquared > 1e-20f) ? 1 / std::sqrt(lengthSquared) : 0.0f;
+    return vector3(x * scale, y * scale, z * scale);
+  }
+  constexpr vector3 add(const vector3 &v) const {
+    return vector3(x + v.x, y + v.y, z + v.z);
+  }
+  constexpr vector3 subtract(const vector3 &v) const {
+    return vector3(x - v.x, y - v.y, z - v.z);
+  }
+  constexpr vector3 scalar(float f) const {
+    return vector3(x * f, y * f, z * f);
+  }
+  constexpr float dot(const vector3 &v) const {
+    return (x * v.x) + (y * v.y) + (z * v.z);
+  }
+  constexpr vector3 cross(const vector3 &v) const {
+    return vector3((y * v.z) - (z * v.y),
+                   (z * v.x) - (x * v.z),
+                   (x * v.y) - (y * v.x));
+  }
+  vector3 reflect(const vector3 &norm) const {
+    // u = v - 2 * |Inc * Norm| * Norm
+    vector3 n_inc = normalize();
+    return n_inc.subtract(norm.scalar(2 * n_inc.dot(norm)));
+  }
 
   // method - geometry
-  float distance(vector3 v);
+  float distance(const vector3 &v) const {
+    vector3 d = v.subtract(*this);
+    return std::sqrt(d.dot(d));
+  }
 
   // data elements
   float x;
@@ -0,0 +1,121 @@
+#pragma once
+/*
+ * Operations on many vectors at once.
+ *
+ * The vectors are stored as a structure of arrays, one array per
+ * component, so the kernels below can load LANES consecutive x (or y or z)
+ * components into one SIMD register (see simd.h) and process that many
+ * vectors per instruction. The last count % LANES vectors take the plain
+ * scalar path.
+ */
+#include <cstddef>
+#include <vector>
+#include "simd.h"
+#include "vector3.h"
+#include "matrix4.h"
+
+struct vector3Batch {
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+
+  size_t size() const { return x.size(); }
+  void resize(size_t count) {
+    x.resize(count);
+    y.resize(count);
+    z.resize(count);
+  }
+  void set(size_t i, const vector3 &v) {
+    x[i] = v.x;
+    y[i] = v.y;
+    z[i] = v.z;
+  }
+  vector3 get(size_t i) const { return vector3(x[i], y[i], z[i]); }
+};
+
+/*
+ * out[i] = m.transformPoint(in[i]). out may be in.
+ */
+inline void transformPoints(const matrix4 &m, const vector3Batch &in, vector3Batch *out) {
+  size_t count = in.size();
+  out->resize(count);
+
+  const float *x = in.x.data();
+  const float *y = in.y.data();
+  const float *z = in.z.data();
+  float *outX = out->x.data();
+  float *outY = out->y.data();
+  float *outZ = out->z.data();
+
+  // The columns of the matrix, each component in every lane.
+  lanes xAxis[3], yAxis[3], zAxis[3], origin[3];
+  for (int c = 0; c < 3; c++) {
+    xAxis[c] = lanesSet(m.m[c]);
+    yAxis[c] = lanesSet(m.m[4 + c]);
+    zAxis[c] = lanesSet(m.m[8 + c]);
+    origin[c] = lanesSet(m.m[12 + c]);
+  }
+  float *result[3] = {outX, outY, outZ};
+
+  size_t i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    lanes px = lanesLoad(x + i);
+    lanes py = lanesLoad(y + i);
+    lanes pz = lanesLoad(z + i);
+    for (int c = 0; c < 3; c++) {
+      // Summed in the order transformPoint sums them, so the results match.
+      lanes r = lanesAdd(lanesAdd(lanesAdd(lanesMul(xAxis[c], px), lanesMul(yAxis[c], py)),
+                                  lanesMul(zAxis[c], pz)), origin[c]);
+      lanesStore(result[c] + i, r);
+    }
+  }
+  for (; i < count; i++)
+    out->set(i, m.transformPoint(in.get(i)));
+}
+
+/*
+ * Normalize every vector in place, like vector3::normalize.
+ */
+inline void normalizeVectors(vector3Batch *v) {
+  size_t count = v->size();
+  float *x = v->x.data();
+  float *y = v->y.data();
+  float *z = v->z.data();
+
+  // Scaled and cut off to zero as normalize does it, so the results match.
+  lanes tiny = lanesSet(1e-20f);
+  lanes one = lanesSet(1.0f);
+  lanes zero = lanesSet(0.0f);
+
+  size_t i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    lanes vx = lanesLoad(x + i);
+    lanes vy = lanesLoad(y + i);
+    lanes vz = lanesLoad(z + i);
+    lanes lengthSquared = lanesAdd(lanesAdd(lanesMul(vx, vx), lanesMul(vy, vy)), lanesMul(vz, vz));
+    lanes scale = lanesSelectLess(tiny, lengthSquared, lanesDiv(one, lanesSqrt(lengthSquared)), zero);
+    lanesStore(x + i, lanesMul(vx, scale));
+    lanesStore(y + i, lanesMul(vy, scale));
+    lanesStore(z + i, lanesMul(vz, scale));
+  }
+  for (; i < count; i++)
+    v->set(i, v->get(i).normalize());
+}
+
+/*
+ * out[i] = a[i].dot(b[i]).
+ */
+inline void dotProducts(const vector3Batch &a, const vector3Batch &b, std::vector<float> *out) {
+  size_t count = a.size();
+  out->resize(count);
+
+  size_t i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    lanes d = lanesMul(lanesLoad(&a.x[i]), lanesLoad(&b.x[i]));
+    d = lanesAdd(d, lanesMul(lanesLoad(&a.y[i]), lanesLoad(&b.y[i])));
+    d = lanesAdd(d, lanesMul(lanesLoad(&a.z[i]), lanesLoad(&b.z[i])));
+    lanesStore(&(*out)[i], d);
+  }
+  for (; i < count; i++)
+    (*out)[i] = a.get(i).dot(b.get(i));
+}
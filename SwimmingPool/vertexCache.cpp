@@ -0,0 +1,150 @@
+/*
+ * Post-transform vertex cache optimization. See vertexCache.h.
+ */
+#include <vector>
+#include "vertexCache.h"
+
+using namespace std;
+
+/*
+ * Everything Tipsify keeps track of, by vertex and by triangle.
+ */
+struct Tipsify {
+  const vector<GLuint> &indices;
+  int cacheSize;
+
+  vector<int> firstTriangle;          // Triangles using vertex v are
+  vector<int> triangles;              // triangles[firstTriangle[v] .. firstTriangle[v + 1] - 1].
+  vector<int> liveTriangles;          // Not yet emitted triangles using each vertex.
+  vector<int> cacheTime;              // When each vertex last entered the cache.
+  vector<char> emitted;
+  vector<GLuint> deadEnds;            // Recently used vertices, to fall back on.
+  int time;
+  int cursor;                         // Next vertex to try when out of dead ends.
+
+  Tipsify(const vector<GLuint> &i, int vertexCount, int size) : indices(i), cacheSize(size) {
+    int triangleCount = (int) indices.size() / 3;
+    firstTriangle.assign(vertexCount + 1, 0);
+    liveTriangles.assign(vertexCount, 0);
+    for (GLuint v : indices)
+      liveTriangles[v]++;
+    for (int v = 0; v < vertexCount; v++)
+      firstTriangle[v + 1] = firstTriangle[v] + liveTriangles[v];
+
+    vector<int> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+    triangles.resize(indices.size());
+    for (int t = 0; t < triangleCount; t++) {
+      for (int corner = 0; corner < 3; corner++)
+        triangles[filled[indices[3 * t + corner]]++] = t;
+    }
+
+    cacheTime.assign(vertexCount, 0);
+    emitted.assign(triangleCount, 0);
+    time = cacheSize + 1;
+    cursor = 0;
+  }
+
+  /*
+   * The next vertex to fan around: of the vertices the last fan touched,
+   * the one that has been in the cache longest but will still be there
+   * after its remaining triangles are emitted. Otherwise a dead end, or
+   * failing that any vertex with triangles left; -1 when done.
+   */
+  int nextVertex(const vector<GLuint> &candidates) {
+    int best = -1;
+    int bestPriority = -1;
+    for (GLuint v : candidates) {
+      if (liveTriangles[v] > 0) {
+        int priority = 0;
+        if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+          priority = time - cacheTime[v];
+        if (priority > bestPriority) {
+          bestPriority = priority;
+          best = (int) v;
+        }
+      }
+    }
+    if (best >= 0)
+      return best;
+
+    while (!deadEnds.empty()) {
+      GLuint v = deadEnds.back();
+      deadEnds.pop_back();
+      if (liveTriangles[v] > 0)
+        return (int) v;
+    }
+    for (; cursor < (int) liveTriangles.size(); cursor++) {
+      if (liveTriangles[cursor] > 0)
+        return cursor;
+    }
+    return -1;
+  }
+
+  vector<GLuint> run() {
+    vector<GLuint> ordered;
+    ordered.reserve(indices.size());
+    vector<GLuint> candidates;
+
+    int fan = nextVertex(candidates);
+    while (fan >= 0) {
+      candidates.clear();
+      for (int i = firstTriangle[fan]; i < firstTriangle[fan + 1]; i++) {
+        int t = triangles[i];
+        if (emitted[t])
+          continue;
+        emitted[t] = 1;
+
+        // Keep the corners in their original order, and so the winding.
+        for (int corner = 0; corner < 3; corner++) {
+          GLuint v = indices[3 * t + corner];
+          ordered.push_back(v);
+          deadEnds.push_back(v);
+          candidates.push_back(v);
+          liveTriangles[v]--;
+          if (time - cacheTime[v] > cacheSize)
+            cacheTime[v] = time++;
+        }
+      }
+      fan = nextVertex(candidates);
+    }
+    return ordered;
+  }
+};
+
+void optimizeVertexCache(MeshData *data) {
+  int vertexCount = (int) data->vertexCount();
+  vector<GLuint> ordered = Tipsify(data->indices, vertexCount, VERTEX_CACHE_SIZE).run();
+
+  // Number the vertices in the order the triangles first use them.
+  const GLuint unused = (GLuint) -1;
+  vector<GLuint> remap(vertexCount, unused);
+  vector<float> vertices;
+  vertices.reserve(data->vertices.size());
+  for (GLuint &v : ordered) {
+    if (remap[v] == unused) {
+      remap[v] = (GLuint) (vertices.size() / MeshData::FLOATS_PER_VERTEX);
+      const float *vertex = &data->vertices[v * MeshData::FLOATS_PER_VERTEX];
+      vertices.insert(vertices.end(), vertex, vertex + MeshData::FLOATS_PER_VERTEX);
+    }
+    v = remap[v];
+  }
+
+  data->vertices.swap(vertices);
+  data->indices.swap(ordered);
+}
+
+float averageCacheMissRatio(const MeshData &data, int cacheSize) {
+  if (data.indices.empty())
+    return 0;
+
+  // A vertex is in the cache if it entered less than cacheSize misses ago.
+  vector<int> entered(data.vertexCount(), -cacheSize - 1);
+  int misses = 0;
+  for (GLuint v : data.indices) {
+    if (misses - entered[v] > cacheSize) {
+      entered[v] = misses;
+      misses++;
+    }
+  }
+  return (float) misses / (data.indices.size() / 3);
+}
@@ -0,0 +1,28 @@
+#pragma once
+/*
+ * Post-transform vertex cache optimization.
+ *
+ * The GPU keeps the last few transformed vertices in a small cache, so a
+ * vertex shared by neighbouring triangles is only transformed once if the
+ * triangles are drawn close together. optimizeVertexCache reorders the
+ * triangles of a mesh with Tipsify (Sander, Nehab and Barczak, "Fast
+ * Triangle Reordering for Vertex Locality and Reduced Overdraw", 2007) and
+ * then renumbers the vertices in the order the triangles first use them,
+ * so vertex fetches walk through the buffer too.
+ *
+ * The average cache miss ratio (ACMR), transformed vertices per triangle,
+ * measures the result: 3 is the worst possible and about 0.5 the best a
+ * closed mesh can get.
+ */
+#include "mesh.h"
+
+// The cache size the ordering is tuned for and measured with.
+const int VERTEX_CACHE_SIZE = 16;
+
+void optimizeVertexCache(MeshData *data);
+
+/*
+ * The ACMR of drawing data's triangles in order through a first in,
+ * first out cache of cacheSize vertices.
+ */
+float averageCacheMissRatio(const MeshData &data, int cacheSize);
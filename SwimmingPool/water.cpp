@@ -0,0 +1,139 @@
+/*
+ * The water surface in the pool. See water.h.
+ */
+#include "sceneShader.h"
+#include "water.h"
+
+using namespace std;
+
+/*
+ * Triangle indices for a grid of columns x rows quads whose vertex
+ * (row, column) is at row * (columns + 1) + column. Counter clockwise
+ * seen from above when the rows run along -z and the columns along +x.
+ */
+static vector<GLuint> gridIndices(int columns, int rows) {
+  int stride = columns + 1;
+  vector<GLuint> indices;
+  indices.reserve(columns * rows * 6);
+
+  for (int row = 0; row < rows; row++) {
+    for (int column = 0; column < columns; column++) {
+      GLuint a = row * stride + column;
+      GLuint b = a + 1;
+      GLuint c = a + stride + 1;
+      GLuint d = a + stride;
+      indices.push_back(a);
+      indices.push_back(b);
+      indices.push_back(c);
+      indices.push_back(a);
+      indices.push_back(c);
+      indices.push_back(d);
+    }
+  }
+  return indices;
+}
+
+/*
+ * Record a vertex buffer of position, normal, texture coordinate vertices
+ * and an index buffer in a new vertex array object.
+ */
+static GLuint makeWaterArray(GLuint vertexBuffer, GLuint indexBuffer) {
+  const GLsizei stride = BezierPatch::FLOATS_PER_VERTEX * sizeof(float);
+  GLuint vao;
+
+  glGenVertexArrays(1, &vao);
+  glBindVertexArray(vao);
+  glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+
+  // Offsets into the bound vertex buffer.
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glVertexPointer(3, GL_FLOAT, stride, (const void *) 0);
+  glEnableClientState(GL_NORMAL_ARRAY);
+  glNormalPointer(GL_FLOAT, stride, (const void *) (3 * sizeof(float)));
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+  glTexCoordPointer(2, GL_FLOAT, stride, (const void *) (6 * sizeof(float)));
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  return vao;
+}
+
+/*
+ * Make an index buffer for a grid and return its number of indices.
+ */
+static GLsizei makeGridIndexBuffer(int columns, int rows, GLuint *indexBuffer) {
+  vector<GLuint> indices = gridIndices(columns, rows);
+  glGenBuffers(1, indexBuffer);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, *indexBuffer);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  return (GLsizei) indices.size();
+}
+
+static void drawWaterArray(GLuint vao, GLsizei indexCount, bool textured) {
+  useSceneShader(textured ? SceneTextured : 0);
+  glBindVertexArray(vao);
+  glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (const void *) 0);
+  glBindVertexArray(0);
+}
+
+void createWater(WaterSurface *water, int resolution) {
+  int count = resolution + 1;
+  water->resolution = resolution;
+
+  glGenBuffers(1, &water->vertexBuffer);
+  glBindBuffer(GL_ARRAY_BUFFER, water->vertexBuffer);
+  glBufferData(GL_ARRAY_BUFFER, count * count * BezierPatch::FLOATS_PER_VERTEX * sizeof(float),
+               NULL, GL_DYNAMIC_DRAW);
+
+  water->indexCount = makeGridIndexBuffer(resolution, resolution, &water->indexBuffer);
+  water->vao = makeWaterArray(water->vertexBuffer, water->indexBuffer);
+}
+
+void drawWater(WaterSurface *water, bool textured) {
+  if (water->patch.tessellate(water->resolution, &water->vertices)) {
+    glBindBuffer(GL_ARRAY_BUFFER, water->vertexBuffer);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, water->vertices.size() * sizeof(float), water->vertices.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+  drawWaterArray(water->vao, water->indexCount, textured);
+}
+
+void updateWaterVertices(WaterSurface *water) {
+  water->patch.tessellate(water->resolution, &water->vertices);
+}
+
+void createAnimatedWater(AnimatedWater *water, int columns, int rows, int threads) {
+  int count = (columns + 1) * (rows + 1);
+  water->simulation = new WaterSimulation(columns, rows, threads);
+
+  water->indexCount = makeGridIndexBuffer(columns, rows, &water->indexBuffer);
+  glGenBuffers(2, water->vertexBuffer);
+  for (int i = 0; i < 2; i++) {
+    glBindBuffer(GL_ARRAY_BUFFER, water->vertexBuffer[i]);
+    glBufferData(GL_ARRAY_BUFFER, count * WaterSimulation::FLOATS_PER_VERTEX * sizeof(float),
+                 NULL, GL_STREAM_DRAW);
+    water->vao[i] = makeWaterArray(water->vertexBuffer[i], water->indexBuffer);
+  }
+}
+
+bool drawAnimatedWater(AnimatedWater *water, bool textured) {
+  if (water->simulation->takeFrame(&water->vertices)) {
+    water->current = (water->current + 1) % 2;
+    glBindBuffer(GL_ARRAY_BUFFER, water->vertexBuffer[water->current]);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, water->vertices.size() * sizeof(float), water->vertices.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+  if (water->current < 0)
+    return false;
+
+  drawWaterArray(water->vao[water->current], water->indexCount, textured);
+  return true;
+}
+
+bool updateAnimatedWaterVertices(AnimatedWater *water) {
+  water->simulation->takeFrame(&water->vertices);
+  return !water->vertices.empty();
+}
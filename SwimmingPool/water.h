@@ -0,0 +1,80 @@
+#pragma once
+/*
+ * The water surface in the pool.
+ *
+ * Normally a bicubic Bezier patch tessellated on the CPU (see
+ * bezierPatch.h) into a dynamic vertex buffer. The buffer is only
+ * rewritten when the patch changes, so a still surface costs one
+ * glDrawElements a frame.
+ *
+ * Optionally the surface is animated by a WaterSimulation instead (see
+ * waterSimulation.h). Its frames are streamed into two vertex buffers in
+ * turn, so a new frame is never written into the buffer the previous draw
+ * may still be reading from.
+ */
+#include <vector>
+#include "glFunctions.h"
+#include "bezierPatch.h"
+#include "waterSimulation.h"
+
+struct WaterSurface {
+  BezierPatch patch;
+  int resolution = 0;
+
+  std::vector<float> vertices;
+  GLuint vao = 0;
+  GLuint vertexBuffer = 0;
+  GLuint indexBuffer = 0;
+  GLsizei indexCount = 0;
+};
+
+struct AnimatedWater {
+  WaterSimulation *simulation = NULL;
+
+  std::vector<float> vertices;        // The frame last taken from the simulation.
+  GLuint vao[2] = {0, 0};
+  GLuint vertexBuffer[2] = {0, 0};
+  GLuint indexBuffer = 0;
+  GLsizei indexCount = 0;
+  int current = -1;                   // The buffer holding the newest frame, -1 for none yet.
+};
+
+/*
+ * Create the buffers for a grid of resolution x resolution quads.
+ * Set the patch's control points and texture coordinates before drawing.
+ */
+void createWater(WaterSurface *water, int resolution);
+
+/*
+ * Re-tessellate the patch if it changed and draw it with the scene shader
+ * and the current matrices, color and material. The texture is used if
+ * textured is set.
+ */
+void drawWater(WaterSurface *water, bool textured);
+
+/*
+ * Bring water->vertices up to date with the patch without drawing, for
+ * drawing the surface on the CPU instead (see softwareRenderer.h). The
+ * buffer is left as it was, so draw the surface one way or the other.
+ */
+void updateWaterVertices(WaterSurface *water);
+
+/*
+ * Create a stopped simulation of columns x rows quads shared by threads
+ * threads, and the buffers to draw it.
+ */
+void createAnimatedWater(AnimatedWater *water, int columns, int rows, int threads);
+
+/*
+ * Upload the simulation's newest frame, if there is one, and draw the
+ * latest frame uploaded like drawWater. Returns false without drawing if
+ * the simulation has not produced a frame yet.
+ */
+bool drawAnimatedWater(AnimatedWater *water, bool textured);
+
+/*
+ * Take the simulation's newest frame, if there is one, into
+ * water->vertices without uploading it, as updateWaterVertices does.
+ * Returns false if the simulation has not produced a frame yet.
+ */
+bool updateAnimatedWaterVertices(AnimatedWater *water);
@@ -0,0 +1,286 @@
+/*
+ * Animated height field water. See waterSimulation.h.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include "waterSimulation.h"
+#include "simd.h"
+
+using namespace std;
+
+// The pool basin the grid covers.
+static const float WATER_LEFT = -50;
+static const float WATER_RIGHT = 50;
+static const float WATER_NEAR = 100;
+static const float WATER_FAR = -100;
+// Height of the surface at rest.
+static const float WATER_LEVEL = -12;
+
+// Seconds per tick of the simulation thread.
+static const double WATER_TICK = 1.0 / 60.0;
+// Speed of the waves, in scene units per second.
+static const float WAVE_SPEED = 30;
+// Fraction of the motion kept after each solver step.
+static const float WAVE_DAMPING = 0.998f;
+
+WaterSimulation::WaterSimulation(int columns, int rows, int threads)
+  : gridColumns(columns), gridRows(rows), stride(columns + 1),
+    current(0), fresh(false), threadCount(max(threads, 1)),
+    phase(Step), generation(0), pending(0), stopping(false), quitting(false) {
+  spacingX = (WATER_RIGHT - WATER_LEFT) / columns;
+  spacingZ = (WATER_FAR - WATER_NEAR) / rows;
+
+  // The explicit scheme is stable while a wave crosses less than one
+  // cell per step, so take enough steps per tick to keep it under 0.7.
+  float cellsPerTick = WAVE_SPEED * WATER_TICK *
+    sqrt(1 / (spacingX * spacingX) + 1 / (spacingZ * spacingZ));
+  substeps = max(1, (int) ceil(cellsPerTick / 0.7f));
+
+  heights[0].assign(stride * (rows + 1), 0.0f);
+  heights[1].assign(stride * (rows + 1), 0.0f);
+}
+
+WaterSimulation::~WaterSimulation() {
+  stop();
+}
+
+void WaterSimulation::start() {
+  if (running())
+    return;
+
+  stopping = false;
+  quitting = false;
+  for (int slice = 1; slice < threadCount; slice++)
+    workers.push_back(thread(&WaterSimulation::work, this, slice, generation));
+  simulationThread = thread(&WaterSimulation::simulate, this);
+}
+
+void WaterSimulation::stop() {
+  if (!running())
+    return;
+
+  // The simulation thread may be waiting on the workers, so let it
+  // finish its tick before the workers go.
+  {
+    lock_guard<mutex> lock(workLock);
+    stopping = true;
+  }
+  simulationThread.join();
+
+  {
+    lock_guard<mutex> lock(workLock);
+    quitting = true;
+  }
+  workReady.notify_all();
+  for (size_t i = 0; i < workers.size(); i++)
+    workers[i].join();
+  workers.clear();
+}
+
+void WaterSimulation::disturb(float x, float z, float depth, float radius) {
+  lock_guard<mutex> lock(disturbanceLock);
+  Disturbance disturbance = {x, z, depth, radius};
+  disturbances.push_back(disturbance);
+}
+
+bool WaterSimulation::takeFrame(vector<float> *vertices) {
+  lock_guard<mutex> lock(publishLock);
+  if (!fresh)
+    return false;
+  published.swap(*vertices);
+  fresh = false;
+  return true;
+}
+
+/*
+ * The simulation thread: one tick every WATER_TICK seconds. If a tick
+ * overruns, the next one starts straight away rather than trying to
+ * catch up, so the water slows down instead of falling further behind.
+ */
+void WaterSimulation::simulate() {
+  chrono::steady_clock::time_point next = chrono::steady_clock::now();
+  chrono::duration<double> tick(WATER_TICK);
+
+  for (;;) {
+    {
+      lock_guard<mutex> lock(workLock);
+      if (stopping)
+        return;
+    }
+
+    applyDisturbances();
+    for (int i = 0; i < substeps; i++) {
+      runPhase(Step);
+      current = 1 - current;
+    }
+
+    building.resize(stride * (gridRows + 1) * FLOATS_PER_VERTEX);
+    runPhase(Build);
+    {
+      lock_guard<mutex> lock(publishLock);
+      building.swap(published);
+      fresh = true;
+    }
+
+    next += chrono::duration_cast<chrono::steady_clock::duration>(tick);
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    if (next < now)
+      next = now;
+    else
+      this_thread::sleep_until(next);
+  }
+}
+
+/*
+ * A worker thread: runs its slice of every phase the simulation thread
+ * hands out, until told to quit.
+ */
+void WaterSimulation::work(int slice, unsigned seen) {
+  for (;;) {
+    unique_lock<mutex> lock(workLock);
+    workReady.wait(lock, [&] { return generation != seen || quitting; });
+    if (generation == seen)
+      return;
+    seen = generation;
+    Phase task = phase;
+    lock.unlock();
+
+    runSlice(task, slice);
+
+    lock.lock();
+    if (--pending == 0)
+      workDone.notify_one();
+  }
+}
+
+void WaterSimulation::runPhase(Phase next) {
+  {
+    lock_guard<mutex> lock(workLock);
+    phase = next;
+    generation++;
+    pending = threadCount - 1;
+  }
+  workReady.notify_all();
+
+  runSlice(next, 0);
+
+  unique_lock<mutex> lock(workLock);
+  workDone.wait(lock, [&] { return pending == 0; });
+}
+
+void WaterSimulation::runSlice(Phase task, int slice) {
+  int count = gridRows + 1;
+  int first = count * slice / threadCount;
+  int last = count * (slice + 1) / threadCount;
+
+  if (task == Step)
+    stepRows(first, last);
+  else
+    buildRows(first, last);
+}
+
+/*
+ * One leapfrog step of the wave equation for rows first .. last - 1:
+ *   next = (2 current - previous + c^2 dt^2 laplacian(current)) * damping
+ * written over the previous heights. The edges of the grid stay at rest.
+ */
+void WaterSimulation::stepRows(int first, int last) {
+  float dt = (float) (WATER_TICK / substeps);
+  float kx = WAVE_SPEED * WAVE_SPEED * dt * dt / (spacingX * spacingX);
+  float kz = WAVE_SPEED * WAVE_SPEED * dt * dt / (spacingZ * spacingZ);
+
+  const float *now = heights[current].data();
+  float *next = heights[1 - current].data();
+
+  lanes two = lanesSet(2.0f);
+  lanes lanesKx = lanesSet(kx);
+  lanes lanesKz = lanesSet(kz);
+  lanes damping = lanesSet(WAVE_DAMPING);
+
+  for (int row = max(first, 1); row < min(last, gridRows); row++) {
+    const float *c = now + row * stride;
+    float *n = next + row * stride;
+
+    int i = 1;
+    for (; i + LANES < stride; i += LANES) {
+      lanes center = lanesLoad(c + i);
+      lanes twice = lanesMul(two, center);
+      lanes alongX = lanesSub(lanesAdd(lanesLoad(c + i - 1), lanesLoad(c + i + 1)), twice);
+      lanes alongZ = lanesSub(lanesAdd(lanesLoad(c + i - stride), lanesLoad(c + i + stride)), twice);
+      lanes result = lanesSub(twice, lanesLoad(n + i));
+      result = lanesAdd(result, lanesAdd(lanesMul(lanesKx, alongX), lanesMul(lanesKz, alongZ)));
+      lanesStore(n + i, lanesMul(result, damping));
+    }
+    for (; i < stride - 1; i++) {
+      float alongX = c[i - 1] + c[i + 1] - 2 * c[i];
+      float alongZ = c[i - stride] + c[i + stride] - 2 * c[i];
+      n[i] = (2 * c[i] - n[i] + kx * alongX + kz * alongZ) * WAVE_DAMPING;
+    }
+  }
+}
+
+/*
+ * Write the vertices of rows first .. last - 1 of the current heights
+ * into building, with normals from central differences.
+ */
+void WaterSimulation::buildRows(int first, int last) {
+  const float *h = heights[current].data();
+
+  for (int row = first; row < last; row++) {
+    int above = max(row - 1, 0) * stride;
+    int below = min(row + 1, gridRows) * stride;
+    float z = WATER_NEAR + row * spacingZ;
+    float t = 0.5f * row / gridRows;
+    float *out = &building[row * stride * FLOATS_PER_VERTEX];
+
+    for (int column = 0; column < stride; column++) {
+      int left = max(column - 1, 0);
+      int right = min(column + 1, gridColumns);
+      float slopeX = (h[row * stride + right] - h[row * stride + left]) / (2 * spacingX);
+      float slopeZ = (h[below + column] - h[above + column]) / (2 * spacingZ);
+      float length = sqrt(slopeX * slopeX + 1 + slopeZ * slopeZ);
+
+      *out++ = WATER_LEFT + column * spacingX;
+      *out++ = WATER_LEVEL + h[row * stride + column];
+      *out++ = z;
+      *out++ = -slopeX / length;
+      *out++ = 1 / length;
+      *out++ = -slopeZ / length;
+      *out++ = 0.5f * column / gridColumns;
+      *out++ = t;
+    }
+  }
+}
+
+/*
+ * Press a smooth dimple into the surface for each disturbance. Both the
+ * previous and current heights move, so the dimple starts at rest.
+ */
+void WaterSimulation::applyDisturbances() {
+  vector<Disturbance> queued;
+  {
+    lock_guard<mutex> lock(disturbanceLock);
+    queued.swap(disturbances);
+  }
+
+  for (size_t d = 0; d < queued.size(); d++) {
+    const Disturbance &disturbance = queued[d];
+    float reach = 3 * disturbance.radius;
+    int firstColumn = max(1, (int) ((disturbance.x - reach - WATER_LEFT) / spacingX));
+    int lastColumn = min(gridColumns - 1, (int) ((disturbance.x + reach - WATER_LEFT) / spacingX) + 1);
+    int firstRow = max(1, (int) ((disturbance.z + reach - WATER_NEAR) / spacingZ));
+    int lastRow = min(gridRows - 1, (int) ((disturbance.z - reach - WATER_NEAR) / spacingZ) + 1);
+
+    for (int row = firstRow; row <= lastRow; row++) {
+      for (int column = firstColumn; column <= lastColumn; column++) {
+        float dx = WATER_LEFT + column * spacingX - disturbance.x;
+        float dz = WATER_NEAR + row * spacingZ - disturbance.z;
+        float r2 = (dx * dx + dz * dz) / (disturbance.radius * disturbance.radius);
+        float dent = disturbance.depth * exp(-r2);
+        heights[0][row * stride + column] -= dent;
+        heights[1][row * stride + column] -= dent;
+      }
+    }
+  }
+}
@@ -0,0 +1,93 @@
+#pragma once
+/*
+ * Animated water: a height field solved with the wave equation.
+ *
+ * The surface is a grid over the pool basin, x from -50 to 50 and z from
+ * 100 to -100, whose heights are stepped on a fixed timestep by a
+ * simulation thread of its own. Each step is split by rows across worker
+ * threads, with the inner loops over a row done LANES cells at a time (see
+ * simd.h). After every tick the simulation builds a complete vertex array
+ * in the same layout as BezierPatch and publishes it; the renderer takes
+ * the newest published array whenever it likes, so neither side ever waits
+ * for the other beyond swapping two vectors.
+ */
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WaterSimulation {
+public:
+  // Each vertex: position x, y, z, normal x, y, z, texture s, t.
+  static const int FLOATS_PER_VERTEX = 8;
+
+  // A grid of columns x rows quads; columns run along x and rows along z.
+  // threads is the number of threads sharing each step, at least one.
+  WaterSimulation(int columns, int rows, int threads);
+  ~WaterSimulation();
+
+  int columns() const { return gridColumns; }
+  int rows() const { return gridRows; }
+
+  // Start or stop the simulation thread. The surface keeps its state
+  // while stopped.
+  void start();
+  void stop();
+  bool running() const { return simulationThread.joinable(); }
+
+  // Push the surface at (x, z) down by depth, spread over radius.
+  // Applied at the start of the next tick.
+  void disturb(float x, float z, float depth, float radius);
+
+  // If a frame was published since the last call, swap it into *vertices
+  // and return true. Vertex (row, column) is at row * (columns + 1) + column.
+  bool takeFrame(std::vector<float> *vertices);
+
+private:
+  enum Phase { Step, Build };
+  struct Disturbance {
+    float x, z, depth, radius;
+  };
+
+  void simulate();
+  void work(int slice, unsigned seen);
+  void runPhase(Phase next);
+  void runSlice(Phase task, int slice);
+  void stepRows(int first, int last);
+  void buildRows(int first, int last);
+  void applyDisturbances();
+
+  int gridColumns;
+  int gridRows;
+  int stride;                         // Heights per row, columns + 1.
+  float spacingX;                     // Distance between samples along x.
+  float spacingZ;                     // Along z, negative as z decreases.
+  int substeps;                       // Solver steps per tick.
+
+  // The heights at the previous and current step. A step overwrites the
+  // previous heights with the next ones and then swaps the two.
+  std::vector<float> heights[2];
+  int current;
+
+  std::vector<float> building;        // Written by Build.
+  std::vector<float> published;       // Waiting for takeFrame.
+  bool fresh;
+  std::mutex publishLock;
+
+  std::vector<Disturbance> disturbances;
+  std::mutex disturbanceLock;
+
+  // The simulation thread hands each phase to the workers and does the
+  // first slice of rows itself.
+  std::thread simulationThread;
+  std::vector<std::thread> workers;
+  int threadCount;
+  std::mutex workLock;
+  std::condition_variable workReady;
+  std::condition_variable workDone;
+  Phase phase;
+  unsigned generation;
+  int pending;
+  bool stopping;                      // Tells the simulation thread to finish.
+  bool quitting;                      // Tells the workers to finish.
+};